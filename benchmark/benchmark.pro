@@ -0,0 +1,27 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = userdaobenchmark
+
+INCLUDEPATH += $$PWD/..
+
+include(../data/data.pri)
+include(../dao/dao.pri)
+
+# qmake CONFIG+=sqlite 时加入 SQLite 后端（需要已经编译好的 DbUtil）
+sqlite {
+    include(../dao/sqlite.pri)
+}
+
+HEADERS += \
+        serializecheck.h \
+        snapshotcheck.h \
+        userdaobenchmark.h
+
+SOURCES += \
+        main.cpp \
+        serializecheck.cpp \
+        snapshotcheck.cpp \
+        userdaobenchmark.cpp
@@ -0,0 +1,154 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include "serializecheck.h"
+#include "snapshotcheck.h"
+#include "userdaobenchmark.h"
+#include "dao/blockcodec.h"
+#include "dao/userbulkloader.h"
+#include "dao/userdao.h"
+
+/**
+ * @brief 把 input 中的记录（QDataStream 格式，依次用 operator<< 写入的 User）批量加载到 dataFileName，
+ *        替换其中原有的内容。
+ * @return 执行结果
+ */
+static bool bulkLoad(const QString &input, const QString &dataFileName, const QString &format, qint64 memoryBudget)
+{
+    QFile file(input);
+    if (!file.open(QFile::ReadOnly)) {
+        qWarning("Cannot open '%s'", qPrintable(input));
+        return false;
+    }
+
+    UserDao dao(dataFileName);
+    dao.setCompactionRatio(0);
+    if (format == "block" || format == "zlib")
+    {
+        dao.setWriteFormat(UserDao::BlockFormat);
+    }
+    if (format == "zlib")
+    {
+        dao.setCompression(BlockCodec::ZlibCodec);
+    }
+
+    UserBulkLoader loader(&dao, memoryBudget);
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::BigEndian);
+    while (!in.atEnd())
+    {
+        User user;
+        in >> user;
+        if (in.status() != QDataStream::Ok)
+        {
+            qWarning("'%s': bad record after %lld records", qPrintable(input), (long long)loader.count());
+            return false;
+        }
+        if (!loader.add(user))
+        {
+            return false;
+        }
+    }
+    if (!loader.finish())
+    {
+        return false;
+    }
+    QTextStream(stdout) << "loaded " << loader.count() << " records (" << loader.runCount()
+                        << " sorted runs) into " << dataFileName << "\n";
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("userdaobenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("UserDao benchmark, results are written as JSON.");
+    parser.addHelpOption();
+
+    QCommandLineOption recordsOption("records", "Comma separated record counts.", "list", "10000,1000000,10000000");
+    QCommandLineOption operationsOption("operations", "Number of single-record operations per benchmark.", "n", "1000");
+    QCommandLineOption repeatsOption("repeats", "Number of repetitions for full scans.", "n", "5");
+    QCommandLineOption cacheOption("cache", "Cache variants to run: warm, cold or both.", "list", "warm,cold");
+    QCommandLineOption dirOption("dir", "Directory for temporary data files.", "path", QDir::tempPath());
+    QCommandLineOption filterOption("filter", "Only run benchmarks whose name contains this string.", "name");
+    QCommandLineOption formatOption("format", "Write format: row, block or zlib (compressed blocks).", "format", "row");
+    QCommandLineOption sqliteOption("sqlite", "SQLite backend database: file (in --dir) or memory.", "mode", "file");
+    QCommandLineOption outputOption("output", "Write JSON results to this file instead of stdout.", "file");
+    QCommandLineOption checkOption("check", "Run consistency checks (serialization, snapshot isolation with concurrent readers and a writer) instead of benchmarking.");
+    QCommandLineOption readersOption("readers", "Number of reader threads for --check.", "n", "4");
+    QCommandLineOption commitsOption("commits", "Number of writer commits for --check.", "n", "200");
+    QCommandLineOption bulkLoadOption("bulk-load", "Load the Users in this file (QDataStream, written with operator<<) into --into instead of benchmarking.", "file");
+    QCommandLineOption intoOption("into", "Data file for --bulk-load; its previous contents are replaced.", "file", "user.dat");
+    QCommandLineOption memoryOption("memory", "Memory budget in MiB for --bulk-load.", "n", "256");
+    parser.addOptions(QList<QCommandLineOption>() << recordsOption << operationsOption << repeatsOption
+                      << cacheOption << dirOption << filterOption << formatOption << sqliteOption
+                      << outputOption << checkOption << readersOption << commitsOption
+                      << bulkLoadOption << intoOption << memoryOption);
+    parser.process(a);
+
+    if (parser.isSet(bulkLoadOption))
+    {
+        qint64 budget = qMax(1, parser.value(memoryOption).toInt()) * qint64(1024 * 1024);
+        return bulkLoad(parser.value(bulkLoadOption), parser.value(intoOption), parser.value(formatOption), budget) ? 0 : 1;
+    }
+
+    if (parser.isSet(checkOption))
+    {
+        // 检查没有通过时以非 0 退出，脚本可以据此判断失败
+        QStringList failures = SerializeCheck().run();
+        SnapshotCheck check(parser.value(dirOption), parser.value(readersOption).toInt(),
+                            parser.value(commitsOption).toInt());
+        failures << check.run();
+        foreach (const QString &failure, failures)
+        {
+            qWarning("FAILED: %s", qPrintable(failure));
+        }
+        if (!failures.isEmpty())
+        {
+            return 2;
+        }
+        QTextStream(stdout) << "checks passed\n";
+        return 0;
+    }
+
+    UserDaoBenchmark::Options options;
+    foreach (const QString &records, parser.value(recordsOption).split(',', QString::SkipEmptyParts))
+    {
+        options.records.append(records.trimmed().toInt());
+    }
+    options.operations = qMax(1, parser.value(operationsOption).toInt());
+    options.repeats = qMax(1, parser.value(repeatsOption).toInt());
+    QStringList caches = parser.value(cacheOption).split(',');
+    options.warm = caches.contains("warm");
+    options.cold = caches.contains("cold");
+    options.directory = parser.value(dirOption);
+    options.filter = parser.value(filterOption);
+    options.format = parser.value(formatOption);
+    options.sqlite = parser.value(sqliteOption);
+
+    UserDaoBenchmark benchmark(options);
+    QJsonDocument result(benchmark.run());
+
+    if (parser.isSet(outputOption))
+    {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        {
+            qWarning("Cannot open '%s'", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+        file.write(result.toJson());
+        file.close();
+    }
+    else
+    {
+        QTextStream(stdout) << result.toJson();
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "serializecheck.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <QVector>
+
+#include "data/user.h"
+
+static bool sameUser(const User &a, const User &b)
+{
+    return a.id() == b.id() && a.userName() == b.userName() && a.password() == b.password();
+}
+
+static QString describe(const User &user)
+{
+    return QString("(%1, %2, %3)").arg(user.id()).arg(user.userName(), user.password());
+}
+
+QStringList SerializeCheck::run()
+{
+    QStringList failures;
+    QVector<User> users;
+    users << User(1, "alice", "secret")
+          << User(2, QString::fromUtf8("\xe5\xbc\xa0\xe4\xb8\x89"), QString())
+          << User(3, QString(300, QChar('x')), "long name");
+
+    // 批量编码：长度等于各条记录 serializedSize() 之和，逐个解码得到原来的记录
+    QByteArray batch;
+    qint64 expected = 0;
+    foreach (const User &user, users)
+    {
+        expected += user.serializedSize();
+    }
+    if (!SerializeInterface::serializeBatch(users.constBegin(), users.constEnd(), &batch)
+            || batch.size() != expected)
+    {
+        failures << QString("serializeBatch: %1 bytes, expected %2").arg(batch.size()).arg(expected);
+    }
+    else
+    {
+        const uchar *data = reinterpret_cast<const uchar *>(batch.constData());
+        qint64 pos = 0;
+        foreach (const User &user, users)
+        {
+            User decoded;
+            qint64 used = decoded.deSerializeBinary(data + pos, batch.size() - pos);
+            if (used != user.serializedSize() || !sameUser(decoded, user))
+            {
+                failures << QString("batch decode at %1: got %2, expected %3").arg(pos).arg(describe(decoded), describe(user));
+                break;
+            }
+            pos += used;
+        }
+    }
+
+    // 经过 QDataStream 往返
+    QByteArray bytes;
+    {
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        QDataStream out(&buffer);
+        if (!users.at(2).serializeBinary(out))
+        {
+            failures << "serializeBinary(QDataStream &) failed";
+        }
+    }
+    {
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream in(&buffer);
+        User decoded;
+        if (!decoded.deSerializeBinary(in) || !sameUser(decoded, users.at(2)) || !buffer.atEnd())
+        {
+            failures << QString("stream round trip: got %1").arg(describe(decoded));
+        }
+    }
+
+    // 截断的数据：按字段读取的实现和 SerializeInterface 的默认实现（peek 后在内存中解码）都应报告 ReadPastEnd
+    QByteArray truncated = bytes.left(bytes.size() - 1);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        QBuffer buffer(&truncated);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream in(&buffer);
+        User decoded;
+        bool read = pass == 0 ? decoded.deSerializeBinary(in) : decoded.SerializeInterface::deSerializeBinary(in);
+        QString name = pass == 0 ? "FieldSerializable" : "SerializeInterface";
+        if (read || in.status() != QDataStream::ReadPastEnd)
+        {
+            failures << QString("%1: truncated input read %2 with status %3, expected ReadPastEnd")
+                        .arg(name).arg(int(read)).arg(int(in.status()));
+        }
+        if (pass == 1 && buffer.pos() != 0)
+        {
+            failures << QString("%1: truncated input consumed %2 bytes").arg(name).arg(buffer.pos());
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,20 @@
+#ifndef SERIALIZECHECK_H
+#define SERIALIZECHECK_H
+
+#include <QStringList>
+
+/**
+ * @brief 检查 User 通过 SerializeInterface 的编码和解码：批量编码后逐个解码得到原来的记录，
+ *        经过 QDataStream 往返不变，数据被截断时解码失败、流的状态为 ReadPastEnd 且不消耗数据。
+ */
+class SerializeCheck
+{
+public:
+    /**
+     * @brief 执行检查。
+     * @return 没有通过的项，为空表示通过
+     */
+    QStringList run();
+};
+
+#endif // SERIALIZECHECK_H
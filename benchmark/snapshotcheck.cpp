@@ -0,0 +1,205 @@
+#include "snapshotcheck.h"
+#include <QAtomicInt>
+#include <QDir>
+#include <QMutex>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "dao/userdao.h"
+#include "dao/usersnapshot.h"
+
+// 每次提交改写的固定 id 数和追加的新 id 数
+static const int BASE = 1000;
+static const int NEW = 100;
+// 每隔多少次提交压缩一次，压缩替换文件时已有的快照必须仍然可用
+static const int COMPACT_INTERVAL = 20;
+// 每个读线程最多记录的失败数
+static const int MAX_FAILURES = 10;
+
+static QVector<User> makeCommit(int version)
+{
+    QVector<User> users;
+    users.reserve(BASE + NEW);
+    QString password = QString::number(version);
+    for (int id = 0; id < BASE; ++id)
+    {
+        users.append(User(id, "base" + QString::number(id), password));
+    }
+    if (version > 0)
+    {
+        int from = BASE + (version - 1) * NEW;
+        for (int id = from; id < from + NEW; ++id)
+        {
+            users.append(User(id, "new" + QString::number(id), password));
+        }
+    }
+    return users;
+}
+
+/**
+ * @brief 检查一个快照的内容，返回错误说明，没有错误时返回空字符串
+ * @param version[out] 快照对应的版本号
+ */
+static QString checkUsers(const QVector<User> &users, int *version)
+{
+    *version = -1;
+    QSet<quint32> ids;
+    foreach (const User &user, users)
+    {
+        if (ids.contains(user.id()))
+        {
+            return QString("duplicate id %1").arg(user.id());
+        }
+        ids.insert(user.id());
+        if (user.id() == 0)
+        {
+            *version = user.password().toInt();
+        }
+    }
+    if (*version < 0)
+    {
+        return QString("id 0 missing, %1 records").arg(users.size());
+    }
+
+    int expected = BASE + *version * NEW;
+    if (users.size() != expected)
+    {
+        return QString("version %1: %2 records, expected %3").arg(*version).arg(users.size()).arg(expected);
+    }
+    foreach (const User &user, users)
+    {
+        int id = int(user.id());
+        // 固定的 id 是这次提交写入的，新 id 是追加它的那次提交写入的
+        int written = id < BASE ? *version : (id - BASE) / NEW + 1;
+        QString name = (id < BASE ? "base" : "new") + QString::number(id);
+        if (id >= expected || user.userName() != name || user.password() != QString::number(written))
+        {
+            return QString("version %1: unexpected record %2 (%3, %4)")
+                    .arg(*version).arg(id).arg(user.userName(), user.password());
+        }
+    }
+    return QString();
+}
+
+SnapshotCheck::SnapshotCheck(const QString &directory, int readers, int commits)
+    : m_directory(directory)
+    , m_readers(qMax(1, readers))
+    , m_commits(qMax(1, commits))
+{
+
+}
+
+QStringList SnapshotCheck::run()
+{
+    QStringList failures;
+    QTemporaryDir dir(QDir(m_directory).filePath("snapshotcheck-XXXXXX"));
+    if (!dir.isValid())
+    {
+        failures << QString("cannot create temporary directory in '%1'").arg(m_directory);
+        return failures;
+    }
+
+    UserDao dao(dir.path() + "/snapshot.dat");
+    dao.setCompactionRatio(0);
+    if (!dao.insert(makeCommit(0)))
+    {
+        failures << "initial insert failed";
+        return failures;
+    }
+
+    QMutex mutex;
+    QAtomicInt writing(1);
+    QAtomicInt checked(0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_readers);
+    QVector<QFuture<void> > futures;
+    for (int i = 0; i < m_readers; ++i)
+    {
+        futures.append(QtConcurrent::run(&pool, [&, i]() {
+            quint64 lastEpoch = 0;
+            int lastVersion = -1;
+            int count = 0;
+            QStringList errors;
+            auto fail = [&](const QString &error) {
+                if (errors.size() < MAX_FAILURES)
+                {
+                    errors << QString("reader %1: %2").arg(i).arg(error);
+                }
+            };
+
+            do
+            {
+                QSharedPointer<UserSnapshot> snapshot = dao.snapshot();
+                if (!snapshot)
+                {
+                    fail("snapshot() returned null");
+                    continue;
+                }
+
+                int version = -1;
+                QString error = checkUsers(snapshot->selectAll(), &version);
+                if (!error.isEmpty())
+                {
+                    fail(QString("epoch %1: %2").arg(snapshot->epoch()).arg(error));
+                    continue;
+                }
+                // 同一个快照上的范围查询与 selectAll 一致
+                if (snapshot->selectRange(0, BASE - 1).size() != BASE)
+                {
+                    fail(QString("epoch %1: selectRange over the base ids is incomplete").arg(snapshot->epoch()));
+                }
+                if (snapshot->epoch() < lastEpoch || version < lastVersion
+                        || (snapshot->epoch() == lastEpoch && version != lastVersion && lastVersion >= 0))
+                {
+                    fail(QString("went backwards: epoch %1 -> %2, version %3 -> %4")
+                         .arg(lastEpoch).arg(snapshot->epoch()).arg(lastVersion).arg(version));
+                }
+                lastEpoch = snapshot->epoch();
+                lastVersion = version;
+                ++count;
+            } while (writing.loadAcquire());
+
+            checked.fetchAndAddRelaxed(count);
+            QMutexLocker locker(&mutex);
+            failures << errors;
+        }));
+    }
+
+    int committed = 0;
+    for (int version = 1; version <= m_commits; ++version)
+    {
+        if (!dao.insert(makeCommit(version)))
+        {
+            QMutexLocker locker(&mutex);
+            failures << QString("insert of version %1 failed").arg(version);
+            break;
+        }
+        committed = version;
+        if (version % COMPACT_INTERVAL == 0)
+        {
+            // Windows 上有快照映射着原文件时替换会失败，原文件保持不变，这不算错误
+            dao.compact();
+        }
+    }
+    writing.storeRelease(0);
+    for (int i = 0; i < futures.size(); ++i)
+    {
+        futures[i].waitForFinished();
+    }
+
+    // 写入结束后的快照必须是最后一次提交
+    int version = -1;
+    QSharedPointer<UserSnapshot> snapshot = dao.snapshot();
+    QString error = snapshot ? checkUsers(snapshot->selectAll(), &version) : QString("snapshot() returned null");
+    if (!error.isEmpty() || version != committed)
+    {
+        failures << QString("final snapshot: %1").arg(error.isEmpty() ? QString("version %1").arg(version) : error);
+    }
+    if (checked.loadAcquire() == 0)
+    {
+        failures << "no snapshot was checked while writing";
+    }
+    return failures;
+}
@@ -0,0 +1,37 @@
+#ifndef SNAPSHOTCHECK_H
+#define SNAPSHOTCHECK_H
+
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief 检查 UserDao::snapshot() 的隔离性：一个线程持续写入（中间穿插压缩），
+ *        若干读线程同时在快照上查询，验证每个快照都恰好是某一次提交之后的状态。
+ *
+ * 写入者每次提交用一次 insert() 把 BASE 个固定的 id 改写为新的版本号，并追加 NEW 个新 id，
+ * 因此任何一个快照中：固定的 id 都在且版本号相同（记为 v），新 id 恰好是前 v 次提交追加的那些，
+ * 每个 id 只出现一次；同一个读线程看到的序号和版本号都不减少，序号相同时版本号也相同。
+ */
+class SnapshotCheck
+{
+public:
+    /**
+     * @param directory 临时文件所在目录
+     * @param readers 读线程数
+     * @param commits 写入者提交的次数
+     */
+    SnapshotCheck(const QString &directory, int readers, int commits);
+
+    /**
+     * @brief 执行检查。
+     * @return 没有通过的项，为空表示通过
+     */
+    QStringList run();
+
+private:
+    QString m_directory;
+    int m_readers;
+    int m_commits;
+};
+
+#endif // SNAPSHOTCHECK_H
@@ -0,0 +1,865 @@
+#include "userdaobenchmark.h"
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QDebug>
+#include <algorithm>
+#include <random>
+
+#include "dao/userdao.h"
+#include "dao/asyncuserdao.h"
+#include "dao/shardeduserdao.h"
+#include "dao/usersnapshot.h"
+#include "dao/userbulkloader.h"
+#include "dao/idscan.h"
+#include "dao/deltavarint.h"
+#include "dao/blockcodec.h"
+#include "dao/crc32c.h"
+#ifdef USERDAO_SQLITE
+#  include "dao/sqliteuserdao.h"
+#endif
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_MACOS)
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/resource.h>
+#endif
+
+// 批量插入时每次 insert 的记录数
+static const int INSERT_BATCH = 1000000;
+// 范围查询的宽度
+static const quint32 RANGE_WIDTH = 1000;
+// 分片测试的分片数
+static const int SHARDS = 4;
+// select_cached 使用的缓存容量
+static const qint64 CACHE_CAPACITY = 256 * 1024 * 1024;
+// snapshot_scan 中写线程每批插入的记录数和批数
+static const int SNAPSHOT_WRITE_BATCH = 10000;
+static const int SNAPSHOT_WRITE_BATCHES = 100;
+// bulk_load 的内存上限，数据量大时会写出多个有序段
+static const qint64 BULK_LOAD_BUDGET = 64 * 1024 * 1024;
+
+UserDaoBenchmark::UserDaoBenchmark(const Options &options)
+    : m_options(options)
+{
+
+}
+
+QJsonObject UserDaoBenchmark::run()
+{
+    foreach (int records, m_options.records)
+    {
+        runRecords(records);
+    }
+
+    QJsonObject context;
+    context.insert("date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    context.insert("host", QSysInfo::machineHostName());
+    context.insert("cpu_architecture", QSysInfo::currentCpuArchitecture());
+    context.insert("cpus", QThread::idealThreadCount());
+    context.insert("qt_version", QString(qVersion()));
+    context.insert("idscan", QString(IdScan::implementation()));
+    context.insert("deltavarint", QString(DeltaVarint::implementation()));
+    context.insert("crc32c", QString(Crc32c::implementation()));
+#ifdef Q_OS_LINUX
+    context.insert("cold_cache_supported", true);
+#else
+    context.insert("cold_cache_supported", false);
+#endif
+
+    QJsonObject result;
+    result.insert("context", context);
+    result.insert("benchmarks", m_results);
+    return result;
+}
+
+QVector<User> UserDaoBenchmark::makeUsers(int from, int count)
+{
+    QVector<User> users;
+    users.reserve(count);
+    for (int i = from; i < from + count; ++i)
+    {
+        users.append(User(i, "name" + QString::number(i), "field"));
+    }
+    return users;
+}
+
+void UserDaoBenchmark::runRecords(int records)
+{
+    QTemporaryDir dir(QDir(m_options.directory).filePath("userdaobench-XXXXXX"));
+    if (!dir.isValid())
+    {
+        qWarning("UserDaoBenchmark: cannot create temporary directory in '%s'", qPrintable(m_options.directory));
+        return;
+    }
+    m_fileName = dir.path() + "/user.dat";
+    m_indexFileName = UserDao(m_fileName).indexFileName();
+    m_nameIndexFileName = UserDao(m_fileName).nameIndexFileName();
+
+    std::mt19937 random(records);
+    std::uniform_int_distribution<quint32> anyId(0, quint32(qMax(records, 1) - 1));
+
+    // 批量插入：同时生成后面测试用的数据
+    {
+        UserDao dao(m_fileName);
+        configure(dao);
+
+        Sample sample;
+        sample.items = 0;
+        QElapsedTimer total;
+        total.start();
+        for (int from = 0; from < records; from += INSERT_BATCH)
+        {
+            QVector<User> users = makeUsers(from, qMin(INSERT_BATCH, records - from));
+            QElapsedTimer timer;
+            timer.start();
+            dao.insert(users);
+            sample.latencies.append(timer.nsecsElapsed());
+            sample.items += users.size();
+        }
+        sample.elapsed = total.nsecsElapsed();
+        if (enabled("insert"))
+        {
+            report("insert", "warm", records, sample);
+        }
+    }
+
+    if (enabled("insert_sharded") || enabled("select_all_sharded"))
+    {
+        // 分片文件都在同一个临时目录中，这里只体现多个线程并行编码、写入的收益
+        ShardedUserDao dao(ShardedUserDao::shardFileNames(dir.path() + "/sharded.dat", SHARDS));
+        for (int i = 0; i < dao.shardCount(); ++i)
+        {
+            configure(*dao.shard(i));
+        }
+
+        Sample sample;
+        sample.items = 0;
+        QElapsedTimer total;
+        total.start();
+        for (int from = 0; from < records; from += INSERT_BATCH)
+        {
+            QVector<User> users = makeUsers(from, qMin(INSERT_BATCH, records - from));
+            QElapsedTimer timer;
+            timer.start();
+            dao.insert(users);
+            sample.latencies.append(timer.nsecsElapsed());
+            sample.items += users.size();
+        }
+        sample.elapsed = total.nsecsElapsed();
+        if (enabled("insert_sharded"))
+        {
+            report("insert_sharded", "warm", records, sample);
+        }
+
+        if (enabled("select_all_sharded"))
+        {
+            Sample scan;
+            scan.items = 0;
+            scan.elapsed = 0;
+            for (int i = 0; i < m_options.repeats; ++i)
+            {
+                QElapsedTimer timer;
+                timer.start();
+                scan.items += dao.selectAll().size();
+                qint64 elapsed = timer.nsecsElapsed();
+                scan.latencies.append(elapsed);
+                scan.elapsed += elapsed;
+            }
+            report("select_all_sharded", "warm", records, scan);
+        }
+    }
+
+    if (enabled("bulk_load"))
+    {
+        // 按批倒序加入，每批内部有序，整体无序，需要外部排序
+        UserDao dao(dir.path() + "/bulk.dat");
+        configure(dao);
+
+        Sample sample;
+        sample.items = records;
+        QElapsedTimer total;
+        total.start();
+        UserBulkLoader loader(&dao, BULK_LOAD_BUDGET);
+        for (int from = (qMax(records, 1) - 1) / INSERT_BATCH * INSERT_BATCH; from >= 0; from -= INSERT_BATCH)
+        {
+            loader.add(makeUsers(from, qMin(INSERT_BATCH, records - from)));
+        }
+        int runs = loader.runCount();
+        loader.finish();
+        sample.elapsed = total.nsecsElapsed();
+        sample.latencies.append(sample.elapsed);
+        report("bulk_load", "warm", records, sample);
+
+        QJsonObject result = m_results.last().toObject();
+        result.insert("runs", runs);
+        m_results.replace(m_results.size() - 1, result);
+    }
+
+    QStringList caches;
+    if (m_options.warm)
+    {
+        caches << "warm";
+    }
+    if (m_options.cold)
+    {
+        caches << "cold";
+    }
+
+    QVector<quint32> ids(m_options.operations);
+    for (int i = 0; i < ids.size(); ++i)
+    {
+        ids[i] = anyId(random);
+    }
+
+    foreach (const QString &cache, caches)
+    {
+        bool cold = cache == "cold";
+
+        if (enabled("load_index"))
+        {
+            // 新建 UserDao 后第一次查询时加载 id 索引和名字索引的代价，其它测试的冷缓存结果不包含这部分
+            Sample index;
+            index.items = 0;
+            index.elapsed = 0;
+            Sample names = index;
+            {
+                // 名字索引文件不存在时第一次查询会扫描数据文件建立它，先建好，只测量加载
+                UserDao dao(m_fileName);
+                dao.selectByName(QString());
+            }
+            for (int i = 0; i < m_options.repeats; ++i)
+            {
+                if (cold)
+                {
+                    dropCache(m_fileName);
+                    dropCache(m_indexFileName);
+                    dropCache(m_nameIndexFileName);
+                }
+                UserDao dao(m_fileName);
+                configure(dao);
+
+                QElapsedTimer timer;
+                timer.start();
+                dao.contains(0);
+                qint64 elapsed = timer.nsecsElapsed();
+                index.latencies.append(elapsed);
+                index.elapsed += elapsed;
+                index.items += records;
+
+                timer.start();
+                dao.selectByName(QString());
+                elapsed = timer.nsecsElapsed();
+                names.latencies.append(elapsed);
+                names.elapsed += elapsed;
+                names.items += records;
+            }
+            report("load_index", cache, records, index);
+            report("load_name_index", cache, records, names);
+        }
+
+        if (enabled("select_all_stream"))
+        {
+            report("select_all_stream", cache, records, measure(m_options.repeats, cold,
+                [](UserDao &dao, int) -> qint64 {
+                    dao.setReadMode(UserDao::StreamRead);
+                    dao.setParallelism(1);
+                    return dao.selectAll().size();
+                }));
+        }
+
+        if (enabled("select_all_mapped"))
+        {
+            report("select_all_mapped", cache, records, measure(m_options.repeats, cold,
+                [](UserDao &dao, int) -> qint64 {
+                    dao.setReadMode(UserDao::MappedRead);
+                    dao.setParallelism(1);
+                    return dao.selectAll().size();
+                }));
+        }
+
+        if (enabled("select_all_parallel"))
+        {
+            report("select_all_parallel", cache, records, measure(m_options.repeats, cold,
+                [](UserDao &dao, int) -> qint64 {
+                    dao.setReadMode(UserDao::MappedRead);
+                    dao.setParallelism(QThread::idealThreadCount());
+                    return dao.selectAll().size();
+                }));
+        }
+
+        if (enabled("select_all_batch"))
+        {
+            report("select_all_batch", cache, records, measure(m_options.repeats, cold,
+                [](UserDao &dao, int) -> qint64 {
+                    dao.setReadMode(UserDao::MappedRead);
+                    UserBatch batch;
+                    dao.selectAll(&batch);
+                    return batch.size();
+                }));
+        }
+
+        if (enabled("for_each"))
+        {
+            report("for_each", cache, records, measure(m_options.repeats, cold,
+                [](UserDao &dao, int) -> qint64 {
+                    dao.setReadMode(UserDao::MappedRead);
+                    qint64 count = 0;
+                    dao.forEach([&count](const User &) {
+                        ++count;
+                        return true;
+                    });
+                    return count;
+                }));
+        }
+
+        if (enabled("select_range"))
+        {
+            report("select_range", cache, records, measure(m_options.repeats, cold,
+                [&ids](UserDao &dao, int i) -> qint64 {
+                    quint32 lo = ids.isEmpty() ? 0 : ids.at(i % ids.size());
+                    return dao.selectRange(lo, lo + RANGE_WIDTH - 1).size();
+                }));
+        }
+
+        if (enabled("select"))
+        {
+            report("select", cache, records, measure(m_options.operations, cold,
+                [&ids](UserDao &dao, int i) -> qint64 {
+                    dao.select(ids.at(i));
+                    return 1;
+                }));
+        }
+
+        if (enabled("select_missing"))
+        {
+            // 不存在的 id 只查内存中的索引，不读数据文件
+            report("select_missing", cache, records, measure(m_options.operations, cold,
+                [records](UserDao &dao, int i) -> qint64 {
+                    User user;
+                    return dao.select(quint32(records + i), &user) ? 0 : 1;
+                }));
+        }
+
+        if (enabled("select_by_name"))
+        {
+            // 第一次查询时加载（或建立）名字索引，热缓存时在预热中完成
+            report("select_by_name", cache, records, measure(m_options.operations, cold,
+                [&ids](UserDao &dao, int i) -> qint64 {
+                    return dao.selectByName("name" + QString::number(ids.at(i))).size();
+                }));
+        }
+    }
+
+    if (enabled("select_async"))
+    {
+        // 一次提交全部查询，由读线程池流水执行；延迟是提交到结果可用的时间
+        UserDao dao(m_fileName);
+        configure(dao);
+        dao.select(ids.isEmpty() ? 0 : ids.at(0));
+        AsyncUserDao async(&dao);
+
+        Sample sample;
+        sample.items = ids.size();
+        QVector<QFuture<QPair<bool, User> > > futures;
+        futures.reserve(ids.size());
+        QVector<qint64> submitted;
+        submitted.reserve(ids.size());
+        QElapsedTimer total;
+        total.start();
+        foreach (quint32 id, ids)
+        {
+            submitted.append(total.nsecsElapsed());
+            futures.append(async.selectAsync(id));
+        }
+        for (int i = 0; i < futures.size(); ++i)
+        {
+            futures[i].waitForFinished();
+            sample.latencies.append(total.nsecsElapsed() - submitted.at(i));
+        }
+        sample.elapsed = total.nsecsElapsed();
+        report("select_async", "warm", records, sample);
+    }
+
+    if (enabled("select_cached"))
+    {
+        // 缓存能放下全部查询的记录：第一遍填充缓存，只统计第二遍
+        UserDao dao(m_fileName);
+        configure(dao);
+        dao.setCacheCapacity(CACHE_CAPACITY);
+        foreach (quint32 id, ids)
+        {
+            dao.select(id);
+        }
+        dao.resetCacheStats();
+
+        Sample sample;
+        sample.items = ids.size();
+        sample.elapsed = 0;
+        foreach (quint32 id, ids)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            dao.select(id);
+            qint64 elapsed = timer.nsecsElapsed();
+            sample.latencies.append(elapsed);
+            sample.elapsed += elapsed;
+        }
+        report("select_cached", "warm", records, sample);
+
+        QJsonObject result = m_results.last().toObject();
+        result.insert("cache_hit_ratio", dao.cacheStats().hitRatio());
+        m_results.replace(m_results.size() - 1, result);
+    }
+
+    if (enabled("select_instrumented"))
+    {
+        // 与 select 相同，但开启 UserDao 的统计，和 select 对比可以看出统计本身的开销；
+        // 结果中附带统计的 JSON（读写字节数、解码和读设备的耗时、延迟分布）
+        UserDao dao(m_fileName);
+        configure(dao);
+        dao.select(ids.isEmpty() ? 0 : ids.at(0));
+        dao.stats().setEnabled(true);
+        dao.stats().reset();
+
+        Sample sample;
+        sample.items = ids.size();
+        sample.elapsed = 0;
+        foreach (quint32 id, ids)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            dao.select(id);
+            qint64 elapsed = timer.nsecsElapsed();
+            sample.latencies.append(elapsed);
+            sample.elapsed += elapsed;
+        }
+        dao.selectAll();
+        report("select_instrumented", "warm", records, sample);
+
+        QJsonObject result = m_results.last().toObject();
+        result.insert("stats", dao.stats().toJson());
+        m_results.replace(m_results.size() - 1, result);
+    }
+
+    if (enabled("snapshot_scan"))
+    {
+        // 调用线程持续批量插入，同时若干读线程在快照上反复 selectAll，读线程数按 1、2、4... 递增。
+        // 只测量吞吐量和延迟，快照的一致性由 --check 检查（见 SnapshotCheck）
+        QString fileName = dir.path() + "/snapshot.dat";
+        for (int readers = 1; readers <= qMax(1, QThread::idealThreadCount()); readers *= 2)
+        {
+            {
+                UserDao names(fileName);
+                QFile::remove(names.indexFileName());
+                QFile::remove(names.checkpointFileName());
+            }
+            QFile::remove(fileName);
+            QFile::copy(m_fileName, fileName);
+
+            UserDao dao(fileName);
+            configure(dao);
+            // 加载索引并建立第一个快照，不计入结果
+            dao.snapshot();
+
+            QAtomicInt writing(1);
+            QThreadPool pool;
+            pool.setMaxThreadCount(readers);
+            QVector<QFuture<Sample> > futures;
+            QElapsedTimer total;
+            total.start();
+            for (int i = 0; i < readers; ++i)
+            {
+                futures.append(QtConcurrent::run(&pool, [&dao, &writing]() {
+                    Sample sample;
+                    sample.items = 0;
+                    sample.elapsed = 0;
+                    do
+                    {
+                        QElapsedTimer timer;
+                        timer.start();
+                        QSharedPointer<UserSnapshot> snapshot = dao.snapshot();
+                        QVector<User> users = snapshot ? snapshot->selectAll() : QVector<User>();
+                        qint64 elapsed = timer.nsecsElapsed();
+                        sample.latencies.append(elapsed);
+                        sample.elapsed += elapsed;
+                        sample.items += users.size();
+                    } while (writing.loadAcquire());
+                    return sample;
+                }));
+            }
+
+            for (int i = 0; i < SNAPSHOT_WRITE_BATCHES; ++i)
+            {
+                dao.insert(makeUsers(records + i * SNAPSHOT_WRITE_BATCH, SNAPSHOT_WRITE_BATCH));
+            }
+            writing.storeRelease(0);
+
+            Sample sample;
+            sample.items = 0;
+            for (int i = 0; i < futures.size(); ++i)
+            {
+                Sample part = futures[i].result();
+                sample.latencies += part.latencies;
+                sample.items += part.items;
+            }
+            sample.elapsed = total.nsecsElapsed();
+            report(QString("snapshot_scan_%1").arg(readers), "warm", records, sample);
+
+            QJsonObject result = m_results.last().toObject();
+            result.insert("readers", readers);
+            m_results.replace(m_results.size() - 1, result);
+        }
+    }
+
+    // 各个后端使用自己的文件，不影响 m_fileName
+    if (enabled("backend_"))
+    {
+        UserDao dao(dir.path() + "/backend.dat");
+        configure(dao);
+        runBackend("file", dao, QStringList() << dao.fileName() << dao.indexFileName(), records, ids);
+    }
+
+#ifdef USERDAO_SQLITE
+    if (enabled("backend_"))
+    {
+        bool memory = m_options.sqlite == "memory";
+        QString databaseName = memory ? QString(":memory:") : dir.path() + "/backend.db";
+        SqliteUserDao dao(databaseName);
+        if (dao.isOpen())
+        {
+            QStringList files;
+            if (!memory)
+            {
+                files << databaseName << databaseName + "-wal";
+            }
+            runBackend("sqlite", dao, files, records, ids);
+        }
+    }
+#endif
+
+    // 以下测试会修改数据，放在所有读测试之后
+    if (enabled("insert_single"))
+    {
+        report("insert_single", "warm", records, measure(m_options.operations, false,
+            [records](UserDao &dao, int i) -> qint64 {
+                dao.insert(User(records + i, "name" + QString::number(records + i), "field"));
+                return 1;
+            }));
+    }
+
+    if (enabled("insert_queued"))
+    {
+        UserDao dao(m_fileName);
+        configure(dao);
+        dao.setWriteBehind(true);
+
+        Sample sample;
+        sample.items = m_options.operations;
+        QElapsedTimer total;
+        total.start();
+        int base = records + m_options.operations;
+        for (int i = 0; i < m_options.operations; ++i)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            dao.insertQueued(User(base + i, "name" + QString::number(base + i), "field"));
+            sample.latencies.append(timer.nsecsElapsed());
+        }
+        dao.flush();
+        sample.elapsed = total.nsecsElapsed();
+        report("insert_queued", "warm", records, sample);
+    }
+
+    if (enabled("update"))
+    {
+        report("update", "warm", records, measure(m_options.operations, false,
+            [&ids](UserDao &dao, int i) -> qint64 {
+                dao.update(User(ids.at(i), "name" + QString::number(ids.at(i)), "updated"));
+                return 1;
+            }));
+    }
+
+    if (enabled("remove"))
+    {
+        report("remove", "warm", records, measure(m_options.operations, false,
+            [records, this](UserDao &dao, int i) -> qint64 {
+                // 每个 id 只能删除一次，按固定步长挑选不重复的 id
+                int step = qMax(1, records / qMax(1, m_options.operations));
+                dao.remove(User(i * step, QString(), QString()));
+                return 1;
+            }));
+    }
+
+    if (enabled("compact"))
+    {
+        report("compact", "warm", records, measure(1, false,
+            [](UserDao &dao, int) -> qint64 {
+                dao.compact();
+                return 1;
+            }));
+    }
+}
+
+void UserDaoBenchmark::runBackend(const QString &backend, UserStore &store, const QStringList &files,
+                                  int records, const QVector<quint32> &ids)
+{
+    // report() 按 m_fileName 计算占用的空间，这里换成后端自己的文件
+    auto annotate = [&]() {
+        qint64 bytes = 0;
+        foreach (const QString &file, files)
+        {
+            bytes += QFileInfo(file).size();
+        }
+        QJsonObject result = m_results.last().toObject();
+        result.insert("backend", backend);
+        result.insert("file_bytes", double(bytes));
+        result.insert("bytes_per_record", records > 0 ? double(bytes) / records : 0.0);
+        result.remove("index_bytes_per_record");
+        m_results.replace(m_results.size() - 1, result);
+    };
+
+    // 后面的测试都依赖插入的数据，因此总是执行，只在启用时报告
+    Sample insert;
+    insert.items = 0;
+    insert.elapsed = 0;
+    for (int from = 0; from < records; from += INSERT_BATCH)
+    {
+        QVector<User> users = makeUsers(from, qMin(INSERT_BATCH, records - from));
+        QElapsedTimer timer;
+        timer.start();
+        store.insert(users);
+        qint64 elapsed = timer.nsecsElapsed();
+        insert.latencies.append(elapsed);
+        insert.elapsed += elapsed;
+        insert.items += users.size();
+    }
+    if (enabled("backend_insert"))
+    {
+        report("backend_insert", "warm", records, insert);
+        annotate();
+    }
+
+    if (enabled("backend_select"))
+    {
+        report("backend_select", "warm", records, measure(ids.size(),
+            [&store, &ids](int i) -> qint64 {
+                User user;
+                return store.select(ids.at(i), &user) ? 1 : 0;
+            }));
+        annotate();
+    }
+
+    if (enabled("backend_select_all"))
+    {
+        report("backend_select_all", "warm", records, measure(m_options.repeats,
+            [&store](int) -> qint64 {
+                return store.selectAll().size();
+            }));
+        annotate();
+    }
+
+    if (enabled("backend_select_range"))
+    {
+        report("backend_select_range", "warm", records, measure(ids.size(),
+            [&store, &ids](int i) -> qint64 {
+                return store.selectRange(ids.at(i), ids.at(i) + RANGE_WIDTH - 1).size();
+            }));
+        annotate();
+    }
+
+    if (enabled("backend_select_by_name"))
+    {
+        report("backend_select_by_name", "warm", records, measure(ids.size(),
+            [&store, &ids](int i) -> qint64 {
+                return store.selectByName("name" + QString::number(ids.at(i))).size();
+            }));
+        annotate();
+    }
+
+    if (enabled("backend_update"))
+    {
+        report("backend_update", "warm", records, measure(ids.size(),
+            [&store, &ids](int i) -> qint64 {
+                store.update(QVector<User>() << User(ids.at(i), "name" + QString::number(ids.at(i)), "updated"));
+                return 1;
+            }));
+        annotate();
+    }
+
+    if (enabled("backend_remove"))
+    {
+        // 每个 id 只能删除一次，按固定步长挑选不重复的 id
+        int step = qMax(1, records / qMax(1, m_options.operations));
+        int times = qMin(m_options.operations, records);
+        report("backend_remove", "warm", records, measure(times,
+            [&store, step](int i) -> qint64 {
+                store.remove(QVector<User>() << User(i * step, QString(), QString()));
+                return 1;
+            }));
+        annotate();
+    }
+}
+
+void UserDaoBenchmark::configure(UserDao &dao) const
+{
+    dao.setCompactionRatio(0);
+    if (m_options.format == "block" || m_options.format == "zlib")
+    {
+        dao.setWriteFormat(UserDao::BlockFormat);
+    }
+    if (m_options.format == "zlib")
+    {
+        dao.setCompression(BlockCodec::ZlibCodec);
+    }
+}
+
+bool UserDaoBenchmark::enabled(const QString &name) const
+{
+    return m_options.filter.isEmpty() || name.contains(m_options.filter);
+}
+
+UserDaoBenchmark::Sample UserDaoBenchmark::measure(int times, bool cold,
+                                                   const std::function<qint64(UserDao &, int)> &op)
+{
+    Sample sample;
+    sample.items = 0;
+    sample.elapsed = 0;
+    sample.latencies.reserve(times);
+
+    UserDao dao(m_fileName);
+    configure(dao);
+    if (cold)
+    {
+        // 冷缓存：id 索引和名字索引只在这里加载一次，不计入结果（加载的代价见 load_index），
+        // 之后每次执行前只把数据文件移出页缓存
+        dao.contains(0);
+        dao.selectByName(QString());
+    }
+    else
+    {
+        // 热缓存：先执行一次（加载索引、建立映射、预热页缓存），不计入结果
+        op(dao, 0);
+    }
+
+    for (int i = 0; i < times; ++i)
+    {
+        if (cold)
+        {
+            // 映射住的页不会被移出页缓存，先取消数据文件的映射，下次读取时重新映射
+            UserDao::ReadMode mode = dao.readMode();
+            dao.setReadMode(UserDao::StreamRead);
+            dao.setReadMode(mode);
+            dropCache(m_fileName);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        sample.items += op(dao, i);
+        qint64 elapsed = timer.nsecsElapsed();
+        sample.latencies.append(elapsed);
+        sample.elapsed += elapsed;
+    }
+    return sample;
+}
+
+UserDaoBenchmark::Sample UserDaoBenchmark::measure(int times, const std::function<qint64(int)> &op)
+{
+    Sample sample;
+    sample.items = 0;
+    sample.elapsed = 0;
+    sample.latencies.reserve(times);
+    for (int i = 0; i < times; ++i)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        sample.items += op(i);
+        qint64 elapsed = timer.nsecsElapsed();
+        sample.latencies.append(elapsed);
+        sample.elapsed += elapsed;
+    }
+    return sample;
+}
+
+void UserDaoBenchmark::report(const QString &name, const QString &cache, int records, const Sample &sample)
+{
+    QVector<qint64> latencies = sample.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    qint64 p50 = 0;
+    qint64 p99 = 0;
+    if (!latencies.isEmpty())
+    {
+        p50 = latencies.at((latencies.size() - 1) / 2);
+        p99 = latencies.at(qMin(latencies.size() - 1, int(latencies.size() * 0.99)));
+    }
+
+    double seconds = sample.elapsed / 1e9;
+    QFileInfo data(m_fileName);
+    QFileInfo index(m_indexFileName);
+
+    QJsonObject result;
+    result.insert("name", name);
+    result.insert("records", records);
+    result.insert("cache", cache);
+    result.insert("format", m_options.format);
+    result.insert("iterations", latencies.size());
+    result.insert("items", double(sample.items));
+    result.insert("elapsed_ns", double(sample.elapsed));
+    result.insert("ops_per_second", seconds > 0 ? latencies.size() / seconds : 0.0);
+    result.insert("items_per_second", seconds > 0 ? sample.items / seconds : 0.0);
+    result.insert("p50_ns", double(p50));
+    result.insert("p99_ns", double(p99));
+    result.insert("file_bytes", double(data.size()));
+    result.insert("bytes_per_record", records > 0 ? double(data.size()) / records : 0.0);
+    result.insert("index_bytes_per_record", records > 0 ? double(index.size()) / records : 0.0);
+    result.insert("peak_rss_kb", double(peakRss()));
+    m_results.append(result);
+
+    qDebug().noquote() << QString("%1 %2 %3: %4 items/s, p50 %5 us, p99 %6 us")
+                          .arg(name, -20).arg(records).arg(cache)
+                          .arg(seconds > 0 ? sample.items / seconds : 0.0, 0, 'f', 0)
+                          .arg(p50 / 1000.0, 0, 'f', 1)
+                          .arg(p99 / 1000.0, 0, 'f', 1);
+}
+
+bool UserDaoBenchmark::dropCache(const QString &fileName)
+{
+#ifdef Q_OS_LINUX
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        return false;
+    }
+    // 先把脏页写回，否则 DONTNEED 对它们无效
+    ::fdatasync(file.handle());
+    bool ok = ::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED) == 0;
+    file.close();
+    return ok;
+#else
+    Q_UNUSED(fileName);
+    return false;
+#endif
+}
+
+qint64 UserDaoBenchmark::peakRss()
+{
+#if defined(Q_OS_LINUX)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#elif defined(Q_OS_MACOS)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+#else
+    return 0;
+#endif
+}
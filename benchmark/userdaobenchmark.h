@@ -0,0 +1,106 @@
+#ifndef USERDAOBENCHMARK_H
+#define USERDAOBENCHMARK_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+#include "data/user.h"
+
+class UserDao;
+class UserStore;
+
+/**
+ * @brief UserDao 的基准测试。
+ *
+ * 每种数据量在单独的临时目录中生成数据文件，依次测量批量插入、各种读取方式（冷/热缓存）、
+ * 单条插入、后台批量插入、更新、删除和压缩，结果以 JSON 输出：
+ * 吞吐量、p50/p99 延迟、每条记录占用的字节数以及进程的峰值内存。
+ *
+ * backend_* 测试通过 UserStore 接口在各个存储后端上执行同样的负载，结果中 backend 字段区分后端：
+ * file（user.dat），以及用 CONFIG+=sqlite 编译时的 sqlite（SqliteUserDao）。
+ */
+class UserDaoBenchmark
+{
+public:
+    struct Options
+    {
+        QList<int> records;   ///< 要测试的数据量
+        int operations;       ///< select/update/remove 等单条操作的次数
+        int repeats;          ///< selectAll 等整体操作的重复次数
+        bool cold;            ///< 是否测试冷缓存
+        bool warm;            ///< 是否测试热缓存
+        QString directory;    ///< 临时文件所在目录
+        QString filter;       ///< 只运行名字包含该字符串的测试
+        QString format;       ///< 写入格式：row、block 或 zlib（压缩的数据块）
+        QString sqlite;       ///< SQLite 后端的数据库：file（临时目录中的文件）或 memory（内存数据库）
+    };
+
+    explicit UserDaoBenchmark(const Options &options);
+
+    /**
+     * @brief 运行所有测试。
+     * @return 测试结果（JSON）
+     */
+    QJsonObject run();
+
+    static QVector<User> makeUsers(int from, int count);
+
+private:
+    struct Sample
+    {
+        QVector<qint64> latencies; ///< 每次操作的耗时（纳秒）
+        qint64 items;              ///< 处理的记录总数
+        qint64 elapsed;            ///< 总耗时（纳秒）
+    };
+
+    void runRecords(int records);
+
+    /**
+     * @brief 在一个存储后端上依次测量批量插入、按 id 查询、全部查询、范围查询、按名字查询、更新和删除。
+     * @param backend 后端的名字，写入结果的 backend 字段
+     * @param files 后端的数据文件，用于计算每条记录占用的字节数（内存数据库为空）
+     * @param ids 按 id 查询和更新使用的 id
+     */
+    void runBackend(const QString &backend, UserStore &store, const QStringList &files,
+                    int records, const QVector<quint32> &ids);
+
+    /**
+     * @brief 按 Options::format 设置写入格式，并关闭自动压缩以免干扰测量
+     */
+    void configure(UserDao &dao) const;
+
+    bool enabled(const QString &name) const;
+
+    /**
+     * @brief 重复执行 op，记录每次的耗时。cold 为 true 时先加载索引（不计时），
+     *        之后每次执行前取消数据文件的映射并把它移出页缓存，测量的是冷页缓存下的查询而不是加载索引。
+     * @param op 执行一次操作，返回处理的记录数
+     */
+    Sample measure(int times, bool cold, const std::function<qint64(UserDao &, int)> &op);
+
+    /**
+     * @brief 重复执行 op，记录每次的耗时，不做预热。
+     */
+    static Sample measure(int times, const std::function<qint64(int)> &op);
+
+    void report(const QString &name, const QString &cache, int records, const Sample &sample);
+
+    /**
+     * @brief 把文件从页缓存中移除（仅 Linux 有效）
+     */
+    static bool dropCache(const QString &fileName);
+
+    static qint64 peakRss();
+
+    Options m_options;
+    QString m_fileName;
+    QString m_indexFileName;
+    QString m_nameIndexFileName;
+    QJsonArray m_results;
+};
+
+#endif // USERDAOBENCHMARK_H
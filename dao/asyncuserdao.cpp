@@ -0,0 +1,106 @@
+#include "asyncuserdao.h"
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "userdao.h"
+
+AsyncUserDao::AsyncUserDao(UserDao *dao, int readThreads)
+    : m_dao(dao)
+{
+    m_readPool.setMaxThreadCount(readThreads > 0 ? readThreads : qMax(1, QThread::idealThreadCount()));
+    // 只有一个线程时任务按提交顺序逐个执行，写入的顺序与调用顺序相同
+    m_writePool.setMaxThreadCount(1);
+    // I/O 线程常驻，避免空闲一段时间后每次提交都重新创建线程
+    m_readPool.setExpiryTimeout(-1);
+    m_writePool.setExpiryTimeout(-1);
+}
+
+AsyncUserDao::~AsyncUserDao()
+{
+    waitForDone();
+}
+
+UserDao *AsyncUserDao::dao() const
+{
+    return m_dao;
+}
+
+QFuture<QPair<bool, User> > AsyncUserDao::selectAsync(quint32 id)
+{
+    UserDao *dao = m_dao;
+    return QtConcurrent::run(&m_readPool, [dao, id]() {
+        QPair<bool, User> result;
+        result.first = dao->select(id, &result.second);
+        return result;
+    });
+}
+
+QFuture<QVector<User> > AsyncUserDao::selectAllAsync()
+{
+    UserDao *dao = m_dao;
+    return QtConcurrent::run(&m_readPool, [dao]() {
+        return dao->selectAll();
+    });
+}
+
+QFuture<QVector<User> > AsyncUserDao::selectRangeAsync(quint32 lo, quint32 hi)
+{
+    UserDao *dao = m_dao;
+    return QtConcurrent::run(&m_readPool, [dao, lo, hi]() {
+        return dao->selectRange(lo, hi);
+    });
+}
+
+QFuture<bool> AsyncUserDao::insertAsync(const User &user)
+{
+    return insertAsync(QVector<User>() << user);
+}
+
+QFuture<bool> AsyncUserDao::insertAsync(const QVector<User> &users)
+{
+    UserDao *dao = m_dao;
+    return QtConcurrent::run(&m_writePool, [dao, users]() {
+        return dao->insert(users);
+    });
+}
+
+QFuture<bool> AsyncUserDao::updateAsync(const User &user)
+{
+    return updateAsync(QVector<User>() << user);
+}
+
+QFuture<bool> AsyncUserDao::updateAsync(const QVector<User> &users)
+{
+    UserDao *dao = m_dao;
+    return QtConcurrent::run(&m_writePool, [dao, users]() {
+        return dao->update(users);
+    });
+}
+
+QFuture<bool> AsyncUserDao::removeAsync(const User &user)
+{
+    return removeAsync(QVector<User>() << user);
+}
+
+QFuture<bool> AsyncUserDao::removeAsync(const QVector<User> &users)
+{
+    UserDao *dao = m_dao;
+    return QtConcurrent::run(&m_writePool, [dao, users]() {
+        return dao->remove(users);
+    });
+}
+
+QFuture<bool> AsyncUserDao::syncAsync()
+{
+    UserDao *dao = m_dao;
+    return QtConcurrent::run(&m_writePool, [dao]() {
+        bool flushed = dao->flush();
+        return dao->checkpoint() && flushed;
+    });
+}
+
+void AsyncUserDao::waitForDone()
+{
+    m_writePool.waitForDone();
+    m_readPool.waitForDone();
+}
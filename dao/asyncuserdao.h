@@ -0,0 +1,68 @@
+#ifndef ASYNCUSERDAO_H
+#define ASYNCUSERDAO_H
+
+#include <QFuture>
+#include <QPair>
+#include <QThreadPool>
+#include <QVector>
+#include "data/user.h"
+
+class UserDao;
+
+/**
+ * @brief UserDao 的异步接口：每个操作放到 I/O 线程中执行，立即返回 QFuture，
+ *        事件循环中可以用 QFutureWatcher 等待结果而不阻塞。
+ *
+ * 读操作在读线程池中执行，互相独立的查询可以同时进行（UserDao 的读操作只持有读锁）；
+ * 写操作由一个专用的写线程按提交的顺序逐个执行，先提交的写入一定先完成。
+ * 读和写之间不排序：读操作只保证能看到 future 已经完成的写入。
+ *
+ * 不拥有 UserDao，析构时等待所有已提交的操作完成，UserDao 需要比它活得更久。
+ */
+class AsyncUserDao
+{
+    Q_DISABLE_COPY(AsyncUserDao)
+
+public:
+    /**
+     * @param dao 实际执行读写的 UserDao
+     * @param readThreads 读线程数，0 表示 CPU 核数
+     */
+    explicit AsyncUserDao(UserDao *dao, int readThreads = 0);
+    ~AsyncUserDao();
+
+    UserDao *dao() const;
+
+    /**
+     * @brief 异步执行 UserDao::select(id, User *)。
+     * @return first 为 false 表示记录不存在（或者已经删除），此时 second 是默认构造的 User
+     */
+    QFuture<QPair<bool, User> > selectAsync(quint32 id);
+    QFuture<QVector<User> > selectAllAsync();
+    QFuture<QVector<User> > selectRangeAsync(quint32 lo, quint32 hi);
+
+    QFuture<bool> insertAsync(const User &user);
+    QFuture<bool> insertAsync(const QVector<User> &users);
+    QFuture<bool> updateAsync(const User &user);
+    QFuture<bool> updateAsync(const QVector<User> &users);
+    QFuture<bool> removeAsync(const User &user);
+    QFuture<bool> removeAsync(const QVector<User> &users);
+
+    /**
+     * @brief 排在之前提交的写操作之后执行 UserDao::flush() 和 UserDao::checkpoint()，
+     *        future 完成时之前提交的写入都已经落盘。
+     */
+    QFuture<bool> syncAsync();
+
+    /**
+     * @brief 等待所有已提交的操作完成。
+     */
+    void waitForDone();
+
+private:
+    UserDao *m_dao;
+    QThreadPool m_readPool;
+    QThreadPool m_writePool;
+};
+
+#endif // ASYNCUSERDAO_H
@@ -0,0 +1,73 @@
+#include "blockcodec.h"
+#include <QMutex>
+#include <QMutexLocker>
+
+// 按 id 保存已注册的压缩算法
+static const BlockCodec *codecs[BlockCodec::MaxCodec + 1] = { nullptr };
+static QMutex codecMutex;
+
+static void registerDefaultCodecs()
+{
+    // 速度优先：块在每次扫描时都要解压，压缩级别 1 的压缩率已经足够
+    static ZlibBlockCodec zlib(1);
+    if (!codecs[BlockCodec::ZlibCodec])
+    {
+        codecs[BlockCodec::ZlibCodec] = &zlib;
+    }
+}
+
+const BlockCodec *BlockCodec::codec(quint8 id)
+{
+    if (id == NoCodec || id > MaxCodec)
+    {
+        return nullptr;
+    }
+    QMutexLocker locker(&codecMutex);
+    registerDefaultCodecs();
+    return codecs[id];
+}
+
+void BlockCodec::registerCodec(const BlockCodec *codec)
+{
+    if (!codec || codec->id() == NoCodec || codec->id() > MaxCodec)
+    {
+        return;
+    }
+    QMutexLocker locker(&codecMutex);
+    registerDefaultCodecs();
+    codecs[codec->id()] = codec;
+}
+
+ZlibBlockCodec::ZlibBlockCodec(int level)
+    : m_level(level)
+{
+
+}
+
+quint8 ZlibBlockCodec::id() const
+{
+    return ZlibCodec;
+}
+
+QString ZlibBlockCodec::name() const
+{
+    return "zlib";
+}
+
+bool ZlibBlockCodec::compress(const char *data, int size, QByteArray *out) const
+{
+    QByteArray compressed = qCompress(reinterpret_cast<const uchar *>(data), size, m_level);
+    if (compressed.isEmpty())
+    {
+        return false;
+    }
+    out->append(compressed);
+    return true;
+}
+
+bool ZlibBlockCodec::decompress(const uchar *data, int size, QByteArray *out) const
+{
+    *out = qUncompress(data, size);
+    // qUncompress 出错时返回空数组，合法的块至少包含 count 和一个 id
+    return !out->isEmpty();
+}
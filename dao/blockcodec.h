@@ -0,0 +1,70 @@
+#ifndef BLOCKCODEC_H
+#define BLOCKCODEC_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @brief 数据块的压缩算法。
+ *
+ * 压缩以数据块为单位，压缩后的块仍然是一条独立的记录，按索引随机读取时只需要解压命中的那一块。
+ * 记录头 flags 的低 4 位保存压缩算法的 id（见 UserFormat::CodecMask），0 表示没有压缩。
+ * 默认只注册了 zlib（qCompress），其他算法（例如 LZ4）可以实现这个接口后通过 registerCodec() 加入，
+ * 写入和读取的程序都需要注册同一个 id 的算法。
+ */
+class BlockCodec
+{
+public:
+    enum {
+        NoCodec   = 0,
+        ZlibCodec = 1,
+        Lz4Codec  = 2, ///< 保留给 LZ4，需要另外提供实现
+        MaxCodec  = 15
+    };
+
+    virtual ~BlockCodec() {}
+
+    virtual quint8 id() const = 0;
+    virtual QString name() const = 0;
+
+    /**
+     * @brief 压缩 size 字节的 data，结果追加到 out。
+     * @return 执行结果
+     */
+    virtual bool compress(const char *data, int size, QByteArray *out) const = 0;
+
+    /**
+     * @brief 解压 size 字节的 data，结果替换 out 的内容。
+     * @return 数据损坏时返回 false
+     */
+    virtual bool decompress(const uchar *data, int size, QByteArray *out) const = 0;
+
+    /**
+     * @brief 按 id 查找压缩算法，没有注册时返回空。
+     */
+    static const BlockCodec *codec(quint8 id);
+
+    /**
+     * @brief 注册压缩算法，同一个 id 后注册的覆盖之前的，codec 需要在程序运行期间一直有效。
+     */
+    static void registerCodec(const BlockCodec *codec);
+};
+
+/**
+ * @brief qCompress/qUncompress（zlib），压缩结果以 4 字节大端的原始长度开头。
+ */
+class ZlibBlockCodec : public BlockCodec
+{
+public:
+    explicit ZlibBlockCodec(int level = 1);
+
+    quint8 id() const override;
+    QString name() const override;
+    bool compress(const char *data, int size, QByteArray *out) const override;
+    bool decompress(const uchar *data, int size, QByteArray *out) const override;
+
+private:
+    int m_level;
+};
+
+#endif // BLOCKCODEC_H
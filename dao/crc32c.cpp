@@ -0,0 +1,88 @@
+#include "crc32c.h"
+#include <QtEndian>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#  define CRC32C_SSE42
+#  include <nmmintrin.h>
+#endif
+
+// CRC-32C 的多项式（反射形式）
+static const quint32 POLYNOMIAL = 0x82f63b78;
+
+struct Crc32cTable
+{
+    quint32 entries[256];
+
+    Crc32cTable()
+    {
+        for (quint32 i = 0; i < 256; ++i)
+        {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+static quint32 computeTable(const uchar *data, qint64 size, quint32 crc)
+{
+    static const Crc32cTable table;
+    for (qint64 i = 0; i < size; ++i)
+    {
+        crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_SSE42
+
+__attribute__((target("sse4.2")))
+static quint32 computeSse42(const uchar *data, qint64 size, quint32 crc)
+{
+    quint64 value = crc;
+    qint64 i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        value = _mm_crc32_u64(value, qFromLittleEndian<quint64>(data + i));
+    }
+    quint32 result = quint32(value);
+    for (; i < size; ++i)
+    {
+        result = _mm_crc32_u8(result, data[i]);
+    }
+    return result;
+}
+
+static bool hasSse42()
+{
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+
+#endif // CRC32C_SSE42
+
+quint32 Crc32c::compute(const uchar *data, qint64 size, quint32 crc)
+{
+    crc = ~crc;
+#ifdef CRC32C_SSE42
+    if (hasSse42())
+    {
+        return ~computeSse42(data, size, crc);
+    }
+#endif
+    return ~computeTable(data, size, crc);
+}
+
+const char *Crc32c::implementation()
+{
+#ifdef CRC32C_SSE42
+    if (hasSse42())
+    {
+        return "sse4.2";
+    }
+#endif
+    return "table";
+}
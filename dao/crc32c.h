@@ -0,0 +1,25 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <QtGlobal>
+
+/**
+ * @brief CRC-32C（Castagnoli），用于校验 user.dat 中的记录。
+ *
+ * x86-64 上 CPU 支持 SSE4.2 时使用 crc32 指令，其它情况查表计算，两者结果相同。
+ */
+class Crc32c
+{
+public:
+    /**
+     * @brief 计算 data 的 CRC，crc 为之前部分的结果，可以分段计算。
+     */
+    static quint32 compute(const uchar *data, qint64 size, quint32 crc = 0);
+
+    /**
+     * @brief 当前使用的实现："sse4.2" 或 "table"
+     */
+    static const char *implementation();
+};
+
+#endif // CRC32C_H
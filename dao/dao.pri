@@ -0,0 +1,48 @@
+QT += concurrent
+
+HEADERS += \
+    $$PWD/userdao.h \
+    $$PWD/userstore.h \
+    $$PWD/asyncuserdao.h \
+    $$PWD/shardeduserdao.h \
+    $$PWD/userbulkloader.h \
+    $$PWD/userindex.h \
+    $$PWD/usernameindex.h \
+    $$PWD/usercache.h \
+    $$PWD/userstats.h \
+    $$PWD/mappedfile.h \
+    $$PWD/usersnapshot.h \
+    $$PWD/usercodec.h \
+    $$PWD/userformat.h \
+    $$PWD/userfilereader.h \
+    $$PWD/userrecordbuilder.h \
+    $$PWD/userblock.h \
+    $$PWD/idscan.h \
+    $$PWD/deltavarint.h \
+    $$PWD/userwriter.h \
+    $$PWD/blockcodec.h \
+    $$PWD/crc32c.h \
+    $$PWD/usercheckpoint.h
+
+SOURCES += \
+    $$PWD/userdao.cpp \
+    $$PWD/asyncuserdao.cpp \
+    $$PWD/shardeduserdao.cpp \
+    $$PWD/userbulkloader.cpp \
+    $$PWD/userindex.cpp \
+    $$PWD/usernameindex.cpp \
+    $$PWD/usercache.cpp \
+    $$PWD/userstats.cpp \
+    $$PWD/mappedfile.cpp \
+    $$PWD/usersnapshot.cpp \
+    $$PWD/usercodec.cpp \
+    $$PWD/userformat.cpp \
+    $$PWD/userfilereader.cpp \
+    $$PWD/userrecordbuilder.cpp \
+    $$PWD/userblock.cpp \
+    $$PWD/idscan.cpp \
+    $$PWD/deltavarint.cpp \
+    $$PWD/userwriter.cpp \
+    $$PWD/blockcodec.cpp \
+    $$PWD/crc32c.cpp \
+    $$PWD/usercheckpoint.cpp
@@ -0,0 +1,140 @@
+#include "deltavarint.h"
+#include <QtEndian>
+
+#include "include/serializefields.h"
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#  define DELTAVARINT_SSE2
+#  include <emmintrin.h>
+#endif
+
+void DeltaVarint::encode(const quint32 *values, int count, QByteArray *out)
+{
+    // 每个值最多 5 字节，先按最大长度分配，写完再截掉
+    int pos = out->size();
+    out->resize(pos + count * 5);
+    uchar *data = reinterpret_cast<uchar *>(out->data()) + pos;
+
+    int used = 0;
+    quint32 previous = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        used += SerializeDetail::putVarint(values[i] - previous, data + used);
+        previous = values[i];
+    }
+    out->resize(pos + used);
+}
+
+/**
+ * @brief 解码 data[pos] 处的一个差值，加到 previous 上
+ */
+static inline bool decodeNext(const uchar *data, qint64 size, qint64 *pos, quint32 *previous)
+{
+    quint32 delta = 0;
+    qint64 used = SerializeDetail::getVarint(data + *pos, size - *pos, &delta);
+    if (used < 0)
+    {
+        return false;
+    }
+    *pos += used;
+    *previous += delta;
+    return true;
+}
+
+#ifndef DELTAVARINT_SSE2
+
+static qint64 decodeScalar(const uchar *data, qint64 size, int count, uchar *out)
+{
+    qint64 pos = 0;
+    quint32 previous = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!decodeNext(data, size, &pos, &previous))
+        {
+            return -1;
+        }
+        qToLittleEndian<quint32>(previous, out + i * sizeof(quint32));
+    }
+    return pos;
+}
+
+#else
+
+/**
+ * @brief 4 个 quint32 的前缀和，再加上 base（4 个通道都是前一个值）
+ */
+static inline __m128i prefixSum(__m128i values, __m128i base)
+{
+    values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+    values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+    return _mm_add_epi32(values, base);
+}
+
+static qint64 decodeSse2(const uchar *data, qint64 size, int count, uchar *out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    qint64 pos = 0;
+    quint32 previous = 0;
+    int i = 0;
+    while (i < count)
+    {
+        if (i + 16 <= count && pos + 16 <= size)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+            if (_mm_movemask_epi8(bytes) == 0)
+            {
+                // 16 个单字节差值：扩展成 4 组 quint32，每组求前缀和后接上前一组的最后一个值
+                __m128i low = _mm_unpacklo_epi8(bytes, zero);
+                __m128i high = _mm_unpackhi_epi8(bytes, zero);
+                __m128i base = _mm_set1_epi32(int(previous));
+                __m128i *dest = reinterpret_cast<__m128i *>(out + i * sizeof(quint32));
+
+                __m128i sums = prefixSum(_mm_unpacklo_epi16(low, zero), base);
+                _mm_storeu_si128(dest, sums);
+                base = _mm_shuffle_epi32(sums, 0xff);
+                sums = prefixSum(_mm_unpackhi_epi16(low, zero), base);
+                _mm_storeu_si128(dest + 1, sums);
+                base = _mm_shuffle_epi32(sums, 0xff);
+                sums = prefixSum(_mm_unpacklo_epi16(high, zero), base);
+                _mm_storeu_si128(dest + 2, sums);
+                base = _mm_shuffle_epi32(sums, 0xff);
+                sums = prefixSum(_mm_unpackhi_epi16(high, zero), base);
+                _mm_storeu_si128(dest + 3, sums);
+
+                previous = quint32(_mm_cvtsi128_si32(_mm_shuffle_epi32(sums, 0xff)));
+                pos += 16;
+                i += 16;
+                continue;
+            }
+        }
+
+        // 这一段有多字节的差值（例如第一个值）或者剩余不足 16 个，解码一个之后再尝试整块
+        if (!decodeNext(data, size, &pos, &previous))
+        {
+            return -1;
+        }
+        qToLittleEndian<quint32>(previous, out + i * sizeof(quint32));
+        ++i;
+    }
+    return pos;
+}
+
+#endif // DELTAVARINT_SSE2
+
+qint64 DeltaVarint::decode(const uchar *data, qint64 size, int count, uchar *out)
+{
+#if defined(DELTAVARINT_SSE2)
+    return decodeSse2(data, size, count, out);
+#else
+    return decodeScalar(data, size, count, out);
+#endif
+}
+
+const char *DeltaVarint::implementation()
+{
+#if defined(DELTAVARINT_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
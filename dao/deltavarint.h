@@ -0,0 +1,35 @@
+#ifndef DELTAVARINT_H
+#define DELTAVARINT_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/**
+ * @brief 非递减整数列的差分 varint 编码：第一个值原样，之后每个值写与前一个值的差，都是 LEB128 varint。
+ *
+ * 批量插入的 id 基本是连续的，差值都小于 128，每个 id 只占 1 字节。
+ * 解码时 x86 上用 SSE2：接下来 16 个字节都是单字节 varint 时一次取出 16 个差值，
+ * 用移位相加求前缀和还原出 16 个值；其它情况逐个解码。
+ */
+class DeltaVarint
+{
+public:
+    /**
+     * @brief 编码 count 个值追加到 out，values 需要是非递减的。
+     */
+    static void encode(const quint32 *values, int count, QByteArray *out);
+
+    /**
+     * @brief 解码 count 个值，写成连续的小端 quint32（与 IdScan 使用的 id 列布局相同）。
+     * @param out 调用者需要保证至少有 count * 4 字节
+     * @return 使用的字节数，数据不完整时返回 -1
+     */
+    static qint64 decode(const uchar *data, qint64 size, int count, uchar *out);
+
+    /**
+     * @brief 当前使用的实现："sse2" 或 "scalar"
+     */
+    static const char *implementation();
+};
+
+#endif // DELTAVARINT_H
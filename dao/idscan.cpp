@@ -0,0 +1,186 @@
+#include "idscan.h"
+#include <QtEndian>
+#include <QtAlgorithms>
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#  define IDSCAN_SSE2
+#  include <emmintrin.h>
+// MinGW 的 GCC 不能把栈对齐到 32 字节，-O0 时溢出到栈上的 __m256i 会非法访问（GCC PR 54412），不启用 AVX2
+#  if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32) && !defined(__MINGW32__)
+#    define IDSCAN_AVX2
+#    include <immintrin.h>
+#  endif
+#endif
+
+static inline quint32 loadId(const uchar *ids, int i)
+{
+    return qFromLittleEndian<quint32>(ids + i * sizeof(quint32));
+}
+
+static int findScalar(const uchar *ids, int begin, int count, quint32 id)
+{
+    for (int i = begin; i < count; ++i)
+    {
+        if (loadId(ids, i) == id)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int filterRangeScalar(const uchar *ids, int begin, int count, quint32 lo, quint32 hi, int *slots)
+{
+    int matched = 0;
+    for (int i = begin; i < count; ++i)
+    {
+        quint32 id = loadId(ids, i);
+        if (id >= lo && id <= hi)
+        {
+            slots[matched++] = i;
+        }
+    }
+    return matched;
+}
+
+#ifdef IDSCAN_SSE2
+
+static inline int appendMask(uint mask, int base, int *slots)
+{
+    int matched = 0;
+    while (mask)
+    {
+        slots[matched++] = base + int(qCountTrailingZeroBits(mask));
+        mask &= mask - 1;
+    }
+    return matched;
+}
+
+static int findSse2(const uchar *ids, int count, quint32 id)
+{
+    const __m128i needle = _mm_set1_epi32(int(id));
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ids + i * 4));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(values, needle)));
+        if (mask)
+        {
+            return i + int(qCountTrailingZeroBits(uint(mask)));
+        }
+    }
+    return findScalar(ids, i, count, id);
+}
+
+static int filterRangeSse2(const uchar *ids, int count, quint32 lo, quint32 hi, int *slots)
+{
+    // SSE2 只有有符号比较，把最高位翻转后无符号比较就变成了有符号比较
+    const __m128i bias = _mm_set1_epi32(int(0x80000000u));
+    const __m128i low = _mm_xor_si128(_mm_set1_epi32(int(lo)), bias);
+    const __m128i high = _mm_xor_si128(_mm_set1_epi32(int(hi)), bias);
+
+    int matched = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ids + i * 4)), bias);
+        __m128i outside = _mm_or_si128(_mm_cmplt_epi32(values, low), _mm_cmpgt_epi32(values, high));
+        int mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xf;
+        matched += appendMask(uint(mask), i, slots + matched);
+    }
+    return matched + filterRangeScalar(ids, i, count, lo, hi, slots + matched);
+}
+
+#endif // IDSCAN_SSE2
+
+#ifdef IDSCAN_AVX2
+
+__attribute__((target("avx2")))
+static int findAvx2(const uchar *ids, int count, quint32 id)
+{
+    const __m256i needle = _mm256_set1_epi32(int(id));
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ids + i * 4));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(values, needle)));
+        if (mask)
+        {
+            return i + int(qCountTrailingZeroBits(uint(mask)));
+        }
+    }
+    return findScalar(ids, i, count, id);
+}
+
+__attribute__((target("avx2")))
+static int filterRangeAvx2(const uchar *ids, int count, quint32 lo, quint32 hi, int *slots)
+{
+    // 无符号范围判断：lo <= x <= hi 等价于 max(x, lo) == x 且 min(x, hi) == x
+    const __m256i low = _mm256_set1_epi32(int(lo));
+    const __m256i high = _mm256_set1_epi32(int(hi));
+
+    int matched = 0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ids + i * 4));
+        __m256i inside = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_max_epu32(values, low), values),
+                                          _mm256_cmpeq_epi32(_mm256_min_epu32(values, high), values));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+        matched += appendMask(uint(mask), i, slots + matched);
+    }
+    return matched + filterRangeScalar(ids, i, count, lo, hi, slots + matched);
+}
+
+static bool hasAvx2()
+{
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif // IDSCAN_AVX2
+
+int IdScan::find(const uchar *ids, int count, quint32 id)
+{
+#if defined(IDSCAN_AVX2)
+    if (hasAvx2())
+    {
+        return findAvx2(ids, count, id);
+    }
+#endif
+#if defined(IDSCAN_SSE2)
+    return findSse2(ids, count, id);
+#else
+    return findScalar(ids, 0, count, id);
+#endif
+}
+
+int IdScan::filterRange(const uchar *ids, int count, quint32 lo, quint32 hi, int *slots)
+{
+#if defined(IDSCAN_AVX2)
+    if (hasAvx2())
+    {
+        return filterRangeAvx2(ids, count, lo, hi, slots);
+    }
+#endif
+#if defined(IDSCAN_SSE2)
+    return filterRangeSse2(ids, count, lo, hi, slots);
+#else
+    return filterRangeScalar(ids, 0, count, lo, hi, slots);
+#endif
+}
+
+const char *IdScan::implementation()
+{
+#if defined(IDSCAN_AVX2)
+    if (hasAvx2())
+    {
+        return "avx2";
+    }
+#endif
+#if defined(IDSCAN_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,33 @@
+#ifndef IDSCAN_H
+#define IDSCAN_H
+
+#include <QtGlobal>
+
+/**
+ * @brief 在列式数据块的 id 列（连续的小端 quint32，不要求对齐）上做比较。
+ *
+ * x86 上按运行时检测到的指令集使用 AVX2 或 SSE2，其它平台使用普通循环。
+ */
+class IdScan
+{
+public:
+    /**
+     * @brief 查找第一个等于 id 的位置。
+     * @return 下标，找不到时返回 -1
+     */
+    static int find(const uchar *ids, int count, quint32 id);
+
+    /**
+     * @brief 找出所有落在 [lo, hi] 范围内的 id。
+     * @param slots[out] 匹配的下标，调用者需要保证至少能放下 count 个
+     * @return 匹配的个数
+     */
+    static int filterRange(const uchar *ids, int count, quint32 lo, quint32 hi, int *slots);
+
+    /**
+     * @brief 当前使用的实现："avx2"、"sse2" 或 "scalar"
+     */
+    static const char *implementation();
+};
+
+#endif // IDSCAN_H
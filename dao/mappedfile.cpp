@@ -0,0 +1,86 @@
+#include "mappedfile.h"
+#include <QFileInfo>
+#include <QDebug>
+
+MappedFile::MappedFile()
+    : m_data(nullptr)
+    , m_size(0)
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const QString &fileName)
+{
+    if (m_file.fileName() == fileName)
+    {
+        return refresh();
+    }
+
+    close();
+    m_file.setFileName(fileName);
+    return refresh();
+}
+
+bool MappedFile::refresh()
+{
+    QFileInfo info(m_file.fileName());
+    qint64 size = info.exists() ? info.size() : 0;
+    if (m_file.isOpen() && size == m_size)
+    {
+        return true;
+    }
+
+    if (m_data)
+    {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_size = 0;
+    m_file.close();
+
+    if (size == 0)
+    {
+        return true;
+    }
+
+    if (!m_file.open(QFile::ReadOnly)) {
+        qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+        return false;
+    }
+
+    m_data = m_file.map(0, size);
+    if (!m_data)
+    {
+        qDebug() << QString::fromLocal8Bit("\n文件映射失败");
+        m_file.close();
+        return false;
+    }
+    m_size = size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data)
+    {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_size = 0;
+    m_file.close();
+}
+
+const uchar *MappedFile::data() const
+{
+    return m_data;
+}
+
+qint64 MappedFile::size() const
+{
+    return m_size;
+}
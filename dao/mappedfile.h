@@ -0,0 +1,43 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QFile>
+#include <QString>
+
+/**
+ * @brief 只读的文件内存映射。映射建立后在多次读取之间复用，
+ *        调用 refresh() 时如果文件长度发生了变化（例如有新的插入），会重新映射。
+ */
+class MappedFile
+{
+    Q_DISABLE_COPY(MappedFile)
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    /**
+     * @brief 映射指定文件，已经映射了同一个文件时等同于 refresh()。
+     * @param fileName 文件名
+     * @return 执行结果，文件不存在或为空时映射为空但返回 true
+     */
+    bool open(const QString &fileName);
+
+    /**
+     * @brief 文件长度变化时重新映射。
+     * @return 执行结果
+     */
+    bool refresh();
+
+    void close();
+
+    const uchar *data() const;
+    qint64 size() const;
+
+private:
+    QFile m_file;
+    uchar *m_data;
+    qint64 m_size;
+};
+
+#endif // MAPPEDFILE_H
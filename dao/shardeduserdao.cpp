@@ -0,0 +1,256 @@
+#include "shardeduserdao.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "userdao.h"
+
+ShardedUserDao::ShardedUserDao(const QStringList &fileNames)
+{
+    foreach (const QString &fileName, fileNames)
+    {
+        m_shards.append(new UserDao(fileName));
+    }
+
+    // 分片之间已经并行，每个分片内部的并行解码线程数相应减少，避免线程数远超 CPU 核数
+    int threads = qMax(1, QThread::idealThreadCount());
+    foreach (UserDao *dao, m_shards)
+    {
+        dao->setParallelism(qMax(1, threads / qMax(1, m_shards.size())));
+    }
+    m_pool.setMaxThreadCount(qMax(1, m_shards.size()));
+}
+
+ShardedUserDao::~ShardedUserDao()
+{
+    m_pool.waitForDone();
+    qDeleteAll(m_shards);
+}
+
+QStringList ShardedUserDao::shardFileNames(const QString &fileName, int shards)
+{
+    QFileInfo info(fileName);
+    QString suffix = info.suffix();
+    QString baseName = suffix.isEmpty() ? info.fileName() : info.completeBaseName();
+
+    QStringList fileNames;
+    for (int i = 0; i < shards; ++i)
+    {
+        QString name = baseName + "." + QString::number(i);
+        if (!suffix.isEmpty())
+        {
+            name += "." + suffix;
+        }
+        fileNames.append(info.dir().filePath(name));
+    }
+    return fileNames;
+}
+
+int ShardedUserDao::shardCount() const
+{
+    return m_shards.size();
+}
+
+int ShardedUserDao::shardOf(quint32 id) const
+{
+    // 乘法哈希后按比例映射到 [0, shardCount)，连续的 id 均匀分散到各个分片
+    quint32 hash = id * 2654435761u;
+    return int((quint64(hash) * quint64(m_shards.size())) >> 32);
+}
+
+UserDao *ShardedUserDao::shard(int index) const
+{
+    return m_shards.at(index);
+}
+
+bool ShardedUserDao::select(quint32 id, User *user)
+{
+    return m_shards.at(shardOf(id))->select(id, user);
+}
+
+User ShardedUserDao::select(quint32 id)
+{
+    return m_shards.at(shardOf(id))->select(id);
+}
+
+bool ShardedUserDao::contains(quint32 id)
+{
+    return m_shards.at(shardOf(id))->contains(id);
+}
+
+QVector<User> ShardedUserDao::selectAll()
+{
+    return queryShards([](UserDao *dao) {
+        return dao->selectAll();
+    });
+}
+
+QVector<User> ShardedUserDao::selectRange(quint32 lo, quint32 hi)
+{
+    return queryShards([lo, hi](UserDao *dao) {
+        return dao->selectRange(lo, hi);
+    });
+}
+
+QVector<User> ShardedUserDao::selectByName(const QString &userName)
+{
+    return queryShards([userName](UserDao *dao) {
+        return dao->selectByName(userName);
+    });
+}
+
+bool ShardedUserDao::insert(const User &user)
+{
+    return m_shards.at(shardOf(user.id()))->insert(user);
+}
+
+bool ShardedUserDao::insert(const QVector<User> &users)
+{
+    return writeShards(users, [](UserDao *dao, const QVector<User> &part) {
+        return dao->insert(part);
+    });
+}
+
+bool ShardedUserDao::update(const User &user)
+{
+    return m_shards.at(shardOf(user.id()))->update(user);
+}
+
+bool ShardedUserDao::update(const QVector<User> &users)
+{
+    foreach (const User &user, users)
+    {
+        if (!contains(user.id()))
+        {
+            qDebug() << QString::fromLocal8Bit("\n要更新的记录不存在") << user.id();
+            return false;
+        }
+    }
+    return writeShards(users, [](UserDao *dao, const QVector<User> &part) {
+        return dao->update(part);
+    });
+}
+
+bool ShardedUserDao::remove(const User &user)
+{
+    return m_shards.at(shardOf(user.id()))->remove(user);
+}
+
+bool ShardedUserDao::remove(const QVector<User> &users)
+{
+    foreach (const User &user, users)
+    {
+        if (!contains(user.id()))
+        {
+            qDebug() << QString::fromLocal8Bit("\n要删除的记录不存在") << user.id();
+            return false;
+        }
+    }
+    return writeShards(users, [](UserDao *dao, const QVector<User> &part) {
+        return dao->remove(part);
+    });
+}
+
+void ShardedUserDao::setWriteBehind(bool enabled, int maxBatch, int maxDelay)
+{
+    foreach (UserDao *dao, m_shards)
+    {
+        dao->setWriteBehind(enabled, maxBatch, maxDelay);
+    }
+}
+
+bool ShardedUserDao::flush()
+{
+    bool ok = true;
+    foreach (UserDao *dao, m_shards)
+    {
+        ok = dao->flush() && ok;
+    }
+    return ok;
+}
+
+bool ShardedUserDao::checkpoint()
+{
+    bool ok = true;
+    foreach (UserDao *dao, m_shards)
+    {
+        ok = dao->checkpoint() && ok;
+    }
+    return ok;
+}
+
+QVector<QVector<User> > ShardedUserDao::partition(const QVector<User> &users) const
+{
+    QVector<QVector<User> > parts(m_shards.size());
+    foreach (const User &user, users)
+    {
+        parts[shardOf(user.id())].append(user);
+    }
+    return parts;
+}
+
+bool ShardedUserDao::writeShards(const QVector<User> &users, const WriteFunction &write)
+{
+    QVector<QVector<User> > parts = partition(users);
+    QVector<QFuture<bool> > futures;
+    int last = -1;
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        if (parts.at(i).isEmpty())
+        {
+            continue;
+        }
+        if (last >= 0)
+        {
+            UserDao *dao = m_shards.at(last);
+            QVector<User> part = parts.at(last);
+            futures.append(QtConcurrent::run(&m_pool, [write, dao, part]() {
+                return write(dao, part);
+            }));
+        }
+        last = i;
+    }
+
+    // 最后一个分片在调用线程中写入，只有一个分片有记录时不需要切换线程
+    bool ok = last < 0 || write(m_shards.at(last), parts.at(last));
+    for (int i = 0; i < futures.size(); ++i)
+    {
+        ok = futures[i].result() && ok;
+    }
+    return ok;
+}
+
+QVector<User> ShardedUserDao::queryShards(const QueryFunction &query)
+{
+    QVector<QFuture<QVector<User> > > futures;
+    for (int i = 1; i < m_shards.size(); ++i)
+    {
+        UserDao *dao = m_shards.at(i);
+        futures.append(QtConcurrent::run(&m_pool, [query, dao]() {
+            return query(dao);
+        }));
+    }
+
+    QVector<User> users;
+    if (!m_shards.isEmpty())
+    {
+        users = query(m_shards.first());
+    }
+    int total = users.size();
+    QVector<QVector<User> > parts;
+    parts.reserve(futures.size());
+    for (int i = 0; i < futures.size(); ++i)
+    {
+        parts.append(futures[i].result());
+        total += parts.last().size();
+    }
+
+    users.reserve(total);
+    foreach (const QVector<User> &part, parts)
+    {
+        users += part;
+    }
+    return users;
+}
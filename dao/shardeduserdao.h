@@ -0,0 +1,98 @@
+#ifndef SHARDEDUSERDAO_H
+#define SHARDEDUSERDAO_H
+
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+#include "data/user.h"
+#include "userstore.h"
+
+class UserDao;
+
+/**
+ * @brief 按 id 的哈希把记录分到多个数据文件中，每个文件由一个独立的 UserDao 管理。
+ *
+ * 各个分片有自己的文件、索引和锁，文件可以放在不同的磁盘上。
+ * 批量写入按分片拆开后在线程池中并行写入，各分片互不等待；
+ * selectAll、selectRange、selectByName 在各分片上并行查询后按分片顺序拼接。
+ *
+ * 分片由 id 和文件个数决定，重新打开时文件列表（个数和顺序）必须与写入时相同。
+ * 每个分片的写入是原子的（任何一个 id 不存在时整个分片不修改），跨分片的 update/remove
+ * 会先检查所有 id 都存在，但与其它线程并发删除同一个 id 时可能只有部分分片写入成功。
+ */
+class ShardedUserDao : public UserStore
+{
+    Q_DISABLE_COPY(ShardedUserDao)
+
+public:
+    /**
+     * @param fileNames 各个分片的数据文件
+     */
+    explicit ShardedUserDao(const QStringList &fileNames);
+    ~ShardedUserDao();
+
+    /**
+     * @brief 在同一个目录下生成分片文件名，例如 user.dat -> user.0.dat、user.1.dat ...
+     */
+    static QStringList shardFileNames(const QString &fileName, int shards);
+
+    int shardCount() const;
+
+    /**
+     * @brief id 所在的分片
+     */
+    int shardOf(quint32 id) const;
+
+    /**
+     * @brief 第 index 个分片，可以用来单独设置读取方式、写入格式、缓存等
+     */
+    UserDao *shard(int index) const;
+
+    bool select(quint32 id, User *user) override;
+    User select(quint32 id);
+    bool contains(quint32 id) override;
+
+    QVector<User> selectAll() override;
+    QVector<User> selectRange(quint32 lo, quint32 hi) override;
+    QVector<User> selectByName(const QString &userName) override;
+
+    bool insert(const User &user);
+    bool insert(const QVector<User> &users) override;
+    bool update(const User &user);
+    bool update(const QVector<User> &users) override;
+    bool remove(const User &user);
+    bool remove(const QVector<User> &users) override;
+
+    /**
+     * @brief 对每个分片开启或关闭后台写入（见 UserDao::setWriteBehind()），每个分片各有一个写线程
+     */
+    void setWriteBehind(bool enabled, int maxBatch = 4096, int maxDelay = 10);
+
+    bool flush();
+    bool checkpoint();
+
+private:
+    typedef std::function<bool(UserDao *, const QVector<User> &)> WriteFunction;
+    typedef std::function<QVector<User>(UserDao *)> QueryFunction;
+
+    /**
+     * @brief 按分片拆分记录
+     */
+    QVector<QVector<User> > partition(const QVector<User> &users) const;
+
+    /**
+     * @brief 拆分后在各分片上并行执行 write，只有一个分片有记录时在调用线程中执行
+     */
+    bool writeShards(const QVector<User> &users, const WriteFunction &write);
+
+    /**
+     * @brief 在各分片上并行执行 query，按分片顺序拼接结果
+     */
+    QVector<User> queryShards(const QueryFunction &query);
+
+    QVector<UserDao *> m_shards;
+    QThreadPool m_pool;
+};
+
+#endif // SHARDEDUSERDAO_H
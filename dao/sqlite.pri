@@ -0,0 +1,13 @@
+# SQLite 后端（SqliteUserDao），通过 DBUtil 访问数据库。
+# DBUtil 需要先单独编译（连同它依赖的 connectionpool、Log4Qt），库所在的目录用 QMAKE_LIBDIR 指定。
+QT += sql
+DEFINES += USERDAO_SQLITE
+
+include($$PWD/../dbutil/dbutil-include.pri)
+LIBS += -lDbUtil
+
+HEADERS += \
+    $$PWD/sqliteuserdao.h
+
+SOURCES += \
+    $$PWD/sqliteuserdao.cpp
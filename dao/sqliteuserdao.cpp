@@ -0,0 +1,227 @@
+#include "sqliteuserdao.h"
+#include <QAtomicInt>
+#include <QDebug>
+#include <QSqlDatabase>
+#include <QSqlError>
+
+#include "DbUtil"
+
+static const char *const CREATE_TABLE_SQL =
+        "CREATE TABLE IF NOT EXISTS user (id INTEGER PRIMARY KEY, userName TEXT, password TEXT)";
+static const char *const CREATE_NAME_INDEX_SQL =
+        "CREATE INDEX IF NOT EXISTS user_userName ON user (userName)";
+static const char *const COUNT_SQL = "SELECT COUNT(*) FROM user";
+static const char *const CONTAINS_SQL = "SELECT COUNT(*) FROM user WHERE id=:id";
+static const char *const SELECT_SQL = "SELECT id, userName, password FROM user WHERE id=:id";
+static const char *const SELECT_ALL_SQL = "SELECT id, userName, password FROM user ORDER BY id";
+static const char *const SELECT_RANGE_SQL =
+        "SELECT id, userName, password FROM user WHERE id BETWEEN :lo AND :hi ORDER BY id";
+static const char *const SELECT_BY_NAME_SQL =
+        "SELECT id, userName, password FROM user WHERE userName=:userName";
+static const char *const INSERT_SQL =
+        "INSERT OR REPLACE INTO user (id, userName, password) VALUES (:id, :userName, :password)";
+static const char *const UPDATE_SQL = "UPDATE user SET userName=:userName, password=:password WHERE id=:id";
+static const char *const REMOVE_SQL = "DELETE FROM user WHERE id=:id";
+
+// 每个对象使用单独的连接名
+static QAtomicInt connectionCounter;
+
+SqliteUserDao::SqliteUserDao(const QString &databaseName)
+    : m_databaseName(databaseName)
+    , m_connectionName(QString("SqliteUserDao-%1").arg(connectionCounter.fetchAndAddRelaxed(1)))
+    , m_db(nullptr)
+    , m_open(false)
+{
+    QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+    database.setDatabaseName(databaseName);
+    if (!database.open())
+    {
+        qDebug() << QString::fromLocal8Bit("\n数据库打开失败") << database.lastError().text();
+        return;
+    }
+    m_db = new DBUtil(database);
+
+    // 内存数据库不支持 WAL，journal_mode 保持为 memory
+    m_db->selectString("PRAGMA journal_mode=WAL");
+    m_open = m_db->update("PRAGMA synchronous=NORMAL")
+            && m_db->update(CREATE_TABLE_SQL)
+            && m_db->update(CREATE_NAME_INDEX_SQL);
+    if (!m_open)
+    {
+        qDebug() << QString::fromLocal8Bit("\n建表失败") << m_db->lastError();
+    }
+}
+
+SqliteUserDao::~SqliteUserDao()
+{
+    // 连接的所有副本（包括 DBUtil 中的）释放之后才能移除
+    delete m_db;
+    {
+        QSqlDatabase database = QSqlDatabase::database(m_connectionName, false);
+        database.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+QString SqliteUserDao::databaseName() const
+{
+    return m_databaseName;
+}
+
+bool SqliteUserDao::isOpen() const
+{
+    return m_open;
+}
+
+int SqliteUserDao::count()
+{
+    return m_open ? m_db->selectInt(COUNT_SQL) : 0;
+}
+
+bool SqliteUserDao::select(quint32 id, User *user)
+{
+    QVector<User> users;
+    QVariantMap params;
+    params["id"] = qint64(id);
+    if (!selectUsers(SELECT_SQL, params, &users) || users.isEmpty())
+    {
+        return false;
+    }
+    *user = users.first();
+    return true;
+}
+
+bool SqliteUserDao::contains(quint32 id)
+{
+    if (!m_open)
+    {
+        return false;
+    }
+    QVariantMap params;
+    params["id"] = qint64(id);
+    return m_db->selectInt(CONTAINS_SQL, params) > 0;
+}
+
+QVector<User> SqliteUserDao::selectAll()
+{
+    QVector<User> users;
+    selectUsers(SELECT_ALL_SQL, QVariantMap(), &users);
+    return users;
+}
+
+QVector<User> SqliteUserDao::selectRange(quint32 lo, quint32 hi)
+{
+    QVector<User> users;
+    QVariantMap params;
+    params["lo"] = qint64(lo);
+    params["hi"] = qint64(hi);
+    selectUsers(SELECT_RANGE_SQL, params, &users);
+    return users;
+}
+
+QVector<User> SqliteUserDao::selectByName(const QString &userName)
+{
+    QVector<User> users;
+    QVariantMap params;
+    params["userName"] = userName;
+    selectUsers(SELECT_BY_NAME_SQL, params, &users);
+    return users;
+}
+
+bool SqliteUserDao::insert(const QVector<User> &users)
+{
+    return writeUsers(INSERT_SQL, users, false, true);
+}
+
+bool SqliteUserDao::update(const QVector<User> &users)
+{
+    return writeUsers(UPDATE_SQL, users, true, true);
+}
+
+bool SqliteUserDao::remove(const QVector<User> &users)
+{
+    return writeUsers(REMOVE_SQL, users, true, false);
+}
+
+bool SqliteUserDao::selectUsers(const QString &sql, const QVariantMap &params, QVector<User> *users)
+{
+    if (!m_open)
+    {
+        return false;
+    }
+    m_db->executeSql(sql, params);
+    if (!m_db->lastError().isEmpty())
+    {
+        qDebug() << QString::fromLocal8Bit("\n查询失败") << m_db->lastError();
+        return false;
+    }
+
+    // 直接按列号读取，不经过 selectMaps() 的按列名映射
+    while (m_db->next())
+    {
+        User user;
+        user.setId(quint32(m_db->value(0).toLongLong()));
+        user.setUserName(m_db->value(1).toString());
+        user.setPassword(m_db->value(2).toString());
+        users->append(user);
+    }
+    return true;
+}
+
+bool SqliteUserDao::writeUsers(const QString &sql, const QVector<User> &users, bool checkExists, bool withFields)
+{
+    if (!m_open)
+    {
+        return false;
+    }
+    if (users.isEmpty())
+    {
+        return true;
+    }
+    if (!m_db->transaction())
+    {
+        qDebug() << QString::fromLocal8Bit("\n开始事务失败");
+        return false;
+    }
+
+    if (checkExists)
+    {
+        foreach (const User &user, users)
+        {
+            if (!contains(user.id()))
+            {
+                qDebug() << QString::fromLocal8Bit("\n要修改的记录不存在") << user.id();
+                m_db->roolback();
+                return false;
+            }
+        }
+    }
+
+    QList<QVariantMap> rows;
+    rows.reserve(users.size());
+    foreach (const User &user, users)
+    {
+        QVariantMap row;
+        row["id"] = qint64(user.id());
+        if (withFields)
+        {
+            row["userName"] = user.userName();
+            row["password"] = user.password();
+        }
+        rows.append(row);
+    }
+
+    if (!m_db->updateBatch(sql, rows))
+    {
+        qDebug() << QString::fromLocal8Bit("\n写入失败") << m_db->lastError();
+        m_db->roolback();
+        return false;
+    }
+    if (!m_db->commit())
+    {
+        qDebug() << QString::fromLocal8Bit("\n提交事务失败");
+        m_db->roolback();
+        return false;
+    }
+    return true;
+}
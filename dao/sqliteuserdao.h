@@ -0,0 +1,82 @@
+#ifndef SQLITEUSERDAO_H
+#define SQLITEUSERDAO_H
+
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+#include "data/user.h"
+#include "userstore.h"
+
+class DBUtil;
+
+/**
+ * @brief 保存在 SQLite 数据库中的 User，通过 DBUtil 读写，用于与 user.dat（UserDao）比较。
+ *
+ * 表 user (id INTEGER PRIMARY KEY, userName TEXT, password TEXT)：id 是 rowid 的别名，
+ * 按 id 查询和范围查询直接走主键的 B 树；userName 上另外建一个索引。
+ * 文件数据库使用 WAL 日志，synchronous=NORMAL（与 UserDao 默认只写入操作系统缓存相近）。
+ *
+ * 每次批量写入是一个事务，插入使用一个 prepare 好的 INSERT OR REPLACE 语句逐行绑定参数执行。
+ * 连接只能在创建它的线程中使用，因此 SqliteUserDao 的对象也只能在一个线程中使用。
+ */
+class SqliteUserDao : public UserStore
+{
+    Q_DISABLE_COPY(SqliteUserDao)
+
+public:
+    /**
+     * @param databaseName 数据库文件名，":memory:" 表示内存数据库（关闭后数据丢失）
+     */
+    explicit SqliteUserDao(const QString &databaseName = ":memory:");
+    ~SqliteUserDao();
+
+    QString databaseName() const;
+
+    /**
+     * @brief 数据库是否打开成功，打开失败时所有操作都返回 false 或空的结果
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief 记录数
+     */
+    int count();
+
+    bool select(quint32 id, User *user) override;
+    bool contains(quint32 id) override;
+
+    /**
+     * @brief 所有记录，按 id 排序
+     */
+    QVector<User> selectAll() override;
+
+    /**
+     * @brief id 在 [lo, hi] 范围内的记录，按 id 排序
+     */
+    QVector<User> selectRange(quint32 lo, quint32 hi) override;
+    QVector<User> selectByName(const QString &userName) override;
+
+    bool insert(const QVector<User> &users) override;
+    bool update(const QVector<User> &users) override;
+    bool remove(const QVector<User> &users) override;
+
+private:
+    /**
+     * @brief 执行查询，把结果（id, userName, password）追加到 users
+     */
+    bool selectUsers(const QString &sql, const QVariantMap &params, QVector<User> *users);
+
+    /**
+     * @brief 在一个事务中对每个 User 执行一次 sql。
+     * @param checkExists 是否先检查所有 id 都存在，有不存在的 id 时不做修改
+     * @param withFields 是否绑定 userName 和 password（删除只需要 id）
+     */
+    bool writeUsers(const QString &sql, const QVector<User> &users, bool checkExists, bool withFields);
+
+    QString m_databaseName;
+    QString m_connectionName;
+    DBUtil *m_db;
+    bool m_open;
+};
+
+#endif // SQLITEUSERDAO_H
@@ -0,0 +1,394 @@
+#include "userblock.h"
+#include <QHash>
+#include <QtEndian>
+
+#include "idscan.h"
+#include "deltavarint.h"
+#include "userformat.h"
+#include "include/serializefields.h"
+#include "include/utf8string.h"
+
+static void appendUInt32(QByteArray *out, quint32 value)
+{
+    uchar bytes[sizeof(quint32)];
+    qToLittleEndian<quint32>(value, bytes);
+    out->append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+
+static void appendUtf8(QByteArray *out, const QString &str, int bytes)
+{
+    int pos = out->size();
+    out->resize(pos + bytes);
+    Utf8String::encode(str, reinterpret_cast<uchar *>(out->data()) + pos);
+}
+
+static int codeWidthOf(int entries)
+{
+    return entries <= 0x100 ? 1 : (entries <= 0x10000 ? 2 : 4);
+}
+
+static quint32 readCode(const uchar *codes, int width, int slot)
+{
+    switch (width)
+    {
+    case 1:
+        return codes[slot];
+    case 2:
+        return qFromLittleEndian<quint16>(codes + slot * 2);
+    default:
+        return qFromLittleEndian<quint32>(codes + slot * 4);
+    }
+}
+
+/**
+ * @brief 编码一列字符串，重复值多时使用字典，否则按顺序存放
+ */
+static void encodeColumn(const QVector<QString> &values, QByteArray *out)
+{
+    QHash<QString, quint32> codes;
+    QVector<QString> entries;
+    QVector<int> entrySizes;
+    QVector<quint32> rowCodes(values.size());
+    QVector<int> sizes(values.size());
+    qint64 plainBytes = 0;
+    qint64 entryBytes = 0;
+    for (int i = 0; i < values.size(); ++i)
+    {
+        const QString &value = values.at(i);
+        sizes[i] = Utf8String::size(value);
+        plainBytes += sizes.at(i);
+
+        QHash<QString, quint32>::const_iterator it = codes.constFind(value);
+        if (it == codes.constEnd())
+        {
+            it = codes.insert(value, quint32(entries.size()));
+            entries.append(value);
+            entrySizes.append(sizes.at(i));
+            entryBytes += sizes.at(i);
+        }
+        rowCodes[i] = it.value();
+    }
+
+    int width = codeWidthOf(entries.size());
+    qint64 plainSize = qint64(values.size()) * sizeof(quint32) + plainBytes;
+    qint64 dictionarySize = qint64(entries.size()) * sizeof(quint32) + qint64(values.size()) * width + entryBytes;
+
+    if (entries.isEmpty() || dictionarySize >= plainSize)
+    {
+        appendUInt32(out, 0);
+        quint32 end = 0;
+        foreach (int size, sizes)
+        {
+            end += quint32(size);
+            appendUInt32(out, end);
+        }
+        for (int i = 0; i < values.size(); ++i)
+        {
+            appendUtf8(out, values.at(i), sizes.at(i));
+        }
+        return;
+    }
+
+    appendUInt32(out, quint32(entries.size()));
+    quint32 end = 0;
+    foreach (int size, entrySizes)
+    {
+        end += quint32(size);
+        appendUInt32(out, end);
+    }
+    foreach (quint32 code, rowCodes)
+    {
+        // 小端的前 width 个字节就是较短宽度的编号
+        uchar bytes[sizeof(quint32)];
+        qToLittleEndian<quint32>(code, bytes);
+        out->append(reinterpret_cast<const char *>(bytes), width);
+    }
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        appendUtf8(out, entries.at(i), entrySizes.at(i));
+    }
+}
+
+UserBlock::UserBlock(const uchar *data, quint32 length, quint8 flags)
+    : m_ids(nullptr)
+    , m_count(0)
+    , m_utf8(flags & UserFormat::Utf8Flag)
+{
+    memset(m_columns, 0, sizeof(m_columns));
+    if (length < sizeof(quint32))
+    {
+        return;
+    }
+    quint32 count = qFromLittleEndian<quint32>(data);
+
+    if ((flags & UserFormat::DictionaryFlag) && (flags & UserFormat::VarintFlag))
+    {
+        if (length < 2 * sizeof(quint32))
+        {
+            return;
+        }
+        // 每个 id 至少占 1 字节，count 不会超过 idBytes，解码前可以放心分配
+        quint32 idBytes = qFromLittleEndian<quint32>(data + sizeof(quint32));
+        if (idBytes > length - 2 * sizeof(quint32) || count > idBytes)
+        {
+            return;
+        }
+        m_idBuffer.resize(int(count * sizeof(quint32)));
+        uchar *ids = reinterpret_cast<uchar *>(m_idBuffer.data());
+        if (DeltaVarint::decode(data + 2 * sizeof(quint32), idBytes, int(count), ids) < 0)
+        {
+            return;
+        }
+        m_count = int(count);
+        if (!parseColumns(data, length, 2 * sizeof(quint32) + quint64(idBytes)))
+        {
+            m_count = 0;
+            return;
+        }
+        m_ids = ids;
+        return;
+    }
+
+    if (flags & UserFormat::DictionaryFlag)
+    {
+        if (quint64(count) * sizeof(quint32) > length - sizeof(quint32))
+        {
+            return;
+        }
+        m_count = int(count);
+        if (!parseColumns(data, length, sizeof(quint32) + quint64(count) * sizeof(quint32)))
+        {
+            m_count = 0;
+            return;
+        }
+        m_ids = data + sizeof(quint32);
+        return;
+    }
+
+    quint64 columns = sizeof(quint32) + quint64(count) * 3 * sizeof(quint32);
+    if (columns > length)
+    {
+        return;
+    }
+
+    m_ids = data + sizeof(quint32);
+    m_count = int(count);
+
+    // 旧布局：两列的 ends 连在一起，共用一个字符串区
+    const uchar *ends = m_ids + count * sizeof(quint32);
+    for (int column = 0; column < 2; ++column)
+    {
+        Column &c = m_columns[column];
+        c.ends = ends + column * count * sizeof(quint32);
+        c.codes = nullptr;
+        c.codeWidth = 0;
+        c.entries = m_count;
+        c.strings = data + columns;
+        c.stringSize = quint32(length - columns);
+        c.firstBegin = column > 0 && count > 0 ? qFromLittleEndian<quint32>(c.ends - sizeof(quint32)) : 0;
+    }
+}
+
+bool UserBlock::parseColumns(const uchar *data, quint32 length, quint64 pos)
+{
+    for (int column = 0; column < 2; ++column)
+    {
+        Column &c = m_columns[column];
+        if (pos + sizeof(quint32) > length)
+        {
+            return false;
+        }
+        quint32 entries = qFromLittleEndian<quint32>(data + pos);
+        pos += sizeof(quint32);
+
+        c.entries = entries > 0 ? int(entries) : m_count;
+        c.codeWidth = entries > 0 ? codeWidthOf(int(entries)) : 0;
+        if (pos + quint64(c.entries) * sizeof(quint32) + quint64(m_count) * c.codeWidth > length)
+        {
+            return false;
+        }
+        c.ends = data + pos;
+        pos += quint64(c.entries) * sizeof(quint32);
+        c.codes = entries > 0 ? data + pos : nullptr;
+        pos += quint64(m_count) * c.codeWidth;
+
+        quint32 stringSize = c.entries > 0 ? qFromLittleEndian<quint32>(c.ends + (c.entries - 1) * sizeof(quint32)) : 0;
+        if (pos + stringSize > length)
+        {
+            return false;
+        }
+        c.strings = data + pos;
+        c.stringSize = stringSize;
+        c.firstBegin = 0;
+        pos += stringSize;
+    }
+    return true;
+}
+
+quint8 UserBlock::encode(const QVector<User> &users, int from, int count, QByteArray *out)
+{
+    QVector<quint32> ids(count);
+    bool sorted = true;
+    for (int i = 0; i < count; ++i)
+    {
+        ids[i] = users.at(from + i).id();
+        sorted = sorted && (i == 0 || ids.at(i - 1) <= ids.at(i));
+    }
+
+    quint8 flags = UserFormat::DictionaryFlag | UserFormat::Utf8Flag;
+    appendUInt32(out, quint32(count));
+    if (sorted)
+    {
+        // 先占位 idBytes，编码后回填
+        int start = out->size();
+        appendUInt32(out, 0);
+        DeltaVarint::encode(ids.constData(), count, out);
+        qToLittleEndian<quint32>(quint32(out->size() - start - sizeof(quint32)),
+                                 reinterpret_cast<uchar *>(out->data()) + start);
+        flags |= UserFormat::VarintFlag;
+    }
+    else
+    {
+        foreach (quint32 id, ids)
+        {
+            appendUInt32(out, id);
+        }
+    }
+
+    QVector<QString> values(count);
+    for (int i = 0; i < count; ++i)
+    {
+        values[i] = users.at(from + i).userName();
+    }
+    encodeColumn(values, out);
+    for (int i = 0; i < count; ++i)
+    {
+        values[i] = users.at(from + i).password();
+    }
+    encodeColumn(values, out);
+
+    return flags;
+}
+
+bool UserBlock::firstId(const uchar *data, quint32 length, quint8 flags, quint32 *id)
+{
+    if ((flags & UserFormat::DictionaryFlag) && (flags & UserFormat::VarintFlag))
+    {
+        // count、idBytes 之后第一个 varint 就是第一个 id 本身
+        return length > 2 * sizeof(quint32)
+                && SerializeDetail::getVarint(data + 2 * sizeof(quint32), length - 2 * sizeof(quint32), id) >= 0;
+    }
+    // count 之后是定长的 id 列
+    if (length < 2 * sizeof(quint32))
+    {
+        return false;
+    }
+    *id = qFromLittleEndian<quint32>(data + sizeof(quint32));
+    return true;
+}
+
+bool UserBlock::isValid() const
+{
+    return m_ids != nullptr;
+}
+
+int UserBlock::count() const
+{
+    return m_count;
+}
+
+quint32 UserBlock::id(int slot) const
+{
+    return qFromLittleEndian<quint32>(m_ids + slot * sizeof(quint32));
+}
+
+int UserBlock::find(quint32 id) const
+{
+    return IdScan::find(m_ids, m_count, id);
+}
+
+QVector<int> UserBlock::filterRange(quint32 lo, quint32 hi) const
+{
+    QVector<int> slots(m_count);
+    slots.resize(IdScan::filterRange(m_ids, m_count, lo, hi, slots.data()));
+    return slots;
+}
+
+User UserBlock::user(int slot) const
+{
+    User user;
+    decodeUser(slot, &user);
+    return user;
+}
+
+void UserBlock::decodeUser(int slot, User *user) const
+{
+    // 同 UserCodec::decode，取出字符串后 resize 可以复用原来的存储；
+    // 字典列直接赋值为字典中的字符串，不需要复用
+    QString userName = user->userName();
+    QString password = user->password();
+    user->setUserName(QString());
+    user->setPassword(QString());
+
+    string(0, slot, &userName);
+    string(1, slot, &password);
+
+    user->setId(id(slot));
+    user->setUserName(userName);
+    user->setPassword(password);
+}
+
+void UserBlock::string(int column, int slot, QString *str) const
+{
+    const Column &c = m_columns[column];
+    if (!c.codes)
+    {
+        readEntry(c, slot, str);
+        return;
+    }
+
+    QVector<QString> &dictionary = m_dictionary[column];
+    if (dictionary.isEmpty())
+    {
+        dictionary.resize(c.entries);
+        for (int i = 0; i < c.entries; ++i)
+        {
+            readEntry(c, i, &dictionary[i]);
+        }
+    }
+
+    quint32 code = readCode(c.codes, c.codeWidth, slot);
+    *str = code < quint32(dictionary.size()) ? dictionary.at(int(code)) : QString();
+}
+
+void UserBlock::readEntry(const Column &column, int index, QString *str) const
+{
+    quint32 begin = index > 0 ? qFromLittleEndian<quint32>(column.ends + (index - 1) * sizeof(quint32)) : column.firstBegin;
+    quint32 end = qFromLittleEndian<quint32>(column.ends + index * sizeof(quint32));
+    if (begin > end || end > column.stringSize || (!m_utf8 && ((end - begin) & 1)))
+    {
+        *str = QString();
+        return;
+    }
+
+    if (m_utf8)
+    {
+        if (!Utf8String::decode(column.strings + begin, int(end - begin), str))
+        {
+            *str = QString();
+        }
+        return;
+    }
+
+    int length = int((end - begin) / 2);
+    str->resize(length);
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    memcpy(str->data(), column.strings + begin, end - begin);
+#else
+    ushort *out = reinterpret_cast<ushort *>(str->data());
+    for (int i = 0; i < length; ++i)
+    {
+        out[i] = qFromLittleEndian<quint16>(column.strings + begin + i * 2);
+    }
+#endif
+}
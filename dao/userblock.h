@@ -0,0 +1,117 @@
+#ifndef USERBLOCK_H
+#define USERBLOCK_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "data/user.h"
+
+/**
+ * @brief 列式数据块（BlockRecord 的内容），把一组 User 按列存放（小端）。
+ *
+ * 版本 4 之前的布局（记录头 flags 中没有 UserFormat::DictionaryFlag）：
+ *
+ *     quint32 count
+ *     quint32 ids[count]
+ *     quint32 ends[2 * count]   userName 列和 password 列每个字符串在字符串区中的结束位置（字节）
+ *     字符串区                  先是所有 userName，再是所有 password，UTF-16 小端
+ *
+ * 字典布局（flags 中有 UserFormat::DictionaryFlag，版本 4 增加）：
+ *
+ *     quint32 count
+ *     quint32 ids[count]
+ *     然后是 userName 列和 password 列，每列：
+ *         quint32 entries       字典中的字符串个数，0 表示这一列不使用字典
+ *         entries == 0 时：     quint32 ends[count]，然后是 count 个字符串
+ *         entries > 0 时：      quint32 ends[entries]，codes[count]，然后是 entries 个字符串
+ *
+ * 记录头 flags 中有 UserFormat::Utf8Flag 时（版本 6 增加）字符串区是 UTF-8 而不是 UTF-16，ends 仍然以字节为单位。
+ *
+ * 记录头 flags 中有 UserFormat::VarintFlag 时（版本 7 增加，只用于字典布局、id 非递减的块），id 列换成：
+ *
+ *     quint32 idBytes       差分 varint 编码的 id 列的字节数
+ *     idBytes 字节          DeltaVarint 编码的 id
+ *
+ * 打开这种块时先把 id 列批量解码成 quint32 数组，之后的查找与定长的 id 列相同。
+ *
+ * ends 是相对这一列字符串区的结束位置，codes 是每一行在字典中的下标，
+ * entries 不超过 256 时为 quint8，不超过 65536 时为 quint16，否则为 quint32。
+ * 写入时每一列分别比较两种方式的长度，取较短的一种，重复值多的列（例如密码）只保存一份。
+ * 读取时字典中的字符串只解码一次，同一块中引用同一个值的 User 共享同一个 QString。
+ *
+ * 按 id 查找只需要比较 id 列，字符串只有命中的记录才会解码。
+ * 列式存储不区分空字符串和 null 字符串，读出来都是空字符串。
+ */
+class UserBlock
+{
+public:
+    /**
+     * @param flags 记录头中的 flags，用来区分布局
+     */
+    UserBlock(const uchar *data, quint32 length, quint8 flags = 0);
+
+    /**
+     * @brief 把 users 中从 from 开始的 count 个记录按字典布局、UTF-8 编码成一个数据块，追加到 out，
+     *        id 非递减时 id 列使用差分 varint。
+     * @return 需要设置到记录头 flags 中的标志
+     */
+    static quint8 encode(const QVector<User> &users, int from, int count, QByteArray *out);
+
+    /**
+     * @brief 只读出块中第一个 id，不解析其它部分。
+     * @return 数据不完整时返回 false
+     */
+    static bool firstId(const uchar *data, quint32 length, quint8 flags, quint32 *id);
+
+    bool isValid() const;
+    int count() const;
+    quint32 id(int slot) const;
+
+    /**
+     * @brief 在 id 列中查找 id。
+     * @return 下标，找不到时返回 -1
+     */
+    int find(quint32 id) const;
+
+    /**
+     * @brief 找出 id 落在 [lo, hi] 范围内的所有下标。
+     */
+    QVector<int> filterRange(quint32 lo, quint32 hi) const;
+
+    /**
+     * @brief 解码指定下标的 User。
+     */
+    User user(int slot) const;
+
+    /**
+     * @brief 把指定下标的 User 解码到 user 中，尽量复用 user 中字符串已有的存储。
+     */
+    void decodeUser(int slot, User *user) const;
+
+private:
+    struct Column
+    {
+        const uchar *ends;
+        const uchar *codes;     ///< 不使用字典时为空
+        int codeWidth;
+        int entries;            ///< 使用字典时为字典中的字符串个数，否则为 count
+        const uchar *strings;
+        quint32 stringSize;
+        quint32 firstBegin;     ///< 第一个字符串的起始位置，旧布局中 password 列接着 userName 列
+    };
+
+    bool parseColumns(const uchar *data, quint32 length, quint64 pos);
+    void string(int column, int slot, QString *str) const;
+    void readEntry(const Column &column, int index, QString *str) const;
+
+    const uchar *m_ids;
+    int m_count;
+    bool m_utf8;
+    QByteArray m_idBuffer;  ///< 差分 varint 的 id 列解码后的小端 quint32 数组
+    Column m_columns[2];
+
+    mutable QVector<QString> m_dictionary[2]; ///< 已经解码的字典，第一次用到时整列解码
+};
+
+#endif // USERBLOCK_H
@@ -0,0 +1,298 @@
+#include "userbulkloader.h"
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+
+#include "userdao.h"
+#include "userfilereader.h"
+#include "userrecordbuilder.h"
+#include "usercheckpoint.h"
+
+// 每攒够这么多字节写一次文件
+static const int LOAD_WRITE_SIZE = 4 * 1024 * 1024;
+// 缓存中每条记录除字符串内容之外大约占用的字节数：User 本身和两个 QString 的头
+static const qint64 LOAD_USER_OVERHEAD = 80;
+
+/**
+ * @brief 归并时一个有序段的读取位置
+ */
+struct UserRunCursor
+{
+    QFile file;
+    UserFileReader *reader;
+    UserRecord record;
+
+    UserRunCursor()
+        : reader(nullptr)
+    {
+
+    }
+
+    ~UserRunCursor()
+    {
+        delete reader;
+    }
+
+    bool next()
+    {
+        return reader->next(&record);
+    }
+};
+
+UserBulkLoader::UserBulkLoader(UserDao *dao, qint64 memoryBudget)
+    : m_dao(dao)
+    , m_memoryBudget(qMax(qint64(LOAD_WRITE_SIZE), memoryBudget))
+    , m_bufferBytes(0)
+    , m_count(0)
+    , m_failed(false)
+    , m_finished(false)
+    , m_dataFileName(dao->fileName() + ".load")
+    , m_indexFileName(dao->indexFileName() + ".load")
+{
+
+}
+
+UserBulkLoader::~UserBulkLoader()
+{
+    foreach (const QString &fileName, m_runFileNames)
+    {
+        QFile::remove(fileName);
+    }
+    QFile::remove(m_dataFileName);
+    QFile::remove(m_indexFileName);
+}
+
+bool UserBulkLoader::add(const User &user)
+{
+    if (m_failed || m_finished)
+    {
+        return false;
+    }
+
+    m_buffer.append(user);
+    m_bufferBytes += cost(user);
+    ++m_count;
+    if (m_bufferBytes >= m_memoryBudget && !spill())
+    {
+        m_failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool UserBulkLoader::add(const QVector<User> &users)
+{
+    foreach (const User &user, users)
+    {
+        if (!add(user))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool UserBulkLoader::finish()
+{
+    if (m_failed || m_finished)
+    {
+        return false;
+    }
+    m_finished = true;
+
+    // 已经写出过有序段时剩下的记录也写成一段，统一归并
+    if (!m_runFileNames.isEmpty() && !m_buffer.isEmpty() && !spill())
+    {
+        return false;
+    }
+    if (!merge())
+    {
+        return false;
+    }
+    foreach (const QString &fileName, m_runFileNames)
+    {
+        QFile::remove(fileName);
+    }
+    m_runFileNames.clear();
+
+    return m_dao->installFiles(m_dataFileName, m_indexFileName);
+}
+
+qint64 UserBulkLoader::count() const
+{
+    return m_count;
+}
+
+int UserBulkLoader::runCount() const
+{
+    return m_runFileNames.size();
+}
+
+bool UserBulkLoader::spill()
+{
+    sortBuffer();
+    QString fileName = m_dao->fileName() + ".run" + QString::number(m_runFileNames.size());
+    m_runFileNames.append(fileName);
+    bool written = writeRun(fileName, m_buffer);
+    m_buffer.clear();
+    m_bufferBytes = 0;
+    return written;
+}
+
+void UserBulkLoader::sortBuffer()
+{
+    // 稳定排序保持同一个 id 的加入顺序，去重时保留最后一条
+    std::stable_sort(m_buffer.begin(), m_buffer.end(), [](const User &a, const User &b) {
+        return a.id() < b.id();
+    });
+    int unique = 0;
+    for (int i = 0; i < m_buffer.size(); ++i)
+    {
+        if (i + 1 < m_buffer.size() && m_buffer.at(i + 1).id() == m_buffer.at(i).id())
+        {
+            continue;
+        }
+        m_buffer[unique++] = m_buffer.at(i);
+    }
+    m_buffer.resize(unique);
+}
+
+bool UserBulkLoader::writeRun(const QString &fileName, const QVector<User> &users)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+        return false;
+    }
+
+    // 有序段只在归并时顺序读一遍，按行写入，不压缩
+    bool ok = file.write(UserFormat::fileHeader()) == UserFormat::FileHeaderSize;
+    UserRecordBuilder builder;
+    for (int i = 0; ok && i < users.size(); ++i)
+    {
+        builder.put(users.at(i));
+        if (builder.data().size() >= LOAD_WRITE_SIZE || i + 1 == users.size())
+        {
+            builder.finish();
+            ok = file.write(builder.data()) == builder.data().size();
+            builder.clear();
+        }
+    }
+    file.close();
+    if (!ok)
+    {
+        qDebug() << QString::fromLocal8Bit("\n文件写入失败");
+    }
+    return ok;
+}
+
+bool UserBulkLoader::merge()
+{
+    QFile::remove(m_indexFileName);
+    QFile out(m_dataFileName);
+    if (!out.open(QFile::WriteOnly | QFile::Truncate)) {
+        qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+        return false;
+    }
+    bool ok = out.write(UserFormat::fileHeader()) == UserFormat::FileHeaderSize;
+
+    int blockSize = m_dao->writeFormat() == UserDao::BlockFormat ? m_dao->blockSize() : 0;
+    UserRecordBuilder builder(blockSize, quint8(m_dao->compression()));
+    auto flushBuilder = [&]() {
+        builder.finish();
+        QVector<UserIndex::Item> items = builder.items(out.pos());
+        ok = out.write(builder.data()) == builder.data().size()
+                && UserIndex::appendFile(m_indexFileName, items);
+        builder.clear();
+    };
+    auto put = [&](const User &user) {
+        builder.put(user);
+        if (ok && builder.data().size() >= LOAD_WRITE_SIZE)
+        {
+            flushBuilder();
+        }
+    };
+
+    // 没有写出过有序段时全部记录都在内存中，排序去重后在归并之后直接写出
+    sortBuffer();
+
+    QVector<UserRunCursor *> cursors;
+    for (int i = 0; ok && i < m_runFileNames.size(); ++i)
+    {
+        UserRunCursor *cursor = new UserRunCursor;
+        cursors.append(cursor);
+        cursor->file.setFileName(m_runFileNames.at(i));
+        if (!cursor->file.open(QFile::ReadOnly)) {
+            qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+            ok = false;
+            break;
+        }
+        cursor->reader = new UserFileReader(&cursor->file);
+    }
+
+    // 小顶堆，堆顶是 id 最小的段；id 相同时后写出的段（后加入的记录）在前
+    auto after = [&cursors](int a, int b) {
+        quint32 idA = cursors.at(a)->record.user.id();
+        quint32 idB = cursors.at(b)->record.user.id();
+        return idA > idB || (idA == idB && a < b);
+    };
+    QVector<int> heap;
+    for (int i = 0; ok && i < cursors.size(); ++i)
+    {
+        if (cursors.at(i)->next())
+        {
+            heap.append(i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), after);
+
+    auto advance = [&](int i) {
+        if (cursors.at(i)->next())
+        {
+            heap.append(i);
+            std::push_heap(heap.begin(), heap.end(), after);
+        }
+    };
+
+    while (ok && !heap.isEmpty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        int top = heap.takeLast();
+        quint32 id = cursors.at(top)->record.user.id();
+        put(cursors.at(top)->record.user);
+        advance(top);
+
+        // 其它段中相同 id 的旧记录直接跳过
+        while (!heap.isEmpty() && cursors.at(heap.first())->record.user.id() == id)
+        {
+            std::pop_heap(heap.begin(), heap.end(), after);
+            advance(heap.takeLast());
+        }
+    }
+    qDeleteAll(cursors);
+
+    for (int i = 0; ok && i < m_buffer.size(); ++i)
+    {
+        put(m_buffer.at(i));
+    }
+    m_buffer.clear();
+    m_bufferBytes = 0;
+
+    if (ok)
+    {
+        flushBuilder();
+    }
+    ok = ok && UserCheckpoint::syncFile(out);
+    out.close();
+    if (!ok)
+    {
+        qDebug() << QString::fromLocal8Bit("\n批量加载写入失败");
+        return false;
+    }
+    return UserCheckpoint::syncFile(m_indexFileName);
+}
+
+qint64 UserBulkLoader::cost(const User &user)
+{
+    return LOAD_USER_OVERHEAD + 2 * qint64(user.userName().size() + user.password().size());
+}
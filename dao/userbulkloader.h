@@ -0,0 +1,103 @@
+#ifndef USERBULKLOADER_H
+#define USERBULKLOADER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "data/user.h"
+
+class UserDao;
+
+/**
+ * @brief 批量加载：接收任意多条 User（不需要一次全部放在内存里），按 id 排序后生成新的数据文件和索引，
+ *        替换 UserDao 原有的全部内容。
+ *
+ * 外部排序：加入的记录先放在内存中，估计的占用超过 memoryBudget 时按 id 排序，写成一个有序段（临时文件），
+ * finish() 时多路归并所有有序段，顺序写一遍数据文件，同时追加索引文件，最后写检查点并替换原文件。
+ * 同一个 id 加入多次时以最后一次为准。内存占用由 memoryBudget 和有序段的个数决定，与记录总数无关
+ * （UserDao 之后加载索引仍然需要与记录数成正比的内存）。
+ *
+ * 数据文件按 UserDao 当前的写入格式和压缩设置写入，记录按 id 有序，稀疏索引的各段互不重叠。
+ * 名字索引在下次 selectByName() 时重建。
+ * 加载期间可以继续使用 UserDao，但 finish() 之前写入的内容会被替换掉。
+ */
+class UserBulkLoader
+{
+    Q_DISABLE_COPY(UserBulkLoader)
+
+public:
+    /**
+     * @param dao 要加载到的 UserDao，临时文件放在它的数据文件旁边
+     * @param memoryBudget 内存中缓存的记录占用的上限（字节）
+     */
+    explicit UserBulkLoader(UserDao *dao, qint64 memoryBudget = 256 * 1024 * 1024);
+
+    /**
+     * @brief 删除剩余的临时文件（没有调用 finish() 时 UserDao 保持原样）
+     */
+    ~UserBulkLoader();
+
+    /**
+     * @brief 加入一条记录，缓存满时写出一个有序段。
+     * @return 写有序段失败时返回 false，之后的调用都失败
+     */
+    bool add(const User &user);
+    bool add(const QVector<User> &users);
+
+    /**
+     * @brief 归并所有记录，写出数据文件和索引文件并替换 UserDao 的内容。之后不能再加入记录。
+     * @return 执行结果，失败时 UserDao 保持原样
+     */
+    bool finish();
+
+    /**
+     * @brief 已经加入的记录数（包括重复的 id）
+     */
+    qint64 count() const;
+
+    /**
+     * @brief 已经写出的有序段个数
+     */
+    int runCount() const;
+
+private:
+    /**
+     * @brief 把缓存中的记录写成一个有序段
+     */
+    bool spill();
+
+    /**
+     * @brief 按 id 排序缓存中的记录并去掉重复的 id（保留最后加入的）
+     */
+    void sortBuffer();
+
+    /**
+     * @brief 把 users（按 id 有序）写到 fileName，文件格式与 user.dat 相同
+     */
+    bool writeRun(const QString &fileName, const QVector<User> &users);
+
+    /**
+     * @brief 多路归并有序段（没有有序段时直接写出缓存），写出新的数据文件和索引文件
+     */
+    bool merge();
+
+    /**
+     * @brief 一条记录在缓存中大约占用的字节数
+     */
+    static qint64 cost(const User &user);
+
+    UserDao *m_dao;
+    qint64 m_memoryBudget;
+
+    QVector<User> m_buffer;
+    qint64 m_bufferBytes;
+    qint64 m_count;
+    QStringList m_runFileNames;
+    bool m_failed;
+    bool m_finished;
+
+    const QString m_dataFileName;  ///< 归并结果，替换之前的临时数据文件
+    const QString m_indexFileName; ///< 与之对应的临时索引文件
+};
+
+#endif // USERBULKLOADER_H
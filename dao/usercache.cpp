@@ -0,0 +1,221 @@
+#include "usercache.h"
+
+// 每个条目除字符串内容以外的开销：Entry、哈希表节点、两个 QString 的头部
+static const qint64 ENTRY_OVERHEAD = 96;
+
+UserCache::Stats::Stats()
+    : hits(0)
+    , misses(0)
+    , insertions(0)
+    , evictions(0)
+    , invalidations(0)
+    , entries(0)
+    , bytes(0)
+    , capacity(0)
+{
+
+}
+
+double UserCache::Stats::hitRatio() const
+{
+    qint64 lookups = hits + misses;
+    return lookups > 0 ? double(hits) / lookups : 0.0;
+}
+
+UserCache::UserCache(qint64 capacity, int shards)
+    : m_capacity(qMax<qint64>(0, capacity))
+    , m_shift(32)
+{
+    int count = 1;
+    while (count < shards && count < 1024)
+    {
+        count *= 2;
+        --m_shift;
+    }
+    m_shardCapacity = m_capacity / count;
+
+    m_shards.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        Shard *shard = new Shard;
+        shard->hand = 0;
+        shard->bytes = 0;
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->insertions = 0;
+        shard->evictions = 0;
+        shard->invalidations = 0;
+        m_shards.append(shard);
+    }
+}
+
+UserCache::~UserCache()
+{
+    qDeleteAll(m_shards);
+}
+
+qint64 UserCache::capacity() const
+{
+    return m_capacity;
+}
+
+bool UserCache::find(quint32 id, User *user)
+{
+    Shard &s = shard(id);
+    QMutexLocker locker(&s.mutex);
+    QHash<quint32, int>::const_iterator it = s.slots.constFind(id);
+    if (it == s.slots.constEnd())
+    {
+        ++s.misses;
+        return false;
+    }
+
+    Entry &entry = s.entries[it.value()];
+    entry.referenced = true;
+    *user = entry.user;
+    ++s.hits;
+    return true;
+}
+
+void UserCache::insert(const User &user)
+{
+    qint64 entryCost = cost(user);
+    Shard &s = shard(user.id());
+    QMutexLocker locker(&s.mutex);
+
+    QHash<quint32, int>::const_iterator it = s.slots.constFind(user.id());
+    if (it != s.slots.constEnd())
+    {
+        release(s, it.value());
+    }
+    if (entryCost > m_shardCapacity)
+    {
+        return;
+    }
+    evict(s, entryCost);
+
+    int slot;
+    if (s.freeSlots.isEmpty())
+    {
+        slot = s.entries.size();
+        s.entries.append(Entry());
+    }
+    else
+    {
+        slot = s.freeSlots.takeLast();
+    }
+
+    // 新条目不设访问标记，只被访问过一次的记录在指针下一次经过时就会被淘汰
+    Entry &entry = s.entries[slot];
+    entry.user = user;
+    entry.cost = entryCost;
+    entry.used = true;
+    entry.referenced = false;
+    s.slots.insert(user.id(), slot);
+    s.bytes += entryCost;
+    ++s.insertions;
+}
+
+void UserCache::remove(quint32 id)
+{
+    Shard &s = shard(id);
+    QMutexLocker locker(&s.mutex);
+    QHash<quint32, int>::const_iterator it = s.slots.constFind(id);
+    if (it != s.slots.constEnd())
+    {
+        release(s, it.value());
+        ++s.invalidations;
+    }
+}
+
+void UserCache::clear()
+{
+    foreach (Shard *s, m_shards)
+    {
+        QMutexLocker locker(&s->mutex);
+        s->slots.clear();
+        s->entries.clear();
+        s->freeSlots.clear();
+        s->hand = 0;
+        s->bytes = 0;
+    }
+}
+
+UserCache::Stats UserCache::stats() const
+{
+    Stats stats;
+    stats.capacity = m_capacity;
+    foreach (Shard *s, m_shards)
+    {
+        QMutexLocker locker(&s->mutex);
+        stats.hits += s->hits;
+        stats.misses += s->misses;
+        stats.insertions += s->insertions;
+        stats.evictions += s->evictions;
+        stats.invalidations += s->invalidations;
+        stats.entries += s->slots.size();
+        stats.bytes += s->bytes;
+    }
+    return stats;
+}
+
+void UserCache::resetStats()
+{
+    foreach (Shard *s, m_shards)
+    {
+        QMutexLocker locker(&s->mutex);
+        s->hits = 0;
+        s->misses = 0;
+        s->insertions = 0;
+        s->evictions = 0;
+        s->invalidations = 0;
+    }
+}
+
+qint64 UserCache::cost(const User &user)
+{
+    return ENTRY_OVERHEAD + qint64(user.userName().size() + user.password().size()) * qint64(sizeof(QChar));
+}
+
+UserCache::Shard &UserCache::shard(quint32 id)
+{
+    // 乘法哈希取高位，连续的 id 也能均匀地分到各个分片
+    return *m_shards.at(m_shift >= 32 ? 0 : int((id * 2654435761u) >> m_shift));
+}
+
+void UserCache::evict(Shard &shard, qint64 cost)
+{
+    while (shard.bytes + cost > m_shardCapacity && !shard.slots.isEmpty())
+    {
+        if (shard.hand >= shard.entries.size())
+        {
+            shard.hand = 0;
+        }
+
+        Entry &entry = shard.entries[shard.hand];
+        if (entry.used)
+        {
+            if (entry.referenced)
+            {
+                entry.referenced = false;
+            }
+            else
+            {
+                release(shard, shard.hand);
+                ++shard.evictions;
+            }
+        }
+        ++shard.hand;
+    }
+}
+
+void UserCache::release(Shard &shard, int slot)
+{
+    Entry &entry = shard.entries[slot];
+    shard.slots.remove(entry.user.id());
+    shard.bytes -= entry.cost;
+    entry.user = User();
+    entry.used = false;
+    entry.referenced = false;
+    shard.freeSlots.append(slot);
+}
@@ -0,0 +1,116 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include "data/user.h"
+
+/**
+ * @brief 按 id 缓存 User 的内存缓存，容量按字节计算（见 cost()）。
+ *
+ * 按 id 分成若干分片，每个分片有自己的锁，多个线程查询不同的 id 时基本不会互相等待。
+ * 每个分片用 CLOCK 算法近似 LRU：命中时只设置访问标记，淘汰时时钟指针扫过的条目
+ * 有标记的清除标记后跳过，没有标记的被淘汰。
+ *
+ * 命中、未命中、淘汰等计数可以用来按实际的命中率曲线确定容量。
+ */
+class UserCache
+{
+    Q_DISABLE_COPY(UserCache)
+
+public:
+    struct Stats
+    {
+        qint64 hits;
+        qint64 misses;
+        qint64 insertions;
+        qint64 evictions;
+        qint64 invalidations;
+        qint64 entries;  ///< 当前缓存的条目数
+        qint64 bytes;    ///< 当前占用的字节数
+        qint64 capacity; ///< 容量（字节）
+
+        Stats();
+        double hitRatio() const;
+    };
+
+    /**
+     * @param capacity 容量（字节），平均分给各个分片
+     * @param shards 分片数，取不小于它的 2 的幂
+     */
+    explicit UserCache(qint64 capacity, int shards = 16);
+    ~UserCache();
+
+    qint64 capacity() const;
+
+    /**
+     * @brief 查找 id，命中时复制到 user。
+     * @return 是否命中
+     */
+    bool find(quint32 id, User *user);
+
+    /**
+     * @brief 放入缓存（已有的条目被替换），空间不够时先淘汰；比一个分片的容量还大的记录不缓存。
+     */
+    void insert(const User &user);
+
+    /**
+     * @brief 删除 id 对应的条目（记录被修改或删除时）
+     */
+    void remove(quint32 id);
+
+    void clear();
+
+    Stats stats() const;
+    void resetStats();
+
+    /**
+     * @brief 一条记录在缓存中大约占用的字节数：条目和哈希表节点本身加上字符串内容
+     */
+    static qint64 cost(const User &user);
+
+private:
+    struct Entry
+    {
+        User user;
+        qint64 cost;
+        bool used;
+        bool referenced;
+    };
+
+    struct Shard
+    {
+        mutable QMutex mutex;
+        QHash<quint32, int> slots; ///< id -> entries 中的下标
+        QVector<Entry> entries;
+        QVector<int> freeSlots;
+        int hand;
+        qint64 bytes;
+
+        qint64 hits;
+        qint64 misses;
+        qint64 insertions;
+        qint64 evictions;
+        qint64 invalidations;
+    };
+
+    Shard &shard(quint32 id);
+
+    /**
+     * @brief 按 CLOCK 淘汰，直到放得下 cost 字节，调用者需要持有分片的锁
+     */
+    void evict(Shard &shard, qint64 cost);
+
+    /**
+     * @brief 删除 entries 中的一项，调用者需要持有分片的锁
+     */
+    void release(Shard &shard, int slot);
+
+    qint64 m_capacity;
+    qint64 m_shardCapacity;
+    int m_shift;
+    QVector<Shard *> m_shards;
+};
+
+#endif // USERCACHE_H
@@ -0,0 +1,117 @@
+#include "usercheckpoint.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#  include <io.h>
+#else
+#  include <unistd.h>
+#endif
+
+#include "crc32c.h"
+
+static const quint32 CHECKPOINT_MAGIC   = 0x55434b50; // "UCKP"
+static const quint32 CHECKPOINT_VERSION = 1;
+
+// 按线程计数，统计时不会把其它线程（其它 UserDao）的落盘算进来
+static thread_local qint64 s_syncCount = 0;
+
+UserCheckpoint::UserCheckpoint()
+    : dataSize(0)
+    , indexSize(0)
+{
+
+}
+
+bool UserCheckpoint::read(const QString &fileName, UserCheckpoint *checkpoint)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        return false;
+    }
+    QByteArray content = file.readAll();
+    file.close();
+
+    QDataStream stream(content);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 dataSize = 0;
+    qint64 indexSize = 0;
+    quint32 crc = 0;
+    stream >> magic >> version >> dataSize >> indexSize;
+    int fieldsSize = int(stream.device()->pos());
+    stream >> crc;
+    if (stream.status() != QDataStream::Ok
+            || magic != CHECKPOINT_MAGIC
+            || version != CHECKPOINT_VERSION
+            || crc != Crc32c::compute(reinterpret_cast<const uchar *>(content.constData()), fieldsSize)
+            || dataSize < 0 || indexSize < 0)
+    {
+        return false;
+    }
+
+    checkpoint->dataSize = dataSize;
+    checkpoint->indexSize = indexSize;
+    return true;
+}
+
+bool UserCheckpoint::write(const QString &fileName) const
+{
+    QByteArray content;
+    QDataStream stream(&content, QIODevice::WriteOnly);
+    stream << CHECKPOINT_MAGIC << CHECKPOINT_VERSION << dataSize << indexSize;
+    stream << Crc32c::compute(reinterpret_cast<const uchar *>(content.constData()), content.size());
+
+    // QSaveFile 写临时文件，commit() 时用原子的改名替换原文件，中途失败时原文件不变
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qDebug() << QString::fromLocal8Bit("\n检查点文件打开失败");
+        return false;
+    }
+    if (file.write(content) != content.size() || !syncFile(file) || !file.commit())
+    {
+        qDebug() << QString::fromLocal8Bit("\n检查点文件写入失败");
+        file.cancelWriting();
+        return false;
+    }
+    return true;
+}
+
+bool UserCheckpoint::syncFile(QFileDevice &file)
+{
+    if (!file.flush())
+    {
+        return false;
+    }
+    ++s_syncCount;
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+bool UserCheckpoint::syncFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.exists())
+    {
+        return true;
+    }
+    if (!file.open(QFile::ReadWrite))
+    {
+        return false;
+    }
+    bool synced = syncFile(file);
+    file.close();
+    return synced;
+}
+
+qint64 UserCheckpoint::syncCount()
+{
+    return s_syncCount;
+}
@@ -0,0 +1,50 @@
+#ifndef USERCHECKPOINT_H
+#define USERCHECKPOINT_H
+
+#include <QString>
+
+class QFileDevice;
+
+/**
+ * @brief 检查点：记录数据文件和索引文件中已经落盘并校验过的长度，保存在 user.ckpt 中。
+ *
+ * 写检查点之前先 fsync 数据文件和索引文件，因此检查点之前的内容在掉电后仍然完整，
+ * 启动时只需要校验检查点之后写入的记录。
+ *
+ * 文件格式（QDataStream）：
+ *     quint32 magic, quint32 version, qint64 dataSize, qint64 indexSize, quint32 crc
+ * crc 是前面所有字段的 CRC-32C，检查点文件本身不完整或者损坏时当作没有检查点。
+ */
+struct UserCheckpoint
+{
+    qint64 dataSize;  ///< 数据文件中已经校验过的长度
+    qint64 indexSize; ///< 索引文件中与之对应的长度
+
+    UserCheckpoint();
+
+    /**
+     * @brief 读取检查点文件。
+     * @return 文件不存在或者损坏时返回 false
+     */
+    static bool read(const QString &fileName, UserCheckpoint *checkpoint);
+
+    /**
+     * @brief 写入检查点文件：用 QSaveFile 先写到临时文件并 fsync，再原子地替换原文件，
+     *        任何时候读到的都是完整的旧文件或新文件。
+     * @return 执行结果
+     */
+    bool write(const QString &fileName) const;
+
+    /**
+     * @brief 把文件已经写入操作系统的内容刷到磁盘
+     */
+    static bool syncFile(QFileDevice &file);
+    static bool syncFile(const QString &fileName);
+
+    /**
+     * @brief 当前线程调用 fsync 的累计次数，调用前后相减得到一次操作落盘的次数
+     */
+    static qint64 syncCount();
+};
+
+#endif // USERCHECKPOINT_H
@@ -0,0 +1,108 @@
+#include "usercodec.h"
+#include <QString>
+#include <QtEndian>
+
+#include "data/user.h"
+#include "include/serializefields.h"
+
+qint64 UserCodec::decode(const uchar *data, qint64 size, User *user, int version)
+{
+    quint32 id = 0;
+    qint64 pos = 0;
+    if (version >= SerializeVarintVersion)
+    {
+        pos = SerializeDetail::getVarint(data, size, &id);
+        if (pos < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if (size < qint64(sizeof(quint32)))
+        {
+            return -1;
+        }
+        pos = sizeof(quint32);
+        id = qFromBigEndian<quint32>(data);
+    }
+
+    // 先把字符串从 user 中取出来，没有其他地方共享时直接复用原来的存储
+    QString userName = user->userName();
+    QString password = user->password();
+    user->setUserName(QString());
+    user->setPassword(QString());
+
+    qint64 (*decodeField)(const uchar *, qint64, QString *) =
+            version >= SerializeUtf8Version ? decodeUtf8String : decodeString;
+    qint64 used = decodeField(data + pos, size - pos, &userName);
+    if (used < 0)
+    {
+        return -1;
+    }
+    pos += used;
+
+    used = decodeField(data + pos, size - pos, &password);
+    if (used < 0)
+    {
+        return -1;
+    }
+    pos += used;
+
+    user->setId(id);
+    user->setUserName(userName);
+    user->setPassword(password);
+    return pos;
+}
+
+qint64 UserCodec::decodeString(const uchar *data, qint64 size, QString *str)
+{
+    if (size < qint64(sizeof(quint32)))
+    {
+        return -1;
+    }
+    quint32 bytes = qFromBigEndian<quint32>(data);
+    data += sizeof(quint32);
+
+    if (bytes == 0xffffffff)
+    {
+        // QDataStream 中的空（null）字符串
+        *str = QString();
+        return sizeof(quint32);
+    }
+    if ((bytes & 1) || qint64(bytes) > size - qint64(sizeof(quint32)))
+    {
+        return -1;
+    }
+
+    int length = int(bytes / 2);
+    str->resize(length);
+    ushort *out = reinterpret_cast<ushort *>(str->data());
+    for (int i = 0; i < length; ++i)
+    {
+        out[i] = qFromBigEndian<quint16>(data + i * 2);
+    }
+    return sizeof(quint32) + bytes;
+}
+
+qint64 UserCodec::decodeUtf8String(const uchar *data, qint64 size, QString *str)
+{
+    quint32 length = 0;
+    qint64 prefix = SerializeDetail::getVarint(data, size, &length);
+    if (prefix < 0)
+    {
+        return -1;
+    }
+    if (length == 0)
+    {
+        *str = QString();
+        return prefix;
+    }
+
+    quint32 bytes = length - 1;
+    if (qint64(bytes) > size - prefix || !Utf8String::decode(data + prefix, int(bytes), str))
+    {
+        return -1;
+    }
+    return prefix + bytes;
+}
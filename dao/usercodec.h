@@ -0,0 +1,40 @@
+#ifndef USERCODEC_H
+#define USERCODEC_H
+
+#include <QtGlobal>
+
+#include "include/serializefields.h"
+
+class User;
+
+/**
+ * @brief 直接在内存（例如映射的 user.dat）上按 QDataStream 的格式解码 User，
+ *        不经过 QIODevice 和 QDataStream，字符串直接从源字节转换到 QString 的存储中。
+ */
+class UserCodec
+{
+public:
+    /**
+     * @brief 解码一条 User 记录，格式与 operator<<(QDataStream&, const User&) 相同。
+     * @param data 记录起始地址
+     * @param size 可用字节数
+     * @param user[out] 解码结果，user 中原有的字符串没有被共享时复用它们的存储
+     * @param version 序列化版本（SerializeVersion），见 UserFormat::serializeVersion()
+     * @return 记录占用的字节数，数据不完整时返回 -1
+     */
+    static qint64 decode(const uchar *data, qint64 size, User *user, int version = SerializeDataStreamVersion);
+
+    /**
+     * @brief 解码一个 QDataStream 格式的 QString（quint32 字节数 + UTF-16 大端）。
+     * @return 占用的字节数，数据不完整时返回 -1
+     */
+    static qint64 decodeString(const uchar *data, qint64 size, QString *str);
+
+    /**
+     * @brief 解码一个 varint（字节数 + 1，0 表示 null）+ UTF-8 的 QString。
+     * @return 占用的字节数，数据不完整或者不是合法的 UTF-8 时返回 -1
+     */
+    static qint64 decodeUtf8String(const uchar *data, qint64 size, QString *str);
+};
+
+#endif // USERCODEC_H
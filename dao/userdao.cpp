@@ -1,97 +1,1526 @@
 #include "userdao.h"
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QThread>
+#include <algorithm>
+#include <limits>
 
+#include "userfilereader.h"
+#include "userrecordbuilder.h"
+#include "userblock.h"
+#include "userwriter.h"
+#include "blockcodec.h"
+#include "usercheckpoint.h"
+#include "usersnapshot.h"
 
-const QString fileName = "user.dat";
 
+// 数据文件小于这个长度时不自动压缩
+static const qint64 COMPACTION_MIN_SIZE = 1024 * 1024;
+// 压缩时每攒够这么多字节写一次新文件
+static const int COMPACTION_BATCH_SIZE = 4 * 1024 * 1024;
+// 压缩时每攒够这么多条有效记录，按 id 排序后写成一个有序段
+static const int COMPACTION_RUN_SIZE = 256 * 1024;
+// 并行解码时每个线程大约分到的段数，段多一些可以让各线程的负载更均匀
+static const int DECODE_CHUNKS_PER_THREAD = 4;
+// 并行解码时每段的最小长度，文件太小时不值得切分
+static const qint64 DECODE_MIN_CHUNK_SIZE = 256 * 1024;
+// 距离上次检查点写入超过这个长度时写一个新的检查点
+static const qint64 CHECKPOINT_INTERVAL = 64 * 1024 * 1024;
+
+
+/**
+ * @brief 索引、检查点文件和数据文件放在一起，只换扩展名，例如 user.dat -> user.idx
+ */
+static QString siblingFileName(const QString &fileName, const QString &suffix)
+{
+    QFileInfo info(fileName);
+    QString baseName = info.completeSuffix().isEmpty() ? info.fileName() : info.completeBaseName();
+    return info.dir().filePath(baseName + suffix);
+}
+
+UserDao::UserDao(const QString &fileName)
+    : m_fileName(fileName)
+    , m_indexFileName(siblingFileName(fileName, ".idx"))
+    , m_checkpointFileName(siblingFileName(fileName, ".ckpt"))
+    , m_compactFileName(fileName + ".compact")
+    , m_nameIndexFileName(siblingFileName(fileName, ".nidx"))
+    , m_readMode(StreamRead)
+    , m_fileVersion(UserFormat::EmptyFile)
+    , m_epoch(0)
+    , m_committedSize(-1)
+    , m_writeFormat(RowFormat)
+    , m_blockSize(1024)
+    , m_codec(BlockCodec::NoCodec)
+    , m_cache(nullptr)
+    , m_parallelism(qMax(1, QThread::idealThreadCount()))
+    , m_writer(nullptr)
+    , m_compactionRatio(0.5)
+{
+    m_decodePool.setMaxThreadCount(m_parallelism);
+}
+
+UserDao::~UserDao()
+{
+    setWriteBehind(false);
+    waitForCompaction();
+    checkpoint();
+    delete m_cache;
+}
+
+QString UserDao::fileName() const
+{
+    return m_fileName;
+}
+
+QString UserDao::indexFileName() const
+{
+    return m_indexFileName;
+}
+
+QString UserDao::checkpointFileName() const
+{
+    return m_checkpointFileName;
+}
+
+QString UserDao::nameIndexFileName() const
+{
+    return m_nameIndexFileName;
+}
+
+UserDao::ReadMode UserDao::readMode() const
+{
+    return m_readMode;
+}
+
+void UserDao::setReadMode(UserDao::ReadMode mode)
+{
+    QWriteLocker locker(&m_lock);
+    m_readMode = mode;
+    if (mode != MappedRead)
+    {
+        m_map.close();
+    }
+}
+
+UserDao::WriteFormat UserDao::writeFormat() const
+{
+    return m_writeFormat;
+}
+
+int UserDao::blockSize() const
+{
+    return m_blockSize;
+}
+
+void UserDao::setWriteFormat(UserDao::WriteFormat format, int blockSize)
+{
+    QWriteLocker locker(&m_lock);
+    m_writeFormat = format;
+    m_blockSize = qMax(1, blockSize);
+}
+
+int UserDao::compression() const
+{
+    return m_codec;
+}
+
+void UserDao::setCompression(int codec)
+{
+    QWriteLocker locker(&m_lock);
+    if (codec != BlockCodec::NoCodec && !BlockCodec::codec(quint8(codec)))
+    {
+        qDebug() << QString::fromLocal8Bit("\n未知的压缩算法") << codec;
+        return;
+    }
+    m_codec = quint8(codec);
+}
+
+int UserDao::parallelism() const
+{
+    return m_parallelism;
+}
+
+void UserDao::setCacheCapacity(qint64 bytes, int shards)
+{
+    QWriteLocker locker(&m_lock);
+    delete m_cache;
+    m_cache = bytes > 0 ? new UserCache(bytes, shards) : nullptr;
+}
+
+qint64 UserDao::cacheCapacity() const
+{
+    // setCacheCapacity() 持有写锁时会删除 m_cache
+    QReadLocker locker(&m_lock);
+    return m_cache ? m_cache->capacity() : 0;
+}
+
+UserCache::Stats UserDao::cacheStats() const
+{
+    QReadLocker locker(&m_lock);
+    return m_cache ? m_cache->stats() : UserCache::Stats();
+}
+
+void UserDao::resetCacheStats()
+{
+    QReadLocker locker(&m_lock);
+    if (m_cache)
+    {
+        m_cache->resetStats();
+    }
+}
+
+void UserDao::setParallelism(int threads)
+{
+    QWriteLocker locker(&m_lock);
+    m_parallelism = qMax(1, threads);
+    m_decodePool.setMaxThreadCount(m_parallelism);
+}
 
 bool UserDao::insert(const User &user)
 {
-    QFile  file(fileName);
+    if (m_writer)
+    {
+        m_writer->enqueue(user);
+        return true;
+    }
+    return insert(QVector<User>() << user);
+}
+
+bool UserDao::insert(const QVector<User> &users)
+{
+    return insertUsers(users, false);
+}
+
+void UserDao::setWriteBehind(bool enabled, int maxBatch, int maxDelay, UserDao::Durability durability)
+{
+    if (m_writer)
+    {
+        m_writer->stop();
+        delete m_writer;
+        m_writer = nullptr;
+    }
+
+    if (enabled)
+    {
+        bool sync = durability == SyncPerBatch;
+        m_writer = new UserWriter([this, sync](const QVector<User> &users) {
+            return insertUsers(users, sync);
+        }, maxBatch, maxDelay);
+    }
+}
+
+bool UserDao::isWriteBehind() const
+{
+    return m_writer != nullptr;
+}
+
+QFuture<bool> UserDao::insertQueued(const User &user)
+{
+    if (m_writer)
+    {
+        return m_writer->enqueue(user);
+    }
+
+    QFutureInterface<bool> result;
+    result.reportStarted();
+    result.reportResult(insert(QVector<User>() << user));
+    result.reportFinished();
+    return result.future();
+}
+
+bool UserDao::flush()
+{
+    return m_writer ? m_writer->flush() : true;
+}
+
+bool UserDao::update(const User &user)
+{
+    return update(QVector<User>() << user);
+}
+
+bool UserDao::update(const QVector<User> &users)
+{
+    UserStats::Scope scope(&m_stats, UserStats::Update);
+    if (!prepareWrite())
+    {
+        return false;
+    }
+
+    UserRecordBuilder builder(builderBlockSize(), m_codec);
+    foreach (const User &user, users)
+    {
+        builder.put(user);
+    }
+    builder.finish();
+
+    QWriteLocker locker(&m_lock);
+    foreach (const User &user, users)
+    {
+        if (!m_index.contains(user.id()))
+        {
+            qDebug() << QString::fromLocal8Bit("\n要更新的记录不存在") << user.id();
+            return false;
+        }
+    }
+    invalidate(users);
+    return appendRecords(builder, false, &users);
+}
+
+bool UserDao::remove(const User &user)
+{
+    return remove(QVector<User>() << user);
+}
+
+bool UserDao::remove(const QVector<User> &users)
+{
+    UserStats::Scope scope(&m_stats, UserStats::Remove);
+    if (!prepareWrite())
+    {
+        return false;
+    }
+
+    UserRecordBuilder builder;
+    foreach (const User &user, users)
+    {
+        builder.remove(user.id());
+    }
+
+    QWriteLocker locker(&m_lock);
+    foreach (const User &user, users)
+    {
+        if (!m_index.contains(user.id()))
+        {
+            qDebug() << QString::fromLocal8Bit("\n要删除的记录不存在") << user.id();
+            return false;
+        }
+    }
+    invalidate(users);
+    return appendRecords(builder);
+}
+
+bool UserDao::select(quint32 id, User *user)
+{
+    UserStats::Scope scope(&m_stats, UserStats::Select);
+    if (!loadIndex())
+    {
+        return false;
+    }
+
+    QReadLocker locker(&m_lock);
+    return lookup(id, user);
+}
+
+User UserDao::select(quint32 id)
+{
+    User user;
+    select(id, &user);
+    return user;
+}
+
+bool UserDao::contains(quint32 id)
+{
+    if (!loadIndex())
+    {
+        return false;
+    }
+
+    QReadLocker locker(&m_lock);
+    return m_index.contains(id);
+}
+
+QVector<User> UserDao::selectAll()
+{
+    return scan(0, std::numeric_limits<quint32>::max());
+}
+
+QVector<User> UserDao::selectRange(quint32 lo, quint32 hi)
+{
+    return scan(lo, hi);
+}
+
+QSharedPointer<UserSnapshot> UserDao::snapshot()
+{
+    // 索引加载时发布第一次的长度
+    if (m_committedSize.loadAcquire() < 0 && !loadIndex())
+    {
+        return QSharedPointer<UserSnapshot>();
+    }
+
+    QMutexLocker locker(&m_snapshotMutex);
+    qint64 size = 0;
+    quint64 epoch = 0;
+    readCommitted(&size, &epoch);
+    if (size < 0)
+    {
+        return QSharedPointer<UserSnapshot>();
+    }
+    if (size > 0 && (!m_snapshotMap || m_snapshotMap->size() < size))
+    {
+        // 上次映射之后有新的提交：重新映射整个文件，之前的快照继续使用原来的映射
+        QSharedPointer<MappedFile> map(new MappedFile);
+        if (!map->open(m_fileName) || map->size() < size)
+        {
+            return QSharedPointer<UserSnapshot>();
+        }
+        m_snapshotMap = map;
+    }
+    return QSharedPointer<UserSnapshot>(new UserSnapshot(m_snapshotMap, size, epoch));
+}
+
+bool UserDao::selectAll(UserBatch *batch)
+{
+    return selectRange(0, std::numeric_limits<quint32>::max(), batch);
+}
+
+bool UserDao::selectRange(quint32 lo, quint32 hi, UserBatch *batch)
+{
+    bool all = lo == 0 && hi == std::numeric_limits<quint32>::max();
+    UserStats::Scope scope(&m_stats, all ? UserStats::SelectAll : UserStats::SelectRange);
+    batch->clear();
+    if (!loadIndex())
+    {
+        return false;
+    }
+
+    QReadLocker locker(&m_lock);
+    if (all)
+    {
+        batch->reserve(m_index.count());
+    }
+    // 每条记录都解码到同一个 User 中，只把字符串的内容复制进批次
+    return visit(lo, hi, [batch](const User &user) {
+        batch->append(user);
+        return true;
+    });
+}
+
+QVector<User> UserDao::selectByName(const QString &userName)
+{
+    UserStats::Scope scope(&m_stats, UserStats::SelectByName);
+    QVector<User> users;
+    forever
+    {
+        {
+            QReadLocker locker(&m_lock);
+            if (m_nameIndex.isOpen())
+            {
+                // 名字索引不删除旧的项，改过名字或者已经删除的记录在这里过滤掉
+                foreach (quint32 id, m_nameIndex.find(userName))
+                {
+                    User user;
+                    if (lookup(id, &user) && user.userName() == userName)
+                    {
+                        users.append(user);
+                    }
+                }
+                return users;
+            }
+        }
+
+        // 压缩可能在释放写锁之后再次删除名字索引，所以重新检查
+        QWriteLocker locker(&m_lock);
+        if (!ensureNameIndex())
+        {
+            return users;
+        }
+    }
+}
+
+bool UserDao::forEach(const Visitor &visitor)
+{
+    return forEachInRange(0, std::numeric_limits<quint32>::max(), visitor);
+}
+
+bool UserDao::forEachInRange(quint32 lo, quint32 hi, const Visitor &visitor)
+{
+    if (!loadIndex())
+    {
+        return false;
+    }
+
+    QReadLocker locker(&m_lock);
+    return visit(lo, hi, visitor);
+}
+
+bool UserDao::rebuildIndex()
+{
+    QWriteLocker locker(&m_lock);
+    // 重建时可能截断数据文件，先取消映射，缓存的记录也可能已经不存在
+    QMutexLocker snapshotLocker(&m_snapshotMutex);
+    releaseSnapshotMap();
+    m_map.close();
+    if (m_cache)
+    {
+        m_cache->clear();
+    }
+    dropNameIndex();
+    QFile::remove(m_checkpointFileName);
+    if (!m_index.rebuild(m_indexFileName, m_fileName))
+    {
+        return false;
+    }
+    publishSnapshot();
+    return m_index.checkpoint(m_indexFileName, m_fileName, m_checkpointFileName);
+}
+
+bool UserDao::rebuildNameIndex()
+{
+    QWriteLocker locker(&m_lock);
+    dropNameIndex();
+    return ensureNameIndex();
+}
+
+UserStats &UserDao::stats()
+{
+    return m_stats;
+}
+
+double UserDao::compactionRatio() const
+{
+    return m_compactionRatio;
+}
+
+void UserDao::setCompactionRatio(double ratio)
+{
+    QWriteLocker locker(&m_lock);
+    m_compactionRatio = ratio;
+}
+
+double UserDao::garbageRatio()
+{
+    if (!loadIndex())
+    {
+        return 0;
+    }
+
+    QReadLocker locker(&m_lock);
+    return m_index.garbageRatio();
+}
+
+bool UserDao::compact()
+{
+    QMutexLocker compactLocker(&m_compactMutex);
+    qint64 syncs = UserCheckpoint::syncCount();
+    bool compacted = compactFile();
+    if (m_stats.isEnabled())
+    {
+        m_stats.add(UserStats::Syncs, UserCheckpoint::syncCount() - syncs);
+    }
+    return compacted;
+}
+
+bool UserDao::compactFile()
+{
+
+    QVector<UserIndex::Item> live;
+    qint64 snapshotSize = 0;
+    {
+        QWriteLocker locker(&m_lock);
+        if (!ensureIndex())
+        {
+            return false;
+        }
+        live = m_index.liveItems();
+        snapshotSize = m_index.coveredSize();
+    }
+
+    QFile out(m_compactFileName);
+    if (!out.open(QFile::WriteOnly | QFile::Truncate)) {
+        qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+        return false;
+    }
+    out.write(UserFormat::fileHeader());
+
+    // 快照范围内的记录不会再被修改，不持锁复制，期间读写都可以继续进行
+    QVector<UserIndex::Item> items;
+    if (!copyRecords(&out, 0, snapshotSize, &live, &items))
+    {
+        out.close();
+        QFile::remove(m_compactFileName);
+        return false;
+    }
+
+    // 只有复制快照之后新写入的记录和替换文件时阻塞读写
+    QWriteLocker locker(&m_lock);
+    if (!copyRecords(&out, snapshotSize, std::numeric_limits<qint64>::max(), nullptr, &items)
+            || !UserCheckpoint::syncFile(out))
+    {
+        out.close();
+        QFile::remove(m_compactFileName);
+        return false;
+    }
+    out.close();
+
+    // 新文件已经落盘；先删检查点，中途中断时下次启动会按没有检查点的方式恢复
+    QMutexLocker snapshotLocker(&m_snapshotMutex);
+    releaseSnapshotMap();
+    m_map.close();
+    dropNameIndex();
+    QFile::remove(m_checkpointFileName);
+    if (!replaceFiles(m_compactFileName, QString()))
+    {
+        // 旧文件已经换回，内存中的索引仍然与它对应，补写检查点后继续使用
+        QFile::remove(m_compactFileName);
+        m_index.checkpoint(m_indexFileName, m_fileName, m_checkpointFileName);
+        if (m_readMode == MappedRead)
+        {
+            openMap();
+        }
+        return false;
+    }
+    m_fileVersion = UserFormat::CurrentVersion;
+
+    if (!m_index.reset(m_indexFileName, items)
+            || !m_index.checkpoint(m_indexFileName, m_fileName, m_checkpointFileName))
+    {
+        // 新的数据文件已经完整落盘，删掉写了一半的索引，从数据文件重建；
+        // 重建失败时索引处于未加载状态，下次访问时再重建，不会在不完整的索引文件上继续追加
+        QFile::remove(m_indexFileName);
+        QFile::remove(m_checkpointFileName);
+        removeBackup();
+        m_index.load(m_indexFileName, m_fileName, m_checkpointFileName);
+        publishSnapshot();
+        return false;
+    }
+    removeBackup();
+    publishSnapshot();
+    return true;
+}
+
+bool UserDao::installFiles(const QString &dataFileName, const QString &indexFileName)
+{
+    // 队列中还没写入的记录要先写进旧文件，否则会在替换之后追加到新文件上
+    if (!flush())
+    {
+        return false;
+    }
+
+    QMutexLocker compactLocker(&m_compactMutex);
+    QWriteLocker locker(&m_lock);
+    QMutexLocker snapshotLocker(&m_snapshotMutex);
+    releaseSnapshotMap();
+    m_map.close();
+    if (m_cache)
+    {
+        m_cache->clear();
+    }
+    dropNameIndex();
+
+    QFile::remove(m_checkpointFileName);
+    if (!replaceFiles(dataFileName, indexFileName))
+    {
+        m_index.load(m_indexFileName, m_fileName, m_checkpointFileName);
+        publishSnapshot();
+        return false;
+    }
+    m_fileVersion = UserFormat::CurrentVersion;
+
+    // 两个文件都已经落盘，直接写检查点，加载时不用再校验数据文件
+    UserCheckpoint checkpoint;
+    checkpoint.dataSize = QFileInfo(m_fileName).size();
+    checkpoint.indexSize = QFileInfo(m_indexFileName).exists() ? QFileInfo(m_indexFileName).size() : 0;
+    bool written = !QFile::exists(m_indexFileName) || checkpoint.write(m_checkpointFileName);
+    // 内存中的索引还对应旧文件，无论如何都要重新加载，快照才不会按旧文件的长度读新文件
+    if (!m_index.load(m_indexFileName, m_fileName, m_checkpointFileName) || !written)
+    {
+        publishSnapshot();
+        return false;
+    }
+    removeBackup();
+    publishSnapshot();
+    return true;
+}
+
+bool UserDao::replaceFiles(const QString &dataFileName, const QString &indexFileName)
+{
+    // 旧文件先改名留作备份（*.old），新文件就位、索引和检查点写好之后才由 removeBackup() 删除；
+    // 中途中断时下次加载按备份恢复（见 restoreBackup()）
+    QString oldFileName = m_fileName + ".old";
+    QString oldIndexFileName = m_indexFileName + ".old";
+    QFile::remove(oldFileName);
+    QFile::remove(oldIndexFileName);
+    bool replaced = (!QFile::exists(m_fileName) || QFile::rename(m_fileName, oldFileName))
+            && (!QFile::exists(m_indexFileName) || QFile::rename(m_indexFileName, oldIndexFileName))
+            // 没有记录时不会生成索引文件，加载时按空的数据文件重建
+            && (indexFileName.isEmpty() || !QFile::exists(indexFileName)
+                || QFile::rename(indexFileName, m_indexFileName))
+            && QFile::rename(dataFileName, m_fileName);
+    if (!replaced)
+    {
+        qDebug() << QString::fromLocal8Bit("\n替换数据文件失败");
+        restoreBackup();
+    }
+    return replaced;
+}
+
+void UserDao::restoreBackup()
+{
+    QString oldFileName = m_fileName + ".old";
+    QString oldIndexFileName = m_indexFileName + ".old";
+    if (!QFile::exists(m_fileName) && QFile::exists(oldFileName))
+    {
+        // 新的数据文件还没就位：换回旧的数据文件和索引文件。此时的索引文件可能已经是新的，
+        // 没有旧的索引文件时删掉它，加载时从数据文件重建
+        QFile::rename(oldFileName, m_fileName);
+        QFile::remove(m_indexFileName);
+        QFile::rename(oldIndexFileName, m_indexFileName);
+        QFile::remove(m_checkpointFileName);
+    }
+    // 否则新的数据文件已经就位，备份不再需要；旧的索引与它不对应，此时的索引文件不完整时加载会重建
+    removeBackup();
+}
+
+void UserDao::removeBackup()
+{
+    QFile::remove(m_fileName + ".old");
+    QFile::remove(m_indexFileName + ".old");
+}
+
+bool UserDao::checkpoint()
+{
+    QWriteLocker locker(&m_lock);
+    if (!m_index.isLoaded())
+    {
+        return true;
+    }
+    qint64 syncs = UserCheckpoint::syncCount();
+    bool ok = (m_index.checkpointedSize() == m_index.coveredSize()
+               || m_index.checkpoint(m_indexFileName, m_fileName, m_checkpointFileName))
+            && syncNameIndex();
+    if (m_stats.isEnabled())
+    {
+        m_stats.add(UserStats::Syncs, UserCheckpoint::syncCount() - syncs);
+    }
+    return ok;
+}
+
+void UserDao::waitForCompaction()
+{
+    QFuture<bool> compaction;
+    {
+        QReadLocker locker(&m_lock);
+        compaction = m_compaction;
+    }
+    compaction.waitForFinished();
+}
+
+bool UserDao::loadIndex()
+{
+    {
+        QReadLocker locker(&m_lock);
+        if (m_index.isLoaded())
+        {
+            return true;
+        }
+    }
+
+    QWriteLocker locker(&m_lock);
+    return ensureIndex();
+}
+
+bool UserDao::ensureIndex()
+{
+    if (m_index.isLoaded())
+    {
+        return true;
+    }
+
+    if (!QFile::exists(m_fileName) && QFile::exists(m_compactFileName))
+    {
+        // 上次压缩在替换文件的过程中被中断
+        QFile::rename(m_compactFileName, m_fileName);
+    }
+    if (QFile::exists(m_fileName + ".old") || QFile::exists(m_indexFileName + ".old"))
+    {
+        // 上次压缩或 installFiles() 在替换文件的过程中被中断
+        restoreBackup();
+    }
+    if (!m_index.load(m_indexFileName, m_fileName, m_checkpointFileName))
+    {
+        return false;
+    }
+
+    // 加载时校验过的尾部记到检查点里，下次启动不用再校验
+    if (m_index.checkpointedSize() < m_index.coveredSize())
+    {
+        m_index.checkpoint(m_indexFileName, m_fileName, m_checkpointFileName);
+    }
+    publishSnapshot();
+    return true;
+}
+
+bool UserDao::ensureNameIndex()
+{
+    if (m_nameIndex.isOpen())
+    {
+        return true;
+    }
+    if (!ensureIndex())
+    {
+        return false;
+    }
+
+    // 索引记录的长度超过数据文件时（数据文件被截断或替换过）不能补扫，只能重建
+    qint64 from = 0;
+    if (!m_nameIndex.open(m_nameIndexFileName, &from) || from > m_index.coveredSize())
+    {
+        if (!m_nameIndex.create(m_nameIndexFileName, m_index.count()))
+        {
+            return false;
+        }
+        from = 0;
+    }
+
+    QFile file(m_fileName);
+    if (from < m_index.coveredSize() && file.exists())
+    {
+        if (!file.open(QFile::ReadOnly)) {
+            qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+            dropNameIndex();
+            return false;
+        }
+
+        UserFileReader reader(&file);
+        bool inserted = reader.seek(from);
+        if (inserted)
+        {
+            visitLive(reader, 0, std::numeric_limits<quint32>::max(), [this, &inserted](const User &user) {
+                inserted = m_nameIndex.insert(user.userName(), user.id());
+                return inserted;
+            });
+        }
+        file.close();
+        if (!inserted)
+        {
+            dropNameIndex();
+            return false;
+        }
+    }
+    return m_nameIndex.sync(m_index.coveredSize());
+}
+
+bool UserDao::syncNameIndex()
+{
+    if (!m_nameIndex.isOpen() || m_nameIndex.syncedSize() == m_index.coveredSize())
+    {
+        return true;
+    }
+    return m_nameIndex.sync(m_index.coveredSize());
+}
+
+void UserDao::dropNameIndex()
+{
+    m_nameIndex.close();
+    QFile::remove(m_nameIndexFileName);
+}
+
+bool UserDao::prepareWrite()
+{
+    {
+        QWriteLocker locker(&m_lock);
+        if (!ensureIndex())
+        {
+            return false;
+        }
+
+        if (m_fileVersion != UserFormat::CurrentVersion)
+        {
+            m_fileVersion = UserFormat::version(m_fileName);
+        }
+
+        if (m_fileVersion == UserFormat::EmptyFile)
+        {
+            QFile file(m_fileName);
+            if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+                qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+                return false;
+            }
+            file.write(UserFormat::fileHeader());
+            file.close();
+            m_fileVersion = UserFormat::CurrentVersion;
+        }
+
+        if (m_fileVersion > UserFormat::LegacyVersion && m_fileVersion < UserFormat::CurrentVersion)
+        {
+            // 之前版本的记录在当前版本中仍然有效，只需要更新文件头中的版本号
+            QFile file(m_fileName);
+            if (!file.open(QFile::ReadWrite)) {
+                qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+                return false;
+            }
+            file.write(UserFormat::fileHeader());
+            file.close();
+            m_fileVersion = UserFormat::CurrentVersion;
+        }
+
+        if (m_fileVersion == UserFormat::CurrentVersion)
+        {
+            return true;
+        }
+        if (m_fileVersion > UserFormat::CurrentVersion)
+        {
+            qDebug() << QString::fromLocal8Bit("\n不支持的文件版本") << m_fileVersion;
+            return false;
+        }
+    }
+
+    // 旧格式的文件没有记录头，不能直接追加新格式的记录，先整体改写成当前格式
+    return compact();
+}
+
+bool UserDao::insertUsers(const QVector<User> &users, bool sync)
+{
+    UserStats::Scope scope(&m_stats, UserStats::Insert);
+    if (!prepareWrite())
+    {
+        return false;
+    }
+
+    UserRecordBuilder builder(builderBlockSize(), m_codec);
+    foreach (const User &user, users)
+    {
+        builder.put(user);
+    }
+    builder.finish();
+
+    QWriteLocker locker(&m_lock);
+    invalidate(users);
+    return appendRecords(builder, sync, &users);
+}
+
+bool UserDao::appendRecords(const UserRecordBuilder &builder, bool sync, const QVector<User> *users)
+{
+    if (builder.isEmpty())
+    {
+        return true;
+    }
+
+    bool measured = m_stats.isEnabled();
+    qint64 syncs = UserCheckpoint::syncCount();
+    QElapsedTimer timer;
+    if (measured)
+    {
+        timer.start();
+    }
+
+    QFile  file(m_fileName);
     if  (!file.open(QFile::Append)) {
         qDebug() << QString::fromLocal8Bit("\n文件打开失败");
         return false;
     }
 
-    QDataStream stream(&file);
-    stream << user;
+    qint64 base = file.size();
+    bool written = file.write(builder.data()) == builder.data().size();
+    if (written && sync)
+    {
+        written = UserCheckpoint::syncFile(file);
+    }
     file.close();
+    if (!written)
+    {
+        qDebug() << QString::fromLocal8Bit("\n文件写入失败");
+        return false;
+    }
+    if (measured)
+    {
+        m_stats.add(UserStats::IoNanos, timer.nsecsElapsed());
+        m_stats.add(UserStats::BytesWritten, builder.data().size());
+        m_stats.add(UserStats::DeviceWrites, 1);
+        m_stats.add(UserStats::RecordsWritten, builder.count());
+    }
+
+    if (!m_index.append(m_indexFileName, builder.items(base)))
+    {
+        return false;
+    }
+
+    // 名字索引没有加载时不更新，下次加载时从它记录的长度开始补扫
+    if (users && m_nameIndex.isOpen())
+    {
+        foreach (const User &user, *users)
+        {
+            if (!m_nameIndex.insert(user.userName(), user.id()))
+            {
+                dropNameIndex();
+                break;
+            }
+        }
+    }
+
+    publishSnapshot();
+
+    if (m_index.coveredSize() - m_index.checkpointedSize() >= CHECKPOINT_INTERVAL)
+    {
+        m_index.checkpoint(m_indexFileName, m_fileName, m_checkpointFileName);
+        syncNameIndex();
+    }
+    if (measured)
+    {
+        m_stats.add(UserStats::Syncs, UserCheckpoint::syncCount() - syncs);
+    }
+
+    scheduleCompaction();
     return true;
 }
 
-bool UserDao::insert(const QVector<User> &users)
+void UserDao::publishSnapshot()
 {
-    QFile  file(fileName);
-    if  (!file.open(QFile::Append)) {
+    // 只有持有写锁的写入者发布，不会有两次发布交错
+    m_epoch.fetchAndAddOrdered(1);
+    m_committedSize.storeRelease(m_index.isLoaded() ? m_index.coveredSize() : -1);
+    m_epoch.fetchAndAddOrdered(1);
+}
+
+void UserDao::readCommitted(qint64 *size, quint64 *epoch) const
+{
+    for (;;)
+    {
+        quint64 begin = m_epoch.loadAcquire();
+        if (begin & 1)
+        {
+            // 正在发布，只有几条指令
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        *size = m_committedSize.loadAcquire();
+        if (m_epoch.loadAcquire() == begin)
+        {
+            *epoch = begin / 2;
+            return;
+        }
+    }
+}
+
+void UserDao::releaseSnapshotMap()
+{
+    // 已经取得的快照各自持有原来的映射，最后一个释放时取消映射
+    m_snapshotMap.clear();
+}
+
+void UserDao::scheduleCompaction()
+{
+    if (m_compactionRatio <= 0
+            || m_index.coveredSize() < COMPACTION_MIN_SIZE
+            || m_index.garbageRatio() < m_compactionRatio
+            || m_compaction.isRunning())
+    {
+        return;
+    }
+
+    m_compaction = QtConcurrent::run(this, &UserDao::compact);
+}
+
+bool UserDao::copyRecords(QFile *out, qint64 from, qint64 to,
+                          const QVector<UserIndex::Item> *live, QVector<UserIndex::Item> *items)
+{
+    QFile in(m_fileName);
+    if (!in.exists())
+    {
+        return true;
+    }
+    if (!in.open(QFile::ReadOnly)) {
         qDebug() << QString::fromLocal8Bit("\n文件打开失败");
         return false;
     }
 
-    QDataStream stream(&file);
-    foreach (auto user, users)
+    UserFileReader reader(&in);
+    reader.seek(from);
+
+    // live 按 (offset, slot) 排序，记录也是按偏移顺序读出的，用一个游标顺序比对即可
+    int cursor = 0;
+    auto isLive = [live, &cursor](qint64 offset, quint32 slot) -> bool {
+        if (!live)
+        {
+            return true;
+        }
+        while (cursor < live->size()
+               && (live->at(cursor).offset < offset
+                   || (live->at(cursor).offset == offset && live->at(cursor).slot < slot)))
+        {
+            ++cursor;
+        }
+        return cursor < live->size() && live->at(cursor).offset == offset && live->at(cursor).slot == slot;
+    };
+
+    UserRecordBuilder builder(builderBlockSize(), m_codec);
+    bool ok = true;
+    auto flushBuilder = [&]() {
+        builder.finish();
+        *items += builder.items(out->pos());
+        ok = out->write(builder.data()) == builder.data().size();
+        builder.clear();
+    };
+
+    // 复制快照时 live 中每个 id 只有一条记录，可以打乱顺序：每攒够一批按 id 排序后写入，
+    // 新文件由若干个有序段组成，稀疏索引中各段的 id 范围很窄，范围查询只读少数几段。
+    // 快照之后的记录可能包含对同一个 id 的多次写入和删除，保持原来的顺序
+    QVector<User> run;
+    auto flushRun = [&]() {
+        std::sort(run.begin(), run.end(), [](const User &a, const User &b) {
+            return a.id() < b.id();
+        });
+        foreach (const User &user, run)
+        {
+            builder.put(user);
+            if (ok && builder.data().size() >= COMPACTION_BATCH_SIZE)
+            {
+                flushBuilder();
+            }
+        }
+        run.clear();
+    };
+    auto put = [&](const User &user) {
+        if (!live)
+        {
+            builder.put(user);
+            return;
+        }
+        run.append(user);
+        if (run.size() >= COMPACTION_RUN_SIZE)
+        {
+            flushRun();
+        }
+    };
+
+    UserRecord record;
+    while (ok && reader.pos() < to && reader.next(&record))
+    {
+        if (record.kind == UserFormat::BlockRecord)
+        {
+            UserBlock block(record.payload, record.length, record.flags);
+            for (int slot = 0; slot < block.count(); ++slot)
+            {
+                if (isLive(record.offset, quint32(slot)))
+                {
+                    put(block.user(slot));
+                }
+            }
+        }
+        else if (isLive(record.offset, 0))
+        {
+            if (record.kind == UserFormat::PutRecord)
+            {
+                put(record.user);
+            }
+            else
+            {
+                builder.remove(record.id);
+            }
+        }
+
+        if (ok && builder.data().size() >= COMPACTION_BATCH_SIZE)
+        {
+            flushBuilder();
+        }
+    }
+    in.close();
+
+    if (ok)
     {
-        stream << user;
+        flushRun();
     }
-    file.close();
+    builder.finish();
+    if (ok && !builder.isEmpty())
+    {
+        *items += builder.items(out->pos());
+        ok = out->write(builder.data()) == builder.data().size();
+    }
+    if (!ok)
+    {
+        qDebug() << QString::fromLocal8Bit("\n文件写入失败");
+    }
+    return ok;
+}
+
+int UserDao::builderBlockSize() const
+{
+    return m_writeFormat == BlockFormat ? m_blockSize : 0;
+}
+
+/**
+ * @brief 把按索引读到的记录解析成 id 对应的 User，数据块中只解码命中的那一个。
+ */
+static bool resolveRecord(quint32 id, const UserIndex::Entry &entry, UserRecord *record)
+{
+    if (record->kind == UserFormat::BlockRecord)
+    {
+        UserBlock block(record->payload, record->length, record->flags);
+        int slot = int(entry.slot);
+        if (slot >= block.count() || block.id(slot) != id)
+        {
+            slot = block.find(id);
+        }
+        if (slot < 0)
+        {
+            return false;
+        }
+        record->id = id;
+        record->user = block.user(slot);
+        return true;
+    }
+    return record->kind == UserFormat::PutRecord && record->id == id;
+}
+
+bool UserDao::openMap()
+{
+    // 文件长度只在持有写锁时变化，所以同一段读锁期间第一个读者重新映射之后，其它读者不会再触发重新映射
+    QMutexLocker locker(&m_mapMutex);
+    return m_map.open(m_fileName);
+}
+
+bool UserDao::lookup(quint32 id, User *user)
+{
+    if (m_cache && m_cache->find(id, user))
+    {
+        return true;
+    }
+
+    UserRecord record;
+    if (!readRecord(id, &record))
+    {
+        return false;
+    }
+    // 写入时持有写锁，这里持有读锁，放入缓存的一定是最新的记录
+    if (m_cache)
+    {
+        m_cache->insert(record.user);
+    }
+    *user = record.user;
     return true;
 }
 
-User UserDao::select(quint32 id)
+void UserDao::invalidate(const QVector<User> &users)
 {
-    User user;
-    QFile  file(fileName);
+    if (!m_cache)
+    {
+        return;
+    }
+    foreach (const User &user, users)
+    {
+        m_cache->remove(user.id());
+    }
+}
+
+bool UserDao::readRecord(quint32 id, UserRecord *record)
+{
+    UserIndex::Entry entry;
+    if (!m_index.find(id, &entry))
+    {
+        return false;
+    }
+
+    bool measured = m_stats.isEnabled();
+    QElapsedTimer timer;
+    if (m_readMode == MappedRead)
+    {
+        if (!openMap())
+        {
+            return false;
+        }
+        if (measured)
+        {
+            timer.start();
+        }
+        UserFileReader reader(m_map.data(), m_map.size());
+        bool found = reader.seek(entry.offset) && reader.next(record) && resolveRecord(id, entry, record);
+        if (measured && found)
+        {
+            addReadStats(reader, 1, timer.nsecsElapsed());
+        }
+        return found;
+    }
+
+    QFile  file(m_fileName);
     if  (!file.open(QFile::ReadOnly)) {
         qDebug() << QString::fromLocal8Bit("\n文件打开失败");
-        return user;
+        return false;
+    }
+
+    if (measured)
+    {
+        timer.start();
+    }
+    UserFileReader reader(&file);
+    reader.setTimeIo(measured);
+    bool found = reader.seek(entry.offset) && reader.next(record) && resolveRecord(id, entry, record);
+    if (measured && found)
+    {
+        addReadStats(reader, 1, timer.nsecsElapsed());
+    }
+    file.close();
+    return found;
+}
+
+void UserDao::addReadStats(const UserFileReader &reader, qint64 records, qint64 nanos)
+{
+    m_stats.add(UserStats::BytesRead, reader.bytesRead());
+    m_stats.add(UserStats::DeviceReads, reader.deviceReads());
+    m_stats.add(UserStats::RecordsDecoded, records);
+    m_stats.add(UserStats::IoNanos, reader.ioNanos());
+    m_stats.add(UserStats::DecodeNanos, qMax(qint64(0), nanos - reader.ioNanos()));
+}
+
+QVector<User> UserDao::scan(quint32 lo, quint32 hi)
+{
+    bool all = lo == 0 && hi == std::numeric_limits<quint32>::max();
+    UserStats::Scope scope(&m_stats, all ? UserStats::SelectAll : UserStats::SelectRange);
+    QVector<User> users;
+    if (!loadIndex())
+    {
+        return users;
+    }
+
+    QReadLocker locker(&m_lock);
+    if (m_parallelism > 1)
+    {
+        // 范围查询只涉及少数几段时直接读这几段，不值得并行扫描整个文件
+        qint64 bytes = all ? m_index.coveredSize() : 0;
+        if (!all)
+        {
+            foreach (const UserIndex::Zone &zone, m_index.zones(lo, hi))
+            {
+                bytes += zone.end - zone.offset;
+            }
+        }
+        if (bytes >= DECODE_MIN_CHUNK_SIZE * 2)
+        {
+            return parallelScan(lo, hi);
+        }
     }
 
-    QDataStream stream(&file);
+    if (all)
+    {
+        users.reserve(m_index.count());
+    }
+    visit(lo, hi, [&users](const User &user) {
+        users.append(user);
+        return true;
+    });
+    return users;
+}
 
-    bool flag = false;
+bool UserDao::visit(quint32 lo, quint32 hi, const Visitor &visitor)
+{
+    // 统计开启时才包一层计数，关闭时不增加每条记录的开销
+    bool measured = m_stats.isEnabled();
+    qint64 decoded = 0;
+    Visitor counted = visitor;
+    QElapsedTimer timer;
+    if (measured)
+    {
+        counted = [&decoded, &visitor](const User &user) {
+            ++decoded;
+            return visitor(user);
+        };
+    }
 
-    while (!stream.atEnd())
+    if (m_readMode == MappedRead)
     {
-        stream >> user;
-        if (id == user.id())
+        if (!openMap())
+        {
+            return !QFile::exists(m_fileName);
+        }
+        if (measured)
         {
-            flag = true;
-            break;
+            timer.start();
         }
+        UserFileReader reader(m_map.data(), m_map.size());
+        visitZones(reader, lo, hi, counted);
+        if (measured)
+        {
+            addReadStats(reader, decoded, timer.nsecsElapsed());
+        }
+        return true;
+    }
+
+    QFile  file(m_fileName);
+    if (!file.exists())
+    {
+        return true;
+    }
+    if  (!file.open(QFile::ReadOnly)) {
+        qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+        return false;
+    }
+
+    // 从设备读取时记录内容读进 reader 内部的缓冲区，每条记录复用同一块内存
+    if (measured)
+    {
+        timer.start();
+    }
+    UserFileReader reader(&file);
+    reader.setTimeIo(measured);
+    visitZones(reader, lo, hi, counted);
+    if (measured)
+    {
+        addReadStats(reader, decoded, timer.nsecsElapsed());
     }
     file.close();
+    return true;
+}
 
-    if (flag)
+bool UserDao::visitZones(UserFileReader &reader, quint32 lo, quint32 hi, const Visitor &visitor) const
+{
+    if (reader.version() == UserFormat::LegacyVersion
+            || (lo == 0 && hi == std::numeric_limits<quint32>::max()))
     {
-        return user;
+        return visitLive(reader, lo, hi, visitor);
     }
-    else
+
+    foreach (const UserIndex::Zone &zone, m_index.zones(lo, hi))
     {
-        return User();
+        if (!reader.seek(zone.offset) || !visitLive(reader, lo, hi, visitor, zone.end))
+        {
+            return false;
+        }
     }
+    return true;
 }
 
-QVector<User> UserDao::selectAll()
+QVector<User> UserDao::parallelScan(quint32 lo, quint32 hi)
 {
     QVector<User> users;
-    QFile  file(fileName);
-    if  (!file.open(QFile::ReadOnly)) {
-        qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+    if (!openMap())
+    {
         return users;
     }
 
-    QDataStream stream(&file);
+    bool measured = m_stats.isEnabled();
+    QElapsedTimer timer;
+    if (measured)
+    {
+        timer.start();
+    }
 
-    stream.resetStatus();
-    while (!stream.atEnd())
+    const uchar *data = m_map.data();
+    qint64 size = m_map.size();
+    UserFileReader splitter(data, size);
+    if (splitter.version() == UserFormat::LegacyVersion)
     {
-        User user;
-        stream >> user;
-        users.append(user);
+        // 旧格式没有记录头，无法在不解码的情况下找到记录边界
+        visitLive(splitter, lo, hi, [&users](const User &user) {
+            users.append(user);
+            return true;
+        });
+        if (measured)
+        {
+            addReadStats(splitter, users.size(), timer.nsecsElapsed());
+        }
+        return users;
+    }
+
+    // 只读记录头跳过内容，按长度把文件切成若干段，每段的边界都是记录的起始位置
+    qint64 chunkSize = qMax(DECODE_MIN_CHUNK_SIZE, size / (m_parallelism * DECODE_CHUNKS_PER_THREAD));
+    QVector<QPair<qint64, qint64> > chunks;
+    qint64 begin = splitter.pos();
+    while (splitter.skip())
+    {
+        if (splitter.pos() - begin >= chunkSize)
+        {
+            chunks.append(qMakePair(begin, splitter.pos()));
+            begin = splitter.pos();
+        }
+    }
+    if (splitter.pos() > begin)
+    {
+        chunks.append(qMakePair(begin, splitter.pos()));
+    }
+
+    QVector<QFuture<QVector<User> > > futures;
+    futures.reserve(chunks.size());
+    for (int i = 0; i < chunks.size(); ++i)
+    {
+        qint64 chunkBegin = chunks.at(i).first;
+        qint64 chunkEnd = chunks.at(i).second;
+        futures.append(QtConcurrent::run(&m_decodePool, [this, data, chunkBegin, chunkEnd, lo, hi]() {
+            // 把可见长度限制在段尾，记录的偏移仍然是相对文件开头的，可以直接和索引比较
+            QVector<User> part;
+            UserFileReader reader(data, chunkEnd);
+            reader.seek(chunkBegin);
+            visitLive(reader, lo, hi, [&part](const User &user) {
+                part.append(user);
+                return true;
+            });
+            return part;
+        }));
+    }
+
+    QVector<QVector<User> > parts;
+    parts.reserve(futures.size());
+    int total = 0;
+    for (int i = 0; i < futures.size(); ++i)
+    {
+        parts.append(futures[i].result());
+        total += parts.last().size();
+    }
+
+    users.reserve(total);
+    foreach (const QVector<User> &part, parts)
+    {
+        users += part;
     }
-    file.close();
 
+    if (measured)
+    {
+        // 映射读取没有设备读取，各线程的解码耗时按墙钟时间计
+        m_stats.add(UserStats::BytesRead, splitter.pos() - UserFormat::headerSize(splitter.version()));
+        m_stats.add(UserStats::RecordsDecoded, users.size());
+        m_stats.add(UserStats::DecodeNanos, timer.nsecsElapsed());
+    }
     return users;
 }
 
+bool UserDao::visitLive(UserFileReader &reader, quint32 lo, quint32 hi, const Visitor &visitor, qint64 end) const
+{
+    bool all = lo == 0 && hi == std::numeric_limits<quint32>::max();
+    UserRecord record;
+    UserIndex::Entry entry;
+    while (reader.pos() < end && reader.next(&record, false))
+    {
+        if (record.kind == UserFormat::BlockRecord)
+        {
+            // 先在 id 列上筛选，字符串只解码范围内并且仍然有效的记录
+            UserBlock block(record.payload, record.length, record.flags);
+            QVector<int> slots;
+            if (!all)
+            {
+                slots = block.filterRange(lo, hi);
+            }
+
+            int count = all ? block.count() : slots.size();
+            for (int i = 0; i < count; ++i)
+            {
+                int slot = all ? i : slots.at(i);
+                if (m_index.find(block.id(slot), &entry)
+                        && entry.offset == record.offset
+                        && entry.slot == quint32(slot))
+                {
+                    block.decodeUser(slot, &record.user);
+                    if (!visitor(record.user))
+                    {
+                        return false;
+                    }
+                }
+            }
+            continue;
+        }
 
+        // 只保留每个 id 最后写入的那条记录
+        if (record.kind == UserFormat::PutRecord
+                && record.id >= lo && record.id <= hi
+                && m_index.find(record.id, &entry)
+                && entry.offset == record.offset
+                && UserFileReader::decodeUser(&record))
+        {
+            if (!visitor(record.user))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
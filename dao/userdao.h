@@ -2,22 +2,473 @@
 #define USERDAO_H
 
 #include <QObject>
+#include <QFuture>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QAtomicInteger>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <functional>
+#include <limits>
 #include "data/user.h"
+#include "data/userbatch.h"
+#include "userindex.h"
+#include "usernameindex.h"
+#include "usercache.h"
+#include "userstats.h"
+#include "mappedfile.h"
+#include "userformat.h"
+#include "userstore.h"
 
-class UserDao
+class QFile;
+class UserFileReader;
+class UserRecordBuilder;
+class UserWriter;
+class UserSnapshot;
+
+/**
+ * @brief user.dat 的读写。
+ *
+ * 文件只追加不修改：插入和更新都追加一条新记录，删除追加一条墓碑记录，
+ * 查询时同一个 id 以最后写入的记录为准。
+ * 失效记录的比例超过 compactionRatio() 时，在后台线程把有效记录改写到新文件中再替换原文件，
+ * 改写期间读写可以正常进行，只有最后替换文件时会短暂阻塞。
+ *
+ * 每条记录带有 CRC。每写入一段数据（以及析构、压缩之后）会把数据和索引刷到磁盘并写一个检查点（user.ckpt），
+ * 启动时只校验检查点之后写入的记录，写入中断留下的不完整记录会被自动截掉。
+ *
+ * 读写之间用读写锁同步，写入期间普通查询会等待；需要在持续写入的同时大量扫描时使用 snapshot()，
+ * 每次写入提交后发布新的快照，读者在快照上查询不加锁，也不会被写入阻塞。
+ *
+ * 按 userName 查询使用单独的名字索引（user.nidx，见 UserNameIndex），第一次调用 selectByName() 时加载，
+ * 之后随写入更新；压缩或重建 id 索引后删除，下次查询时从数据文件重建。
+ */
+class UserDao : public UserStore
 {
 public:
+    /**
+     * @brief 读取 user.dat 的方式
+     */
+    enum ReadMode {
+        StreamRead, ///< QFile + QDataStream 逐字段读取
+        MappedRead  ///< 把文件映射到内存，直接从映射的字节解码（映射在多次调用之间复用）
+    };
+
+    /**
+     * @brief 新写入记录的存放方式
+     */
+    enum WriteFormat {
+        RowFormat,  ///< 每个 User 一条记录
+        BlockFormat ///< 每 blockSize 个 User 按列存放成一个数据块，按 id 查找只比较 id 列
+    };
+
+    /**
+     * @brief 后台批量写入时每一批写完后的落盘方式
+     */
+    enum Durability {
+        NoSync,      ///< 只写入操作系统缓存
+        SyncPerBatch ///< 每一批写完后 fsync
+    };
+
+    /**
+     * @param fileName 数据文件名，索引文件与它放在同一目录，扩展名为 .idx
+     */
+    explicit UserDao(const QString &fileName = "user.dat");
+    ~UserDao();
+
+    QString fileName() const;
+    QString indexFileName() const;
+    QString checkpointFileName() const;
+    QString nameIndexFileName() const;
+
+    ReadMode readMode() const;
+    void setReadMode(ReadMode mode);
+
+    WriteFormat writeFormat() const;
+    int blockSize() const;
+    void setWriteFormat(WriteFormat format, int blockSize = 1024);
+
+    /**
+     * @brief 新写入的数据块使用的压缩算法（BlockCodec 的 id），默认 BlockCodec::NoCodec。
+     *
+     * 只对 BlockFormat 写入的数据块有效，每个块单独压缩，按 id 查询时只解压命中的块。
+     * 已有的块保持原样，压缩时会按当前设置改写。
+     */
+    int compression() const;
+    void setCompression(int codec);
+
+    /**
+     * @brief 设置按 id 查询的缓存（见 UserCache）的容量，按字节计算，0 表示不使用缓存（默认）。
+     *
+     * select() 和 selectByName() 先查缓存，未命中时读取数据文件后放入缓存；
+     * 插入、更新、删除时在持有写锁的情况下删除对应的条目，因此缓存中不会有过期的记录。
+     * 重新设置时丢弃已经缓存的记录和计数。
+     * @param bytes 容量
+     * @param shards 分片数
+     */
+    void setCacheCapacity(qint64 bytes, int shards = 16);
+    qint64 cacheCapacity() const;
+
+    /**
+     * @brief 缓存的命中、未命中、淘汰等计数，没有使用缓存时全部为 0
+     */
+    UserCache::Stats cacheStats() const;
+    void resetCacheStats();
+
+    /**
+     * @brief 按 id 查询。不存在的 id 只查内存中的索引，不读数据文件。
+     * @param user[out] 查到的记录
+     * @return 记录不存在（或者已经删除）时返回 false，user 不变
+     */
+    bool select(quint32 id, User *user) override;
+
+    /**
+     * @brief 同上，记录不存在时返回 User()，无法与 id 为 0 的记录区分，需要区分时使用上一个重载。
+     */
     User select(quint32 id);
-    QVector<User> selectAll();
+    QVector<User> selectAll() override;
+
+    /**
+     * @brief id 是否存在（只查内存中的索引）
+     */
+    bool contains(quint32 id) override;
+
+    /**
+     * @brief 查询 id 在 [lo, hi] 范围内的所有记录，按记录在文件中的顺序返回。
+     *        只读取稀疏索引中 id 范围与之有交集的段（见 UserIndex::zones()）。
+     */
+    QVector<User> selectRange(quint32 lo, quint32 hi) override;
+
+    /**
+     * @brief 同 selectAll/selectRange，结果放进 batch（先清空）：字符串连续存放在批次的存储中，
+     *        不为每条记录单独分配内存。在调用线程中顺序解码，不受 parallelism() 影响。
+     * @return 文件打开失败等错误返回 false
+     */
+    bool selectAll(UserBatch *batch);
+    bool selectRange(quint32 lo, quint32 hi, UserBatch *batch);
+
+    /**
+     * @brief 查询 userName 等于给定名字的所有有效记录（名字相同的不同 id 都会返回）。
+     *        通过名字索引找到候选 id 后按 id 读取记录核对名字，期望的代价与数据量无关。
+     */
+    QVector<User> selectByName(const QString &userName) override;
+
+    /**
+     * @brief 最近一次写入提交之后的只读快照（见 UserSnapshot），不会包含写了一半的记录。
+     *
+     * 每次写入提交（持有写锁、索引已经更新之后）只用两个原子变量发布已经提交的长度和序号，
+     * 写入的代价与文件大小无关。snapshot() 读出这两个值，各个快照共用一个数据文件的映射，
+     * 映射的长度不够（上次映射之后有新的提交）时才重新映射。
+     * 取得快照时加一个互斥锁（m_snapshotMutex），普通的写入提交不会持有它，因此不会被写入阻塞；
+     * 压缩、installFiles() 和 rebuildIndex() 替换文件期间持有它，这时取得快照会等待。
+     * 在快照上查询不加锁。Windows 上有快照没有释放时替换文件会失败，原文件保持不变。
+     * @return 数据文件打开或映射失败时返回空指针
+     */
+    QSharedPointer<UserSnapshot> snapshot();
 
+    /**
+     * @brief 访问一条记录，返回 false 时停止扫描
+     */
+    typedef std::function<bool(const User &)> Visitor;
+
+    /**
+     * @brief 按记录在文件中的顺序逐条访问所有有效记录，不把记录一次全部读进内存。
+     *
+     * 每条记录都解码到同一个 User 中，visitor 没有保留它的拷贝时字符串的存储也会被复用，
+     * 内存占用与文件大小无关。扫描期间持有读锁，visitor 中不能写入同一个 UserDao。
+     * 总是在调用线程中顺序解码，不受 parallelism() 影响。
+     * @return 文件打开失败等错误返回 false，被 visitor 提前停止不算错误
+     */
+    bool forEach(const Visitor &visitor);
+
+    /**
+     * @brief 同 forEach()，只访问 id 在 [lo, hi] 范围内的记录。
+     */
+    bool forEachInRange(quint32 lo, quint32 hi, const Visitor &visitor);
+
+    /**
+     * @brief selectAll/selectRange 解码使用的线程数，默认为 CPU 核数，1 表示在调用线程中顺序解码。
+     *
+     * 多线程解码时按记录头把映射的文件切成若干段，各段在线程池中并行解码后按顺序拼接，
+     * 因此总是通过内存映射读取；没有记录头的旧格式文件只能顺序解码。
+     */
+    int parallelism() const;
+    void setParallelism(int threads);
+
+    /**
+     * @brief 插入单条记录。开启后台写入时只把记录放进队列就返回 true，不等待写入。
+     */
     bool insert(const User &user);
-    bool insert(const QVector<User> &users);
+    bool insert(const QVector<User> &users) override;
+
+    /**
+     * @brief 开启后单条 insert() 交给一个常驻的后台写线程，多个线程提交的记录攒成一批后一次写入。
+     *        需要在开始写入之前设置，关闭时会先写完队列中的记录。
+     * @param enabled 是否开启
+     * @param maxBatch 攒够多少条写一次
+     * @param maxDelay 第一条记录最多等待多少毫秒
+     * @param durability 每一批写完后是否 fsync
+     */
+    void setWriteBehind(bool enabled, int maxBatch = 4096, int maxDelay = 10, Durability durability = NoSync);
+    bool isWriteBehind() const;
 
+    /**
+     * @brief 插入单条记录，返回的 future 在记录所在的批次写完（按设置 fsync）后给出结果。
+     *        没有开启后台写入时同步写入。
+     */
+    QFuture<bool> insertQueued(const User &user);
+
+    /**
+     * @brief 立即写入后台写线程队列中的记录，并等待写完。
+     * @return 执行结果
+     */
+    bool flush();
+
+    /**
+     * @brief 更新记录，任何一个 id 不存在时不做修改并返回 false。
+     */
     bool update(const User &user);
-    bool update(const QVector<User> &users);
+    bool update(const QVector<User> &users) override;
 
+    /**
+     * @brief 删除记录，任何一个 id 不存在时不做修改并返回 false。
+     */
     bool remove(const User &user);
-    bool remove(const QVector<User> &users);
+    bool remove(const QVector<User> &users) override;
+
+    /**
+     * @brief 从数据文件完整扫描一遍重建 id 索引，用于旧版本写入的、没有索引文件的数据。
+     * @return 执行结果
+     */
+    bool rebuildIndex();
+
+    /**
+     * @brief 从数据文件重建名字索引。
+     * @return 执行结果
+     */
+    bool rebuildNameIndex();
+
+    /**
+     * @brief 失效记录比例超过该值时在写入后自动开始后台压缩，0 表示不自动压缩，默认 0.5。
+     */
+    double compactionRatio() const;
+    void setCompactionRatio(double ratio);
+
+    /**
+     * @brief 当前数据文件中已经被覆盖或删除的记录所占的比例。
+     */
+    double garbageRatio();
+
+    /**
+     * @brief 立即把有效记录改写到新文件并替换 user.dat（同步执行）。
+     * @return 执行结果
+     */
+    bool compact();
+
+    /**
+     * @brief 读写统计（见 UserStats），默认关闭，用 stats().setEnabled(true) 开启。
+     *
+     * select、selectAll/selectRange（包括批次版本）、selectByName、insert、update、remove
+     * 各自记录延迟分布；读写文件的字节数和次数、fsync 次数、读设备和解码的耗时在实际读写的地方累加。
+     */
+    UserStats &stats();
+
+    /**
+     * @brief 把数据文件和索引文件刷到磁盘，并写入检查点，下次启动时只需要校验之后写入的记录。
+     *        写入达到一定长度后和析构时会自动调用。
+     * @return 执行结果
+     */
+    bool checkpoint();
+
+    /**
+     * @brief 等待正在进行的后台压缩结束。
+     */
+    void waitForCompaction();
+
+private:
+    /**
+     * @brief 第一次使用时加载 id 索引，之后直接使用内存中的索引（不需要持锁）
+     */
+    bool loadIndex();
+
+    /**
+     * @brief 同 loadIndex()，调用者需要持有写锁
+     */
+    bool ensureIndex();
+
+    /**
+     * @brief 打开名字索引并补扫之后写入的记录，文件不存在或者不完整时重建，调用者需要持有写锁
+     */
+    bool ensureNameIndex();
+
+    /**
+     * @brief 把名字索引刷到磁盘，记录它已经包含的数据文件长度，调用者需要持有写锁
+     */
+    bool syncNameIndex();
+
+    /**
+     * @brief 关闭并删除名字索引（数据文件中的偏移失效时），调用者需要持有写锁
+     */
+    void dropNameIndex();
+
+    /**
+     * @brief 写入前确认文件是当前格式：空文件写入文件头，旧格式的文件先整体改写
+     */
+    bool prepareWrite();
+
+    /**
+     * @brief 同步写入一批新记录
+     * @param sync 写完后是否 fsync
+     */
+    bool insertUsers(const QVector<User> &users, bool sync);
+
+    /**
+     * @brief 把一批记录追加到数据文件并更新索引，调用者需要持有写锁
+     * @param sync 写完后是否 fsync
+     * @param users 写入的记录，不为空时加入名字索引（删除时为空）
+     */
+    bool appendRecords(const UserRecordBuilder &builder, bool sync = false, const QVector<User> *users = nullptr);
+
+    /**
+     * @brief 失效记录过多时启动后台压缩，调用者需要持有写锁
+     */
+    void scheduleCompaction();
+
+    /**
+     * @brief 写入提交之后发布已经提交的长度和新的序号，只写两个原子变量，不重新映射，调用者需要持有写锁
+     */
+    void publishSnapshot();
+
+    /**
+     * @brief 读取最近一次发布的长度和序号（两者对应同一次提交），索引加载之前长度为 -1
+     */
+    void readCommitted(qint64 *size, quint64 *epoch) const;
+
+    /**
+     * @brief 替换或截断数据文件之前释放快照共用的映射，调用者需要持有写锁和 m_snapshotMutex
+     */
+    void releaseSnapshotMap();
+
+    /**
+     * @brief 把数据文件 [from, to) 范围内的记录以当前格式复制到 out。
+     * @param live 不为空时只复制其中列出的记录（按偏移排序）
+     * @param items[out] 复制后的记录在新文件中的索引项
+     */
+    bool copyRecords(QFile *out, qint64 from, qint64 to,
+                     const QVector<UserIndex::Item> *live, QVector<UserIndex::Item> *items);
+
+    /**
+     * @brief 写入时每个数据块的记录数，0 表示按行写入
+     */
+    int builderBlockSize() const;
+
+    /**
+     * @brief 映射数据文件（长度变化时重新映射），调用者需要持有读锁。多个读者可能同时调用，由 m_mapMutex 串行化
+     */
+    bool openMap();
+
+    bool readRecord(quint32 id, UserRecord *record);
+
+    /**
+     * @brief 把一次读取的字节数、设备读取次数和耗时计入统计，nanos 是整个读取的耗时，扣除读设备的部分算作解码
+     */
+    void addReadStats(const UserFileReader &reader, qint64 records, qint64 nanos);
+
+    /**
+     * @brief compact() 的实际过程，调用者需要持有 m_compactMutex
+     */
+    bool compactFile();
+
+    /**
+     * @brief 用 UserBulkLoader 生成并已经落盘的数据文件和索引文件替换当前的全部内容，然后写检查点、加载索引
+     */
+    bool installFiles(const QString &dataFileName, const QString &indexFileName);
+
+    /**
+     * @brief 把当前的数据文件和索引文件改名为 *.old，再把新文件改名就位，调用者需要持有写锁。
+     * @param indexFileName 新的索引文件，为空时不替换（由调用者之后写入）
+     * @return 执行结果，失败时已经按备份换回旧文件
+     */
+    bool replaceFiles(const QString &dataFileName, const QString &indexFileName);
+
+    /**
+     * @brief 替换文件的过程被中断（或者失败）后按留下的备份（*.old）恢复，调用者需要持有写锁
+     */
+    void restoreBackup();
+
+    /**
+     * @brief 新文件就位、索引和检查点都写好之后删除备份
+     */
+    void removeBackup();
+    friend class UserBulkLoader;
+
+    /**
+     * @brief 先查缓存，未命中时读取记录并放入缓存，调用者需要持有读锁
+     */
+    bool lookup(quint32 id, User *user);
+
+    /**
+     * @brief 写入之后删除缓存中对应的条目，调用者需要持有写锁
+     */
+    void invalidate(const QVector<User> &users);
+    QVector<User> scan(quint32 lo, quint32 hi);
+    QVector<User> parallelScan(quint32 lo, quint32 hi);
+
+    /**
+     * @brief 顺序扫描 [lo, hi] 范围内的有效记录，调用者需要持有读锁
+     */
+    bool visit(quint32 lo, quint32 hi, const Visitor &visitor);
+
+    /**
+     * @brief 只读取与 [lo, hi] 有交集的段；旧格式没有记录头，只能从头读到结尾
+     * @return visitor 要求停止时返回 false
+     */
+    bool visitZones(UserFileReader &reader, quint32 lo, quint32 hi, const Visitor &visitor) const;
+
+    /**
+     * @brief 从 reader 当前位置读到 end（默认为结尾），对每条仍然有效的记录调用 visitor
+     * @return visitor 要求停止时返回 false
+     */
+    bool visitLive(UserFileReader &reader, quint32 lo, quint32 hi, const Visitor &visitor,
+                   qint64 end = std::numeric_limits<qint64>::max()) const;
+
+    const QString m_fileName;
+    const QString m_indexFileName;
+    const QString m_checkpointFileName;
+    const QString m_compactFileName;
+    const QString m_nameIndexFileName;
+
+    UserIndex m_index;
+    UserNameIndex m_nameIndex;
+    ReadMode m_readMode;
+    MappedFile m_map;
+    QMutex m_mapMutex;
+
+    int m_fileVersion;
+
+    // 快照：各个快照共用的映射（有新的提交之后由下一次 snapshot() 重新映射），
+    // 以及最近一次提交的长度和序号（顺序锁：m_epoch 是序号的两倍，发布期间为奇数）
+    QSharedPointer<MappedFile> m_snapshotMap;
+    QMutex m_snapshotMutex;
+    QAtomicInteger<quint64> m_epoch;
+    QAtomicInteger<qint64> m_committedSize;
+
+    WriteFormat m_writeFormat;
+    int m_blockSize;
+    quint8 m_codec;
+
+    UserCache *m_cache;
+    UserStats m_stats;
+
+    int m_parallelism;
+    QThreadPool m_decodePool;
+
+    UserWriter *m_writer;
+
+    double m_compactionRatio;
+    QFuture<bool> m_compaction;
+    QMutex m_compactMutex;
+    mutable QReadWriteLock m_lock;
 };
 
 #endif // USERDAO_H
@@ -0,0 +1,336 @@
+#include "userfilereader.h"
+#include <QIODevice>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QtEndian>
+
+#include "usercodec.h"
+#include "userblock.h"
+#include "blockcodec.h"
+#include "crc32c.h"
+
+UserFileReader::UserFileReader(QIODevice *device)
+    : m_device(device)
+    , m_data(nullptr)
+    , m_size(0)
+    , m_pos(0)
+    , m_version(UserFormat::EmptyFile)
+    , m_verifyChecksums(false)
+    , m_timeIo(false)
+    , m_bytesRead(0)
+    , m_deviceReads(0)
+    , m_ioNanos(0)
+{
+    QByteArray head = device->peek(UserFormat::FileHeaderSize);
+    m_version = UserFormat::version(reinterpret_cast<const uchar *>(head.constData()), head.size());
+    if (m_version == UserFormat::LegacyVersion)
+    {
+        m_stream.setDevice(device);
+    }
+    seek(0);
+}
+
+UserFileReader::UserFileReader(const uchar *data, qint64 size)
+    : m_device(nullptr)
+    , m_data(data)
+    , m_size(size)
+    , m_pos(0)
+    , m_version(UserFormat::version(data, size))
+    , m_verifyChecksums(false)
+    , m_timeIo(false)
+    , m_bytesRead(0)
+    , m_deviceReads(0)
+    , m_ioNanos(0)
+{
+    seek(0);
+}
+
+int UserFileReader::version() const
+{
+    return m_version;
+}
+
+void UserFileReader::setVerifyChecksums(bool verify)
+{
+    m_verifyChecksums = verify;
+}
+
+bool UserFileReader::seek(qint64 offset)
+{
+    m_pos = qMax(offset, qint64(UserFormat::headerSize(m_version)));
+    if (m_device)
+    {
+        m_stream.resetStatus();
+        return m_device->seek(m_pos);
+    }
+    return m_pos <= m_size;
+}
+
+qint64 UserFileReader::pos() const
+{
+    return m_pos;
+}
+
+void UserFileReader::setTimeIo(bool enabled)
+{
+    m_timeIo = enabled;
+}
+
+qint64 UserFileReader::bytesRead() const
+{
+    return m_bytesRead;
+}
+
+qint64 UserFileReader::deviceReads() const
+{
+    return m_deviceReads;
+}
+
+qint64 UserFileReader::ioNanos() const
+{
+    return m_ioNanos;
+}
+
+bool UserFileReader::next(UserRecord *record, bool withUser)
+{
+    if (m_version == UserFormat::EmptyFile)
+    {
+        return false;
+    }
+    if (!(m_device ? nextFromDevice(record, withUser) : nextFromMemory(record, withUser)))
+    {
+        return false;
+    }
+    m_bytesRead += record->size;
+    return true;
+}
+
+bool UserFileReader::skip()
+{
+    if (m_version == UserFormat::EmptyFile)
+    {
+        return false;
+    }
+    if (m_version == UserFormat::LegacyVersion)
+    {
+        UserRecord record;
+        return next(&record, false);
+    }
+
+    uchar head[UserFormat::RecordHeaderSize];
+    UserFormat::RecordHeader header;
+    if (m_device)
+    {
+        if (m_device->read(reinterpret_cast<char *>(head), sizeof(head)) != qint64(sizeof(head))
+                || !UserFormat::readRecordHeader(head, sizeof(head), &header)
+                || m_device->size() - m_device->pos() < qint64(header.length))
+        {
+            return false;
+        }
+        m_pos += UserFormat::RecordHeaderSize + header.length;
+        return m_device->seek(m_pos);
+    }
+
+    if (!UserFormat::readRecordHeader(m_data + m_pos, m_size - m_pos, &header)
+            || qint64(header.length) > m_size - m_pos - UserFormat::RecordHeaderSize)
+    {
+        return false;
+    }
+    m_pos += UserFormat::RecordHeaderSize + header.length;
+    return true;
+}
+
+bool UserFileReader::decodeUser(UserRecord *record)
+{
+    if (!record->payload)
+    {
+        // 旧格式的记录在读取时已经解码
+        return true;
+    }
+    return UserCodec::decode(record->payload, record->length, &record->user,
+                             UserFormat::serializeVersion(record->flags)) >= 0;
+}
+
+bool UserFileReader::nextFromDevice(UserRecord *record, bool withUser)
+{
+    if (m_device->atEnd())
+    {
+        return false;
+    }
+
+    if (m_version == UserFormat::LegacyVersion)
+    {
+        // 旧格式逐字段读取，读设备和解码交织在一起，只计一次读取，耗时不区分
+        ++m_deviceReads;
+        m_stream >> record->user;
+        if (m_stream.status() != QDataStream::Ok)
+        {
+            return false;
+        }
+        record->kind = UserFormat::PutRecord;
+        record->flags = 0;
+        record->offset = m_pos;
+        record->id = record->user.id();
+        record->payload = nullptr;
+        record->length = 0;
+        m_pos = m_device->pos();
+        record->size = quint32(m_pos - record->offset);
+        return true;
+    }
+
+    QElapsedTimer timer;
+    if (m_timeIo)
+    {
+        timer.start();
+    }
+    char head[UserFormat::RecordHeaderSize];
+    m_deviceReads += 2;
+    if (m_device->read(head, sizeof(head)) != qint64(sizeof(head)))
+    {
+        return false;
+    }
+    // 记录头没有 CRC，写入中断留下的长度可能是任意值，超出文件剩余长度时视为文件结束
+    UserFormat::RecordHeader header;
+    if (!UserFormat::readRecordHeader(reinterpret_cast<const uchar *>(head), sizeof(head), &header)
+            || qint64(header.length) > m_device->size() - m_device->pos())
+    {
+        return false;
+    }
+
+    if (m_buffer.size() < int(header.length))
+    {
+        m_buffer.resize(int(header.length));
+    }
+    if (m_device->read(m_buffer.data(), header.length) != qint64(header.length))
+    {
+        return false;
+    }
+    if (m_timeIo)
+    {
+        m_ioNanos += timer.nsecsElapsed();
+    }
+
+    record->kind = header.kind;
+    record->flags = header.flags;
+    record->offset = m_pos;
+    record->size = UserFormat::RecordHeaderSize + header.length;
+    if (!decodePayload(reinterpret_cast<const uchar *>(m_buffer.constData()), header.length, header.flags, record, withUser))
+    {
+        return false;
+    }
+    m_pos += record->size;
+    return true;
+}
+
+bool UserFileReader::nextFromMemory(UserRecord *record, bool withUser)
+{
+    if (m_pos >= m_size)
+    {
+        return false;
+    }
+
+    const uchar *data = m_data + m_pos;
+    qint64 available = m_size - m_pos;
+
+    if (m_version == UserFormat::LegacyVersion)
+    {
+        qint64 used = UserCodec::decode(data, available, &record->user);
+        if (used < 0)
+        {
+            return false;
+        }
+        record->kind = UserFormat::PutRecord;
+        record->flags = 0;
+        record->offset = m_pos;
+        record->size = quint32(used);
+        record->id = record->user.id();
+        record->payload = nullptr;
+        record->length = 0;
+        m_pos += used;
+        return true;
+    }
+
+    UserFormat::RecordHeader header;
+    if (!UserFormat::readRecordHeader(data, available, &header)
+            || qint64(header.length) > available - UserFormat::RecordHeaderSize)
+    {
+        return false;
+    }
+
+    record->kind = header.kind;
+    record->flags = header.flags;
+    record->offset = m_pos;
+    record->size = UserFormat::RecordHeaderSize + header.length;
+    if (!decodePayload(data + UserFormat::RecordHeaderSize, header.length, header.flags, record, withUser))
+    {
+        return false;
+    }
+    m_pos += record->size;
+    return true;
+}
+
+bool UserFileReader::decodePayload(const uchar *payload, quint32 length, quint8 flags, UserRecord *record, bool withUser)
+{
+    if (flags & UserFormat::ChecksumFlag)
+    {
+        if (length < quint32(UserFormat::ChecksumSize))
+        {
+            return false;
+        }
+        length -= UserFormat::ChecksumSize;
+        if (m_verifyChecksums
+                && qFromLittleEndian<quint32>(payload + length) != Crc32c::compute(payload, length))
+        {
+            return false;
+        }
+    }
+
+    quint8 codecId = flags & UserFormat::CodecMask;
+    if (codecId != BlockCodec::NoCodec && record->kind == UserFormat::BlockRecord)
+    {
+        const BlockCodec *codec = BlockCodec::codec(codecId);
+        if (!codec)
+        {
+            qDebug() << QString::fromLocal8Bit("\n未知的压缩算法") << codecId;
+            return false;
+        }
+        if (!codec->decompress(payload, int(length), &m_inflated))
+        {
+            return false;
+        }
+        payload = reinterpret_cast<const uchar *>(m_inflated.constData());
+        length = quint32(m_inflated.size());
+    }
+
+    record->payload = payload;
+    record->length = length;
+
+    if (record->kind == UserFormat::BlockRecord)
+    {
+        return UserBlock::firstId(payload, length, flags, &record->id);
+    }
+
+    if (flags & UserFormat::VarintFlag)
+    {
+        // 只有 Put 记录会使用 varint，内容以 varint 格式的 id 开头
+        if (SerializeDetail::getVarint(payload, length, &record->id) < 0)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // Put 和 Remove 记录的内容都以 QDataStream 格式的 quint32 id 开头
+        if (length < sizeof(quint32))
+        {
+            return false;
+        }
+        record->id = qFromBigEndian<quint32>(payload);
+    }
+
+    if (record->kind == UserFormat::PutRecord && withUser)
+    {
+        return UserCodec::decode(payload, length, &record->user, UserFormat::serializeVersion(flags)) >= 0;
+    }
+    return true;
+}
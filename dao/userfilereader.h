@@ -0,0 +1,109 @@
+#ifndef USERFILEREADER_H
+#define USERFILEREADER_H
+
+#include <QByteArray>
+#include <QDataStream>
+
+#include "userformat.h"
+
+class QIODevice;
+
+/**
+ * @brief 顺序读取 user.dat 中的记录，同时支持旧格式和当前格式。
+ *
+ * 可以从 QIODevice（流式读取）或者一段内存（例如映射的文件）读取，
+ * 索引重建、selectAll 等需要扫描文件的地方都通过它读取记录。
+ */
+class UserFileReader
+{
+    Q_DISABLE_COPY(UserFileReader)
+
+public:
+    /**
+     * @brief 从设备读取，设备需要已经打开并位于文件开头。
+     */
+    explicit UserFileReader(QIODevice *device);
+
+    /**
+     * @brief 从内存读取，data 指向文件开头。
+     */
+    UserFileReader(const uchar *data, qint64 size);
+
+    int version() const;
+
+    /**
+     * @brief 是否校验记录的 CRC，默认不校验。校验失败的记录当作文件结尾，next() 返回 false。
+     *        没有 CRC 的记录（版本 5 之前写入的）只检查长度是否完整。
+     */
+    void setVerifyChecksums(bool verify);
+
+    /**
+     * @brief 跳到指定偏移继续读取，偏移必须是记录的起始位置（小于文件头长度时跳到第一条记录）。
+     */
+    bool seek(qint64 offset);
+
+    qint64 pos() const;
+
+    /**
+     * @brief 是否统计读设备的耗时（见 ioNanos()），默认不统计。从内存读取时没有设备读取，耗时总是 0。
+     */
+    void setTimeIo(bool enabled);
+
+    /**
+     * @brief next() 读到的记录的总字节数（含记录头）
+     */
+    qint64 bytesRead() const;
+
+    /**
+     * @brief 对设备调用 read 的次数。QFile 有缓冲，实际的系统调用次数不会更多
+     */
+    qint64 deviceReads() const;
+
+    /**
+     * @brief 读设备的总耗时（纳秒），只在 setTimeIo(true) 时统计
+     */
+    qint64 ioNanos() const;
+
+    /**
+     * @brief 读取下一条记录。
+     * @param record[out] 读到的记录
+     * @param withUser 为 false 时只解析记录类型、id 和位置，不解码 User（旧格式仍需完整解码）
+     * @return 读到完整的记录返回 true，到达文件末尾或者尾部记录不完整时返回 false
+     */
+    bool next(UserRecord *record, bool withUser = true);
+
+    /**
+     * @brief 跳过下一条记录，只读记录头，不解压也不解析内容（旧格式仍需完整解码）。
+     * @return 与 next() 相同
+     */
+    bool skip();
+
+    /**
+     * @brief 对用 withUser = false 读出的 PutRecord 补充解码 User，结果放在 record->user。
+     */
+    static bool decodeUser(UserRecord *record);
+
+private:
+    bool nextFromDevice(UserRecord *record, bool withUser);
+    bool nextFromMemory(UserRecord *record, bool withUser);
+    bool decodePayload(const uchar *payload, quint32 length, quint8 flags, UserRecord *record, bool withUser);
+
+    QIODevice *m_device;
+    QDataStream m_stream;
+    QByteArray m_buffer;
+    QByteArray m_inflated; ///< 解压后的块内容，每个块复用
+
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_pos;
+
+    int m_version;
+    bool m_verifyChecksums;
+
+    bool m_timeIo;
+    qint64 m_bytesRead;
+    qint64 m_deviceReads;
+    qint64 m_ioNanos;
+};
+
+#endif // USERFILEREADER_H
@@ -0,0 +1,75 @@
+#include "userformat.h"
+#include <QFile>
+#include <QtEndian>
+
+static const char FILE_MAGIC[4] = { 'U', 'S', 'R', 'D' };
+
+QByteArray UserFormat::fileHeader(int version)
+{
+    QByteArray header(FileHeaderSize, '\0');
+    uchar *data = reinterpret_cast<uchar *>(header.data());
+    memcpy(data, FILE_MAGIC, sizeof(FILE_MAGIC));
+    qToLittleEndian<quint16>(quint16(version), data + 4);
+    qToLittleEndian<quint16>(0, data + 6);
+    return header;
+}
+
+int UserFormat::version(const uchar *data, qint64 size)
+{
+    if (size <= 0)
+    {
+        return EmptyFile;
+    }
+    if (size < FileHeaderSize || memcmp(data, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    {
+        return LegacyVersion;
+    }
+    return qFromLittleEndian<quint16>(data + 4);
+}
+
+int UserFormat::version(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        return EmptyFile;
+    }
+    QByteArray head = file.read(FileHeaderSize);
+    file.close();
+    return version(reinterpret_cast<const uchar *>(head.constData()), head.size());
+}
+
+int UserFormat::headerSize(int version)
+{
+    return version > LegacyVersion ? FileHeaderSize : 0;
+}
+
+bool UserFormat::readRecordHeader(const uchar *data, qint64 size, RecordHeader *header)
+{
+    if (size < RecordHeaderSize)
+    {
+        return false;
+    }
+    header->kind = data[0];
+    header->flags = data[1];
+    header->length = qFromLittleEndian<quint32>(data + 4);
+    return true;
+}
+
+void UserFormat::writeRecordHeader(uchar *data, const RecordHeader &header)
+{
+    data[0] = header.kind;
+    data[1] = header.flags;
+    data[2] = 0;
+    data[3] = 0;
+    qToLittleEndian<quint32>(header.length, data + 4);
+}
+
+int UserFormat::serializeVersion(quint8 flags)
+{
+    if (flags & VarintFlag)
+    {
+        return SerializeVarintVersion;
+    }
+    return (flags & Utf8Flag) ? SerializeUtf8Version : SerializeDataStreamVersion;
+}
@@ -0,0 +1,113 @@
+#ifndef USERFORMAT_H
+#define USERFORMAT_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "data/user.h"
+
+/**
+ * @brief user.dat 的文件格式定义。
+ *
+ * 旧格式（版本 0）：没有文件头，直接是一个接一个的 QDataStream 格式的 User。
+ *
+ * 当前格式：
+ *     文件头 8 字节：  "USRD" + quint16 version + quint16 flags（小端）
+ *     记录：           记录头 8 字节（quint8 kind, quint8 flags, quint16 保留, quint32 length，小端）+ length 字节内容
+ *
+ * 记录只追加不修改，同一个 id 以最后一条记录为准：
+ *     PutRecord    内容是 QDataStream 格式的 User（有 Utf8Flag、VarintFlag 时见下），插入和更新都写这种记录
+ *     RemoveRecord 内容是 QDataStream 格式的 quint32 id，即墓碑记录
+ *     BlockRecord  内容是按列存放的一组 User，格式见 UserBlock（版本 2 增加）
+ *
+ * 记录头的 flags：
+ *     低 4 位      BlockRecord 内容的压缩算法，见 BlockCodec，0 表示不压缩（版本 3 增加）
+ *     0x10         BlockRecord 内容（解压后）是字典布局，见 UserBlock（版本 4 增加）
+ *     0x20         内容最后 4 字节是前面内容的 CRC-32C（小端），length 包含这 4 字节（版本 5 增加）
+ *     0x40         内容中的字符串是 UTF-8（版本 6 增加）：PutRecord 按 SerializeUtf8Version 编码，
+ *                  即 varint（字节数 + 1，0 表示 null）+ UTF-8；BlockRecord 的字符串区是 UTF-8
+ *     0x80         整数是 varint（版本 7 增加）：PutRecord 按 SerializeVarintVersion 编码，id 是 LEB128 varint；
+ *                  BlockRecord 的 id 列是差分 varint，见 UserBlock 和 DeltaVarint
+ *
+ * 标志是按记录的，所以旧版本的文件升级文件头之后可以直接追加新记录，新旧记录混在一起也能读取。
+ */
+class UserFormat
+{
+public:
+    enum {
+        EmptyFile        = -1,
+        LegacyVersion    = 0,
+        CurrentVersion   = 7,
+        FileHeaderSize   = 8,
+        RecordHeaderSize = 8,
+        ChecksumSize     = 4
+    };
+
+    enum RecordKind {
+        PutRecord    = 1,
+        RemoveRecord = 2,
+        BlockRecord  = 3
+    };
+
+    enum RecordFlag {
+        CodecMask      = 0x0f,
+        DictionaryFlag = 0x10,
+        ChecksumFlag   = 0x20,
+        Utf8Flag       = 0x40,
+        VarintFlag     = 0x80
+    };
+
+    struct RecordHeader
+    {
+        quint8 kind;
+        quint8 flags;
+        quint32 length;
+    };
+
+    static QByteArray fileHeader(int version = CurrentVersion);
+
+    /**
+     * @brief 根据文件开头的字节判断格式版本。
+     * @return 空文件返回 EmptyFile，没有文件头返回 LegacyVersion
+     */
+    static int version(const uchar *data, qint64 size);
+
+    /**
+     * @brief 读取文件开头判断格式版本，文件不存在时返回 EmptyFile。
+     */
+    static int version(const QString &fileName);
+
+    /**
+     * @brief 指定版本的文件头长度，即第一条记录的偏移。
+     */
+    static int headerSize(int version);
+
+    /**
+     * @brief 解析记录头，只检查记录头本身是否完整，内容长度由调用者检查。
+     */
+    static bool readRecordHeader(const uchar *data, qint64 size, RecordHeader *header);
+    static void writeRecordHeader(uchar *data, const RecordHeader &header);
+
+    /**
+     * @brief PutRecord 内容的序列化版本（SerializeVersion），由记录头 flags 中的 Utf8Flag、VarintFlag 决定。
+     */
+    static int serializeVersion(quint8 flags);
+};
+
+/**
+ * @brief 从 user.dat 中读出的一条记录
+ */
+struct UserRecord
+{
+    quint8 kind;
+    quint8 flags;    ///< 记录头中的 flags
+    qint64 offset;
+    quint32 size;
+    quint32 id;      ///< BlockRecord 为块中第一个 id
+    User user;       ///< 只有 PutRecord 并且要求解码时有效
+
+    const uchar *payload; ///< 记录内容（不含记录头，已解压），在读取下一条记录之前有效，旧格式为空
+    quint32 length;  ///< payload 的长度，压缩的块为解压后的长度
+};
+
+#endif // USERFORMAT_H
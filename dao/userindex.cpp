@@ -0,0 +1,457 @@
+#include "userindex.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QDebug>
+#include <algorithm>
+
+#include "userformat.h"
+#include "userfilereader.h"
+#include "userblock.h"
+#include "usercheckpoint.h"
+
+static const quint32 INDEX_MAGIC   = 0x55494458; // "UIDX"
+static const quint32 INDEX_VERSION = 3;
+// 稀疏索引每段的长度
+static const qint64 ZONE_SIZE = 64 * 1024;
+
+static QDataStream &operator<<(QDataStream &out, const UserIndex::Item &item)
+{
+    out << item.id << item.kind << item.offset << item.size << item.slot << item.bytes;
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, UserIndex::Item &item)
+{
+    in >> item.id >> item.kind >> item.offset >> item.size >> item.slot >> item.bytes;
+    return in;
+}
+
+static bool itemOffsetLessThan(const UserIndex::Item &a, const UserIndex::Item &b)
+{
+    return a.offset < b.offset || (a.offset == b.offset && a.slot < b.slot);
+}
+
+UserIndex::UserIndex()
+    : m_coveredSize(0)
+    , m_liveBytes(0)
+    , m_recordBytes(0)
+    , m_checkpointedSize(0)
+    , m_loaded(false)
+{
+
+}
+
+bool UserIndex::load(const QString &indexFileName, const QString &dataFileName, const QString &checkpointFileName)
+{
+    clear();
+
+    // 索引和检查点对不上时丢掉检查点，从头扫描数据文件
+    auto rebuildAll = [&]() -> bool {
+        if (!checkpointFileName.isEmpty())
+        {
+            QFile::remove(checkpointFileName);
+        }
+        return rebuild(indexFileName, dataFileName);
+    };
+
+    QFile file(indexFileName);
+    if (!file.exists())
+    {
+        return rebuildAll();
+    }
+
+    QFileInfo dataInfo(dataFileName);
+    qint64 dataSize = dataInfo.exists() ? dataInfo.size() : 0;
+
+    // 有检查点时只信任检查点之前的索引和数据，之后写入的部分重新校验
+    UserCheckpoint checkpoint;
+    bool checkpointed = !checkpointFileName.isEmpty()
+            && UserCheckpoint::read(checkpointFileName, &checkpoint)
+            && checkpoint.dataSize <= dataSize
+            && checkpoint.indexSize <= file.size();
+
+    if (!file.open(QFile::ReadOnly)) {
+        qDebug() << QString::fromLocal8Bit("\n索引文件打开失败");
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != INDEX_MAGIC || version != INDEX_VERSION)
+    {
+        file.close();
+        return rebuildAll();
+    }
+
+    qint64 indexSize = checkpointed ? checkpoint.indexSize : file.size();
+    while (file.pos() < indexSize)
+    {
+        Item item;
+        stream >> item;
+        if (stream.status() != QDataStream::Ok)
+        {
+            // 索引文件尾部被截断，后续追加会错位，直接重建
+            file.close();
+            return rebuildAll();
+        }
+        add(item);
+    }
+    qint64 indexFileSize = file.size();
+    file.close();
+
+    if (checkpointed ? m_coveredSize != checkpoint.dataSize : m_coveredSize > dataSize)
+    {
+        // 数据文件被替换或截断过，索引已经失效
+        return rebuildAll();
+    }
+
+    m_loaded = true;
+    m_checkpointedSize = checkpointed ? checkpoint.dataSize : 0;
+    if (checkpointed && indexFileSize > indexSize && !QFile::resize(indexFileName, indexSize))
+    {
+        qDebug() << QString::fromLocal8Bit("\n索引文件截断失败");
+        return false;
+    }
+
+    if (m_coveredSize < dataSize)
+    {
+        // 检查点之后写入的、旧版本写入的、或者写数据后没来得及写索引的记录
+        QVector<Item> tail;
+        if (!scanData(dataFileName, m_coveredSize, &tail))
+        {
+            return false;
+        }
+        return append(indexFileName, tail);
+    }
+    return true;
+}
+
+bool UserIndex::rebuild(const QString &indexFileName, const QString &dataFileName)
+{
+    QVector<Item> items;
+    if (!scanData(dataFileName, 0, &items))
+    {
+        clear();
+        return false;
+    }
+    return reset(indexFileName, items);
+}
+
+bool UserIndex::reset(const QString &indexFileName, const QVector<Item> &items)
+{
+    clear();
+    foreach (const Item &item, items)
+    {
+        add(item);
+    }
+    m_loaded = true;
+
+    return writeIndexFile(indexFileName, items);
+}
+
+bool UserIndex::append(const QString &indexFileName, const QVector<Item> &items)
+{
+    if (!appendFile(indexFileName, items))
+    {
+        return false;
+    }
+    foreach (const Item &item, items)
+    {
+        add(item);
+    }
+    return true;
+}
+
+bool UserIndex::appendFile(const QString &indexFileName, const QVector<Item> &items)
+{
+    if (items.isEmpty())
+    {
+        return true;
+    }
+
+    QFile file(indexFileName);
+    if (!file.open(QFile::Append)) {
+        qDebug() << QString::fromLocal8Bit("\n索引文件打开失败");
+        return false;
+    }
+
+    QDataStream stream(&file);
+    if (file.size() == 0)
+    {
+        stream << INDEX_MAGIC << INDEX_VERSION;
+    }
+    foreach (const Item &item, items)
+    {
+        stream << item;
+    }
+    file.close();
+    return true;
+}
+
+bool UserIndex::checkpoint(const QString &indexFileName, const QString &dataFileName, const QString &checkpointFileName)
+{
+    if (!UserCheckpoint::syncFile(dataFileName) || !UserCheckpoint::syncFile(indexFileName))
+    {
+        qDebug() << QString::fromLocal8Bit("\n文件同步失败");
+        return false;
+    }
+
+    UserCheckpoint checkpoint;
+    checkpoint.dataSize = m_coveredSize;
+    checkpoint.indexSize = QFileInfo(indexFileName).size();
+    if (!checkpoint.write(checkpointFileName))
+    {
+        return false;
+    }
+    m_checkpointedSize = m_coveredSize;
+    return true;
+}
+
+qint64 UserIndex::checkpointedSize() const
+{
+    return m_checkpointedSize;
+}
+
+bool UserIndex::find(quint32 id, Entry *entry) const
+{
+    QHash<quint32, Entry>::const_iterator it = m_entries.constFind(id);
+    if (it == m_entries.constEnd())
+    {
+        return false;
+    }
+    *entry = it.value();
+    return true;
+}
+
+bool UserIndex::contains(quint32 id) const
+{
+    return m_entries.contains(id);
+}
+
+QVector<UserIndex::Item> UserIndex::liveItems() const
+{
+    QVector<Item> items;
+    items.reserve(m_entries.size());
+    for (QHash<quint32, Entry>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+    {
+        Item item;
+        item.id = it.key();
+        item.kind = UserFormat::PutRecord;
+        item.offset = it.value().offset;
+        item.size = it.value().size;
+        item.slot = it.value().slot;
+        item.bytes = it.value().bytes;
+        items.append(item);
+    }
+    std::sort(items.begin(), items.end(), itemOffsetLessThan);
+    return items;
+}
+
+QVector<UserIndex::Zone> UserIndex::zones(quint32 lo, quint32 hi) const
+{
+    QVector<Zone> zones;
+    int previous = -2;
+    for (int i = 0; i < m_zones.size(); ++i)
+    {
+        const Zone &zone = m_zones.at(i);
+        if (zone.hi < lo || zone.lo > hi)
+        {
+            continue;
+        }
+        if (previous == i - 1)
+        {
+            Zone &last = zones.last();
+            last.end = zone.end;
+            last.lo = qMin(last.lo, zone.lo);
+            last.hi = qMax(last.hi, zone.hi);
+        }
+        else
+        {
+            zones.append(zone);
+        }
+        previous = i;
+    }
+    return zones;
+}
+
+bool UserIndex::isLoaded() const
+{
+    return m_loaded;
+}
+
+int UserIndex::count() const
+{
+    return m_entries.size();
+}
+
+qint64 UserIndex::coveredSize() const
+{
+    return m_coveredSize;
+}
+
+qint64 UserIndex::liveBytes() const
+{
+    return m_liveBytes;
+}
+
+double UserIndex::garbageRatio() const
+{
+    if (m_recordBytes <= 0)
+    {
+        return 0;
+    }
+    return double(m_recordBytes - m_liveBytes) / double(m_recordBytes);
+}
+
+void UserIndex::clear()
+{
+    m_entries.clear();
+    m_zones.clear();
+    m_coveredSize = 0;
+    m_liveBytes = 0;
+    m_recordBytes = 0;
+    m_checkpointedSize = 0;
+    m_loaded = false;
+}
+
+void UserIndex::add(const Item &item)
+{
+    QHash<quint32, Entry>::iterator it = m_entries.find(item.id);
+    if (it != m_entries.end())
+    {
+        m_liveBytes -= it.value().bytes;
+    }
+
+    if (item.kind == UserFormat::RemoveRecord)
+    {
+        if (it != m_entries.end())
+        {
+            m_entries.erase(it);
+        }
+    }
+    else
+    {
+        Entry entry;
+        entry.offset = item.offset;
+        entry.size = item.size;
+        entry.slot = item.slot;
+        entry.bytes = item.bytes;
+        m_entries.insert(item.id, entry);
+        m_liveBytes += item.bytes;
+
+        // 同一个数据块的各项偏移相同，只在新记录开始时分段
+        qint64 end = item.offset + item.size;
+        if (m_zones.isEmpty()
+                || (item.offset >= m_zones.last().end && item.offset - m_zones.last().offset >= ZONE_SIZE))
+        {
+            Zone zone;
+            zone.offset = item.offset;
+            zone.end = end;
+            zone.lo = item.id;
+            zone.hi = item.id;
+            m_zones.append(zone);
+        }
+        else
+        {
+            Zone &zone = m_zones.last();
+            zone.end = qMax(zone.end, end);
+            zone.lo = qMin(zone.lo, item.id);
+            zone.hi = qMax(zone.hi, item.id);
+        }
+    }
+
+    m_recordBytes += item.bytes;
+    m_coveredSize = qMax(m_coveredSize, item.offset + item.size);
+}
+
+bool UserIndex::scanData(const QString &dataFileName, qint64 from, QVector<Item> *items) const
+{
+    QFile file(dataFileName);
+    if (!file.exists())
+    {
+        return true;
+    }
+    if (!file.open(QFile::ReadOnly)) {
+        qDebug() << QString::fromLocal8Bit("\n文件打开失败");
+        return false;
+    }
+
+    UserFileReader reader(&file);
+    reader.setVerifyChecksums(true);
+    reader.seek(from);
+
+    UserRecord record;
+    while (reader.next(&record, false))
+    {
+        appendItems(record, items);
+    }
+    qint64 validSize = reader.pos();
+    qint64 fileSize = file.size();
+    int version = reader.version();
+    file.close();
+
+    if (version > UserFormat::LegacyVersion && validSize < fileSize)
+    {
+        // 写入过程中断留下的不完整记录，或者校验失败的记录：截掉，之后的追加从这里开始
+        qDebug() << QString::fromLocal8Bit("\n截断数据文件尾部无效的记录") << validSize << fileSize;
+        if (!QFile::resize(dataFileName, validSize))
+        {
+            qDebug() << QString::fromLocal8Bit("\n数据文件截断失败");
+            return false;
+        }
+    }
+    return true;
+}
+
+void UserIndex::appendItems(const UserRecord &record, QVector<Item> *items)
+{
+    Item item;
+    item.id = record.id;
+    item.kind = record.kind;
+    item.offset = record.offset;
+    item.size = record.size;
+    item.slot = 0;
+    item.bytes = record.size;
+
+    if (record.kind != UserFormat::BlockRecord)
+    {
+        items->append(item);
+        return;
+    }
+
+    // 块中每个 id 一项，块的长度平均分摊给每个 id，余数算在最后一个上
+    UserBlock block(record.payload, record.length, record.flags);
+    int count = block.count();
+    for (int slot = 0; slot < count; ++slot)
+    {
+        item.id = block.id(slot);
+        item.slot = quint32(slot);
+        item.bytes = record.size / quint32(count);
+        if (slot == count - 1)
+        {
+            item.bytes += record.size % quint32(count);
+        }
+        items->append(item);
+    }
+}
+
+bool UserIndex::writeIndexFile(const QString &indexFileName, const QVector<Item> &items) const
+{
+    QFile file(indexFileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qDebug() << QString::fromLocal8Bit("\n索引文件打开失败");
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream << INDEX_MAGIC << INDEX_VERSION;
+    foreach (const Item &item, items)
+    {
+        stream << item;
+    }
+    file.close();
+    return true;
+}
@@ -0,0 +1,176 @@
+#ifndef USERINDEX_H
+#define USERINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+struct UserRecord;
+
+/**
+ * @brief user.dat 的 id 索引（id -> 记录在数据文件中的字节偏移），保存在单独的索引文件中。
+ *
+ * 索引文件格式（QDataStream）：
+ *     quint32 magic, quint32 version,
+ *     然后是若干 (quint32 id, quint8 kind, qint64 offset, quint32 size, quint32 slot, quint32 bytes)
+ *
+ * 每个 id 的每次写入对应一个索引项，按写入顺序追加，同一个 id 以最后一项为准，
+ * 墓碑记录会把 id 从索引中删除。列式数据块中的每个 id 各有一项，offset、size 是整个块的，
+ * slot 是 id 在块中的下标，bytes 是这个 id 分摊到的字节数（用于统计失效记录的比例）。
+ * 新插入的记录只追加到索引文件末尾；加载时如果发现数据文件比索引覆盖的范围长
+ * （例如旧版本程序写入的数据），会从数据文件中补扫尾部并追加到索引里。
+ * 索引文件版本不一致时直接从数据文件重建。
+ *
+ * 内存中另外维护一个稀疏索引：数据文件按大约 64 KiB 分段，记录每段中 id 的范围，
+ * 范围查询只需要读取与范围有交集的段。记录按 id 有序写入（顺序插入、压缩后的有序段）时各段的范围几乎不重叠。
+ *
+ * 有检查点（见 UserCheckpoint）时，加载只读取检查点之前的索引项，检查点之后的数据重新扫描并校验 CRC；
+ * 没有检查点时校验索引没有覆盖的尾部。扫描到不完整或者校验失败的记录时，把数据文件截断到它之前。
+ */
+class UserIndex
+{
+public:
+    struct Entry
+    {
+        qint64 offset;
+        quint32 size;
+        quint32 slot;
+        quint32 bytes;
+    };
+
+    struct Item
+    {
+        quint32 id;
+        quint8 kind;
+        qint64 offset;
+        quint32 size;
+        quint32 slot;
+        quint32 bytes;
+    };
+
+    /**
+     * @brief 稀疏索引的一项：数据文件中一段连续的记录，以及其中写入过的 id 的范围（包括已经失效的记录）
+     */
+    struct Zone
+    {
+        qint64 offset; ///< 段中第一条记录的偏移
+        qint64 end;    ///< 段中最后一条记录的结尾
+        quint32 lo;
+        quint32 hi;
+    };
+
+    UserIndex();
+
+    /**
+     * @brief 加载索引文件，并补齐数据文件中索引尚未覆盖的尾部。索引文件不存在或损坏时重建。
+     * @param indexFileName 索引文件名
+     * @param dataFileName 数据文件名
+     * @param checkpointFileName 检查点文件名，为空时不使用检查点
+     * @return 执行结果
+     */
+    bool load(const QString &indexFileName, const QString &dataFileName,
+              const QString &checkpointFileName = QString());
+
+    /**
+     * @brief 从数据文件完整扫描一遍，重新生成索引文件。
+     * @param indexFileName 索引文件名
+     * @param dataFileName 数据文件名
+     * @return 执行结果
+     */
+    bool rebuild(const QString &indexFileName, const QString &dataFileName);
+
+    /**
+     * @brief 用给定的索引项替换整个索引（内存和索引文件），用于压缩之后。
+     * @param indexFileName 索引文件名
+     * @param items 新数据文件中所有记录的索引项
+     * @return 执行结果
+     */
+    bool reset(const QString &indexFileName, const QVector<Item> &items);
+
+    /**
+     * @brief 把新写入数据文件的记录追加到索引（内存和索引文件）。
+     * @param indexFileName 索引文件名
+     * @param items 新记录的 id 和位置
+     * @return 执行结果
+     */
+    bool append(const QString &indexFileName, const QVector<Item> &items);
+
+    /**
+     * @brief 只把索引项追加到索引文件（文件为空时先写文件头），不修改内存中的索引。
+     *        批量加载时用它边写数据文件边写索引，内存占用与记录数无关。
+     * @return 执行结果
+     */
+    static bool appendFile(const QString &indexFileName, const QVector<Item> &items);
+
+    /**
+     * @brief 把数据文件和索引文件刷到磁盘，然后把当前覆盖的长度写入检查点文件。
+     * @return 执行结果
+     */
+    bool checkpoint(const QString &indexFileName, const QString &dataFileName, const QString &checkpointFileName);
+
+    /**
+     * @brief 最近一次检查点记录的数据文件长度，没有检查点时为 0
+     */
+    qint64 checkpointedSize() const;
+
+    /**
+     * @brief 查找 id 对应的最新记录位置。
+     * @param id 用户 id
+     * @param entry[out] 记录位置
+     * @return 找到（且没有被删除）返回 true
+     */
+    bool find(quint32 id, Entry *entry) const;
+    bool contains(quint32 id) const;
+
+    /**
+     * @brief 所有有效记录的索引项，按在数据文件中的偏移和块中的下标排序。
+     */
+    QVector<Item> liveItems() const;
+
+    /**
+     * @brief id 范围与 [lo, hi] 有交集的段，按偏移排序，相邻的段合并成一段。
+     */
+    QVector<Zone> zones(quint32 lo, quint32 hi) const;
+
+    bool isLoaded() const;
+    int count() const;
+
+    /**
+     * @brief 索引已经覆盖到的数据文件长度
+     */
+    qint64 coveredSize() const;
+
+    /**
+     * @brief 有效记录占用的字节数
+     */
+    qint64 liveBytes() const;
+
+    /**
+     * @brief 已经被覆盖或删除的记录（包括墓碑记录）在数据文件中所占的比例
+     */
+    double garbageRatio() const;
+
+    /**
+     * @brief 生成数据文件中一条记录对应的索引项（列式数据块中每个 id 一项）。
+     */
+    static void appendItems(const UserRecord &record, QVector<Item> *items);
+
+private:
+    void clear();
+    void add(const Item &item);
+    /**
+     * @brief 从 from 开始扫描数据文件并校验 CRC，尾部无效的记录会被截掉
+     */
+    bool scanData(const QString &dataFileName, qint64 from, QVector<Item> *items) const;
+    bool writeIndexFile(const QString &indexFileName, const QVector<Item> &items) const;
+
+    QHash<quint32, Entry> m_entries;
+    QVector<Zone> m_zones;
+    qint64 m_coveredSize;
+    qint64 m_liveBytes;
+    qint64 m_recordBytes;
+    qint64 m_checkpointedSize;
+    bool m_loaded;
+};
+
+#endif // USERINDEX_H
@@ -0,0 +1,235 @@
+#include "usernameindex.h"
+#include <QDebug>
+#include <cstring>
+
+#include "crc32c.h"
+#include "usercheckpoint.h"
+
+static const quint32 NAME_INDEX_MAGIC   = 0x554e4958; // "UNIX"
+static const quint32 NAME_INDEX_VERSION = 1;
+// 新建索引的最小容量
+static const quint32 NAME_INDEX_MIN_CAPACITY = 1024;
+
+UserNameIndex::UserNameIndex()
+    : m_data(nullptr)
+    , m_header(nullptr)
+    , m_slots(nullptr)
+{
+
+}
+
+UserNameIndex::~UserNameIndex()
+{
+    close();
+}
+
+bool UserNameIndex::open(const QString &fileName, qint64 *syncedSize)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.exists())
+    {
+        return false;
+    }
+    if (!m_file.open(QFile::ReadWrite)) {
+        qDebug() << QString::fromLocal8Bit("\n名字索引文件打开失败");
+        return false;
+    }
+    if (m_file.size() < qint64(sizeof(Header)) || !map())
+    {
+        close();
+        return false;
+    }
+
+    quint32 capacity = m_header->capacity;
+    bool valid = m_header->magic == NAME_INDEX_MAGIC
+            && m_header->version == NAME_INDEX_VERSION
+            && capacity >= NAME_INDEX_MIN_CAPACITY
+            && (capacity & (capacity - 1)) == 0
+            && m_file.size() == qint64(sizeof(Header)) + qint64(capacity) * qint64(sizeof(Slot))
+            && m_header->count < capacity
+            && m_header->syncedSize >= 0;
+    if (!valid)
+    {
+        close();
+        return false;
+    }
+    *syncedSize = m_header->syncedSize;
+    return true;
+}
+
+bool UserNameIndex::create(const QString &fileName, int expected)
+{
+    close();
+    quint32 capacity = NAME_INDEX_MIN_CAPACITY;
+    while (capacity < quint32(0x80000000) && qint64(capacity) * 7 < qint64(expected) * 10)
+    {
+        capacity *= 2;
+    }
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadWrite | QFile::Truncate)) {
+        qDebug() << QString::fromLocal8Bit("\n名字索引文件打开失败");
+        return false;
+    }
+    if (!m_file.resize(qint64(sizeof(Header)) + qint64(capacity) * qint64(sizeof(Slot))) || !map())
+    {
+        qDebug() << QString::fromLocal8Bit("\n名字索引文件写入失败");
+        close();
+        return false;
+    }
+
+    memset(m_data, 0, size_t(m_file.size()));
+    m_header->magic = NAME_INDEX_MAGIC;
+    m_header->version = NAME_INDEX_VERSION;
+    m_header->capacity = capacity;
+    m_header->count = 0;
+    m_header->syncedSize = 0;
+    return true;
+}
+
+void UserNameIndex::close()
+{
+    if (m_data)
+    {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_header = nullptr;
+    m_slots = nullptr;
+    m_file.close();
+}
+
+bool UserNameIndex::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+bool UserNameIndex::insert(const QString &userName, quint32 id)
+{
+    quint32 h = hash(userName);
+    quint32 mask = m_header->capacity - 1;
+    for (quint32 i = h & mask; m_slots[i].hash != 0; i = (i + 1) & mask)
+    {
+        if (m_slots[i].hash == h && m_slots[i].id == id)
+        {
+            return true;
+        }
+    }
+
+    if (qint64(m_header->count + 1) * 10 > qint64(m_header->capacity) * 7 && !grow())
+    {
+        return false;
+    }
+    insertSlot(h, id);
+    return true;
+}
+
+QVector<quint32> UserNameIndex::find(const QString &userName) const
+{
+    QVector<quint32> ids;
+    quint32 h = hash(userName);
+    quint32 mask = m_header->capacity - 1;
+    for (quint32 i = h & mask; m_slots[i].hash != 0; i = (i + 1) & mask)
+    {
+        if (m_slots[i].hash == h)
+        {
+            ids.append(m_slots[i].id);
+        }
+    }
+    return ids;
+}
+
+bool UserNameIndex::sync(qint64 dataSize)
+{
+    // 先让所有槽位落盘，再记录长度，中断时 syncedSize 不会超前于已经落盘的内容
+    if (!UserCheckpoint::syncFile(m_file))
+    {
+        return false;
+    }
+    m_header->syncedSize = dataSize;
+    return UserCheckpoint::syncFile(m_file);
+}
+
+qint64 UserNameIndex::syncedSize() const
+{
+    return m_header ? m_header->syncedSize : 0;
+}
+
+int UserNameIndex::count() const
+{
+    return m_header ? int(m_header->count) : 0;
+}
+
+quint32 UserNameIndex::hash(const QString &userName)
+{
+    quint32 h = Crc32c::compute(reinterpret_cast<const uchar *>(userName.constData()),
+                                qint64(userName.size()) * qint64(sizeof(QChar)));
+    return h ? h : 1;
+}
+
+bool UserNameIndex::map()
+{
+    m_data = m_file.map(0, m_file.size());
+    if (!m_data)
+    {
+        qDebug() << QString::fromLocal8Bit("\n名字索引文件映射失败");
+        return false;
+    }
+    m_header = reinterpret_cast<Header *>(m_data);
+    m_slots = reinterpret_cast<Slot *>(m_data + sizeof(Header));
+    return true;
+}
+
+bool UserNameIndex::grow()
+{
+    quint32 capacity = m_header->capacity;
+    if (capacity >= quint32(0x80000000))
+    {
+        return false;
+    }
+
+    QVector<Slot> used;
+    used.reserve(int(m_header->count));
+    for (quint32 i = 0; i < capacity; ++i)
+    {
+        if (m_slots[i].hash != 0)
+        {
+            used.append(m_slots[i]);
+        }
+    }
+
+    // 重新分布期间文件内容不完整，先标记，中断后打开时会重建
+    m_header->syncedSize = -1;
+    m_file.unmap(m_data);
+    m_data = nullptr;
+    capacity *= 2;
+    if (!m_file.resize(qint64(sizeof(Header)) + qint64(capacity) * qint64(sizeof(Slot))) || !map())
+    {
+        qDebug() << QString::fromLocal8Bit("\n名字索引扩容失败");
+        close();
+        return false;
+    }
+
+    memset(m_slots, 0, size_t(capacity) * sizeof(Slot));
+    m_header->capacity = capacity;
+    m_header->count = 0;
+    foreach (const Slot &slot, used)
+    {
+        insertSlot(slot.hash, slot.id);
+    }
+    return true;
+}
+
+void UserNameIndex::insertSlot(quint32 hash, quint32 id)
+{
+    quint32 mask = m_header->capacity - 1;
+    quint32 i = hash & mask;
+    while (m_slots[i].hash != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    m_slots[i].hash = hash;
+    m_slots[i].id = id;
+    ++m_header->count;
+}
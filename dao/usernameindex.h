@@ -0,0 +1,105 @@
+#ifndef USERNAMEINDEX_H
+#define USERNAMEINDEX_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief userName 的二级索引：开放寻址（线性探测）的哈希表，保存在单独的文件（user.nidx）中，
+ *        打开后整个文件映射到内存，查找和插入都直接读写映射。
+ *
+ * 文件格式（本机字节顺序，字节顺序不同的文件 magic 对不上，会被重建）：
+ *     quint32 magic, quint32 version, quint32 capacity, quint32 count, qint64 syncedSize,
+ *     然后是 capacity 个槽位 (quint32 hash, quint32 id)，hash 为 0 表示空槽位
+ *
+ * 表中只保存名字的哈希和 id，不保存名字本身：查找得到的是候选 id，调用者需要读出记录核对名字。
+ * 因此更新名字和删除记录时不需要修改索引，旧的项在核对时被过滤掉，压缩数据文件后整个索引重建。
+ *
+ * syncedSize 是最近一次 sync() 时索引已经完整包含的数据文件长度，之前的项都已经落盘；
+ * 之后插入的项可能因为中断而丢失，打开时从 syncedSize 开始补扫数据文件即可。
+ * 扩容期间 syncedSize 为 -1，中断后打开失败，需要重建。
+ */
+class UserNameIndex
+{
+    Q_DISABLE_COPY(UserNameIndex)
+
+public:
+    UserNameIndex();
+    ~UserNameIndex();
+
+    /**
+     * @brief 打开并映射索引文件。
+     * @param fileName 索引文件名
+     * @param syncedSize[out] 索引已经完整包含的数据文件长度
+     * @return 文件不存在、损坏或者扩容时被中断返回 false，需要调用 create() 重建
+     */
+    bool open(const QString &fileName, qint64 *syncedSize);
+
+    /**
+     * @brief 新建一个空的索引文件（覆盖原文件）并映射。
+     * @param fileName 索引文件名
+     * @param expected 预计的项数，用于确定初始容量
+     * @return 执行结果
+     */
+    bool create(const QString &fileName, int expected);
+
+    void close();
+    bool isOpen() const;
+
+    /**
+     * @brief 添加 userName -> id，相同的项已经存在时不重复添加。装载率超过 70% 时容量翻倍。
+     * @return 执行结果，扩容失败时返回 false
+     */
+    bool insert(const QString &userName, quint32 id);
+
+    /**
+     * @brief 名字哈希与 userName 相同的所有 id，包括已经改名或删除的旧项，调用者需要核对记录。
+     */
+    QVector<quint32> find(const QString &userName) const;
+
+    /**
+     * @brief 把映射的内容刷到磁盘，然后记录索引已经包含了数据文件的前 dataSize 字节。
+     * @return 执行结果
+     */
+    bool sync(qint64 dataSize);
+
+    /**
+     * @brief 最近一次 sync() 记录的数据文件长度
+     */
+    qint64 syncedSize() const;
+
+    int count() const;
+
+    /**
+     * @brief 名字的哈希（UTF-16 内容的 CRC-32C），不会是 0
+     */
+    static quint32 hash(const QString &userName);
+
+private:
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        quint32 capacity;
+        quint32 count;
+        qint64 syncedSize;
+    };
+
+    struct Slot
+    {
+        quint32 hash;
+        quint32 id;
+    };
+
+    bool map();
+    bool grow();
+    void insertSlot(quint32 hash, quint32 id);
+
+    QFile m_file;
+    uchar *m_data;
+    Header *m_header;
+    Slot *m_slots;
+};
+
+#endif // USERNAMEINDEX_H
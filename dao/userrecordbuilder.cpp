@@ -0,0 +1,182 @@
+#include "userrecordbuilder.h"
+#include <QtEndian>
+
+#include "userblock.h"
+#include "blockcodec.h"
+#include "crc32c.h"
+
+UserRecordBuilder::UserRecordBuilder(int blockSize, quint8 codec)
+    : m_blockSize(blockSize)
+    , m_codec(BlockCodec::codec(codec))
+    , m_buffer(&m_data)
+{
+    m_buffer.open(QIODevice::WriteOnly);
+    m_stream.setDevice(&m_buffer);
+    if (m_blockSize > 0)
+    {
+        m_pending.reserve(m_blockSize);
+    }
+}
+
+void UserRecordBuilder::put(const User &user)
+{
+    if (m_blockSize > 0)
+    {
+        m_pending.append(user);
+        if (m_pending.size() >= m_blockSize)
+        {
+            finish();
+        }
+        return;
+    }
+
+    // 直接编码到 m_data 末尾，id 是 varint、字符串是 UTF-8，endRecord() 会把 m_buffer 移到新的末尾
+    int start = beginRecord(UserFormat::PutRecord, UserFormat::Utf8Flag | UserFormat::VarintFlag);
+    int pos = m_data.size();
+    qint64 length = Serializer<User>::serializedSize(user, SerializeVarintVersion);
+    m_data.resize(pos + int(length));
+    Serializer<User>::encode(user, reinterpret_cast<uchar *>(m_data.data()) + pos, length,
+                             QDataStream::BigEndian, SerializeVarintVersion);
+    quint32 size = endRecord(start);
+    appendItem(user.id(), UserFormat::PutRecord, start, size, 0, size);
+}
+
+void UserRecordBuilder::remove(quint32 id)
+{
+    // 墓碑必须排在之前写入的记录之后
+    finish();
+
+    int start = beginRecord(UserFormat::RemoveRecord);
+    m_stream << id;
+    quint32 size = endRecord(start);
+    appendItem(id, UserFormat::RemoveRecord, start, size, 0, size);
+}
+
+void UserRecordBuilder::appendPayload(quint8 kind, quint32 id, const char *payload, int length)
+{
+    finish();
+
+    int start = beginRecord(kind);
+    m_buffer.write(payload, length);
+    quint32 size = endRecord(start);
+    appendItem(id, kind, start, size, 0, size);
+}
+
+void UserRecordBuilder::finish()
+{
+    if (m_pending.isEmpty())
+    {
+        return;
+    }
+
+    int start = 0;
+    if (m_codec)
+    {
+        m_block.clear();
+        quint8 layout = UserBlock::encode(m_pending, 0, m_pending.size(), &m_block);
+        start = beginRecord(UserFormat::BlockRecord, quint8(m_codec->id() | layout));
+        // 压缩失败或者压缩后没有变小时写不压缩的块
+        if (!m_codec->compress(m_block.constData(), m_block.size(), &m_data)
+                || m_data.size() - start - UserFormat::RecordHeaderSize >= m_block.size())
+        {
+            m_data.truncate(start);
+            m_buffer.seek(start);
+            start = beginRecord(UserFormat::BlockRecord, layout);
+            m_data.append(m_block);
+        }
+    }
+    else
+    {
+        start = beginRecord(UserFormat::BlockRecord);
+        quint8 layout = UserBlock::encode(m_pending, 0, m_pending.size(), &m_data);
+        // 记录头已经写在前面，布局标志在编码之后才知道，直接改 flags 字节
+        m_data[start + 1] = char(quint8(m_data.at(start + 1)) | layout);
+    }
+    quint32 size = endRecord(start);
+
+    // 块的长度平均分摊给每个 id，余数算在最后一个上，与 UserIndex::appendItems() 一致
+    quint32 count = quint32(m_pending.size());
+    for (quint32 slot = 0; slot < count; ++slot)
+    {
+        quint32 bytes = size / count + (slot == count - 1 ? size % count : 0);
+        appendItem(m_pending.at(int(slot)).id(), UserFormat::BlockRecord, start, size, slot, bytes);
+    }
+    m_pending.clear();
+}
+
+bool UserRecordBuilder::isEmpty() const
+{
+    return m_items.isEmpty() && m_pending.isEmpty();
+}
+
+int UserRecordBuilder::count() const
+{
+    return m_items.size() + m_pending.size();
+}
+
+const QByteArray &UserRecordBuilder::data() const
+{
+    return m_data;
+}
+
+QVector<UserIndex::Item> UserRecordBuilder::items(qint64 baseOffset) const
+{
+    QVector<UserIndex::Item> items = m_items;
+    for (int i = 0; i < items.size(); ++i)
+    {
+        items[i].offset += baseOffset;
+    }
+    return items;
+}
+
+void UserRecordBuilder::clear()
+{
+    m_buffer.close();
+    m_data.clear();
+    m_buffer.open(QIODevice::WriteOnly);
+    m_items.clear();
+    m_pending.clear();
+}
+
+int UserRecordBuilder::beginRecord(quint8 kind, quint8 flags)
+{
+    int start = m_data.size();
+
+    // 先写一个长度为 0 的记录头，内容写完后再回填长度
+    UserFormat::RecordHeader header;
+    header.kind = kind;
+    header.flags = flags | UserFormat::ChecksumFlag;
+    header.length = 0;
+    uchar head[UserFormat::RecordHeaderSize];
+    UserFormat::writeRecordHeader(head, header);
+    m_buffer.write(reinterpret_cast<const char *>(head), sizeof(head));
+    return start;
+}
+
+quint32 UserRecordBuilder::endRecord(int start)
+{
+    // 内容后面追加 CRC，记录头中的长度包含它
+    int payloadStart = start + UserFormat::RecordHeaderSize;
+    uchar crc[UserFormat::ChecksumSize];
+    qToLittleEndian<quint32>(Crc32c::compute(reinterpret_cast<const uchar *>(m_data.constData()) + payloadStart,
+                                             m_data.size() - payloadStart), crc);
+    m_buffer.seek(m_data.size());
+    m_buffer.write(reinterpret_cast<const char *>(crc), sizeof(crc));
+
+    quint32 size = quint32(m_data.size() - start);
+    qToLittleEndian<quint32>(size - UserFormat::RecordHeaderSize,
+                             reinterpret_cast<uchar *>(m_data.data()) + start + 4);
+    return size;
+}
+
+void UserRecordBuilder::appendItem(quint32 id, quint8 kind, int start, quint32 size, quint32 slot, quint32 bytes)
+{
+    UserIndex::Item item;
+    item.id = id;
+    item.kind = kind;
+    item.offset = start;
+    item.size = size;
+    item.slot = slot;
+    item.bytes = bytes;
+    m_items.append(item);
+}
@@ -0,0 +1,69 @@
+#ifndef USERRECORDBUILDER_H
+#define USERRECORDBUILDER_H
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QDataStream>
+#include <QVector>
+
+#include "userformat.h"
+#include "userindex.h"
+
+class BlockCodec;
+
+/**
+ * @brief 在内存中拼接一批当前格式的记录，之后一次 write() 追加到 user.dat，
+ *        同时记下每条记录的相对位置，用来更新索引。
+ *
+ * blockSize 大于 0 时 put() 的记录先攒起来，每 blockSize 个编码成一个列式数据块，
+ * 使用 data() 和 items() 之前需要调用 finish() 把不足一块的记录也写进去。
+ * codec 不是 BlockCodec::NoCodec 时每个数据块压缩后再写入，行记录和墓碑记录不压缩。
+ */
+class UserRecordBuilder
+{
+    Q_DISABLE_COPY(UserRecordBuilder)
+
+public:
+    explicit UserRecordBuilder(int blockSize = 0, quint8 codec = 0);
+
+    void put(const User &user);
+    void remove(quint32 id);
+
+    /**
+     * @brief 追加一条已经编码好的记录内容（不含记录头）。
+     */
+    void appendPayload(quint8 kind, quint32 id, const char *payload, int length);
+
+    /**
+     * @brief 把还没有凑满一块的记录编码成数据块。
+     */
+    void finish();
+
+    bool isEmpty() const;
+    int count() const;
+    const QByteArray &data() const;
+
+    /**
+     * @brief 这批记录写到数据文件 baseOffset 处之后对应的索引项。
+     */
+    QVector<UserIndex::Item> items(qint64 baseOffset) const;
+
+    void clear();
+
+private:
+    int beginRecord(quint8 kind, quint8 flags = 0);
+    quint32 endRecord(int start);
+    void appendItem(quint32 id, quint8 kind, int start, quint32 size, quint32 slot, quint32 bytes);
+
+    int m_blockSize;
+    const BlockCodec *m_codec;
+    QVector<User> m_pending;
+    QByteArray m_block;
+
+    QByteArray m_data;
+    QBuffer m_buffer;
+    QDataStream m_stream;
+    QVector<UserIndex::Item> m_items;
+};
+
+#endif // USERRECORDBUILDER_H
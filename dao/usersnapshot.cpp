@@ -0,0 +1,115 @@
+#include "usersnapshot.h"
+#include <QHash>
+#include <limits>
+
+#include "mappedfile.h"
+#include "userfilereader.h"
+#include "userblock.h"
+
+UserSnapshot::UserSnapshot(const QSharedPointer<const MappedFile> &map, qint64 size, quint64 epoch)
+    : m_map(map)
+    , m_size(map ? qMin(size, map->size()) : 0)
+    , m_epoch(epoch)
+{
+
+}
+
+UserSnapshot::~UserSnapshot()
+{
+
+}
+
+quint64 UserSnapshot::epoch() const
+{
+    return m_epoch;
+}
+
+qint64 UserSnapshot::size() const
+{
+    return m_size;
+}
+
+QVector<User> UserSnapshot::selectAll() const
+{
+    return selectRange(0, std::numeric_limits<quint32>::max());
+}
+
+QVector<User> UserSnapshot::selectRange(quint32 lo, quint32 hi) const
+{
+    QVector<User> users;
+    if (m_size <= 0)
+    {
+        return users;
+    }
+
+    // 每个 id 记下最后一条记录在 users 中的位置，被覆盖或删除的位置记为失效，最后统一去掉
+    QHash<quint32, int> latest;
+    QVector<bool> dead;
+    auto put = [&](const User &user) {
+        QHash<quint32, int>::iterator it = latest.find(user.id());
+        if (it != latest.end())
+        {
+            dead[it.value()] = true;
+            it.value() = users.size();
+        }
+        else
+        {
+            latest.insert(user.id(), users.size());
+        }
+        users.append(user);
+        dead.append(false);
+    };
+
+    bool all = lo == 0 && hi == std::numeric_limits<quint32>::max();
+    UserFileReader reader(m_map->data(), m_size);
+    UserRecord record;
+    while (reader.next(&record, false))
+    {
+        if (record.kind == UserFormat::BlockRecord)
+        {
+            UserBlock block(record.payload, record.length, record.flags);
+            QVector<int> slots;
+            if (!all)
+            {
+                slots = block.filterRange(lo, hi);
+            }
+
+            int count = all ? block.count() : slots.size();
+            for (int i = 0; i < count; ++i)
+            {
+                block.decodeUser(all ? i : slots.at(i), &record.user);
+                put(record.user);
+            }
+            continue;
+        }
+
+        if (record.id < lo || record.id > hi)
+        {
+            continue;
+        }
+        if (record.kind == UserFormat::RemoveRecord)
+        {
+            QHash<quint32, int>::iterator it = latest.find(record.id);
+            if (it != latest.end())
+            {
+                dead[it.value()] = true;
+                latest.erase(it);
+            }
+        }
+        else if (record.kind == UserFormat::PutRecord && UserFileReader::decodeUser(&record))
+        {
+            put(record.user);
+        }
+    }
+
+    int live = 0;
+    for (int i = 0; i < users.size(); ++i)
+    {
+        if (!dead.at(i))
+        {
+            users[live++] = users.at(i);
+        }
+    }
+    users.resize(live);
+    return users;
+}
@@ -0,0 +1,57 @@
+#ifndef USERSNAPSHOT_H
+#define USERSNAPSHOT_H
+
+#include <QSharedPointer>
+#include <QVector>
+#include "data/user.h"
+
+class MappedFile;
+
+/**
+ * @brief user.dat 在某次写入提交时的只读快照（见 UserDao::snapshot()）。
+ *
+ * 快照只读取数据文件中提交时已经完整写入的前 size() 字节，之后追加的记录不在读取范围内，
+ * 因此读者既看不到写了一半的记录，也不需要与写入者共用锁：查询时不访问 UserDao 的任何状态，
+ * 同一个 id 以快照范围内最后写入的记录为准，由扫描本身确定，不依赖会被写入者修改的内存索引。
+ *
+ * 同一个数据文件的各个快照共用一个映射（文件只追加，映射中前 size() 字节的内容不会再变），
+ * 最后一个引用释放时取消映射。压缩等操作用新文件替换原文件后，已有的快照仍然读取原来的映射；
+ * Windows 上映射中的文件不能改名，持有快照期间替换文件会失败（原文件保持不变）。
+ * 快照可以在多个线程中同时使用。
+ */
+class UserSnapshot
+{
+    Q_DISABLE_COPY(UserSnapshot)
+
+public:
+    /**
+     * @param map 数据文件的映射，长度不小于 size；size 为 0 时可以为空
+     * @param size 已经提交的长度
+     * @param epoch 提交的序号
+     */
+    UserSnapshot(const QSharedPointer<const MappedFile> &map, qint64 size, quint64 epoch);
+    ~UserSnapshot();
+
+    /**
+     * @brief 提交的序号，每次写入提交（以及压缩替换文件）加一，序号大的快照包含序号小的快照之后的写入
+     */
+    quint64 epoch() const;
+    qint64 size() const;
+
+    /**
+     * @brief 快照中的所有有效记录，顺序与 UserDao::selectAll() 相同（按记录在文件中的顺序）
+     */
+    QVector<User> selectAll() const;
+
+    /**
+     * @brief 快照中 id 在 [lo, hi] 范围内的有效记录。没有索引可用，总是扫描整个快照。
+     */
+    QVector<User> selectRange(quint32 lo, quint32 hi) const;
+
+private:
+    QSharedPointer<const MappedFile> m_map;
+    qint64 m_size;
+    quint64 m_epoch;
+};
+
+#endif // USERSNAPSHOT_H
@@ -0,0 +1,308 @@
+#include "userstats.h"
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QThread>
+#include <QWaitCondition>
+#include <QDebug>
+
+/**
+ * @brief 定期写统计结果的后台线程
+ */
+class UserStatsDumper : public QThread
+{
+public:
+    UserStatsDumper(const UserStats *stats, const QString &fileName, int interval)
+        : m_stats(stats)
+        , m_fileName(fileName)
+        , m_interval(interval)
+        , m_stopping(false)
+    {
+
+    }
+
+    void stop()
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_stopping = true;
+            m_wakeup.wakeAll();
+        }
+        wait();
+    }
+
+protected:
+    void run() override
+    {
+        QMutexLocker locker(&m_mutex);
+        while (!m_stopping)
+        {
+            m_wakeup.wait(&m_mutex, ulong(m_interval));
+            locker.unlock();
+            UserStats::writeJson(m_fileName, m_stats->toJson());
+            locker.relock();
+        }
+    }
+
+private:
+    const UserStats *m_stats;
+    QString m_fileName;
+    int m_interval;
+
+    QMutex m_mutex;
+    QWaitCondition m_wakeup;
+    bool m_stopping;
+};
+
+UserStats::Histogram::Histogram()
+    : count(0)
+    , totalNanos(0)
+    , maxNanos(0)
+    , buckets(BUCKET_COUNT, 0)
+{
+
+}
+
+qint64 UserStats::Histogram::percentile(double p) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    qint64 rank = qMax(qint64(1), qint64(p * count + 0.5));
+    qint64 seen = 0;
+    for (int i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets.at(i);
+        if (seen >= rank)
+        {
+            return qMin(maxNanos, (qint64(1) << (i + 1)) - 1);
+        }
+    }
+    return maxNanos;
+}
+
+QJsonObject UserStats::Histogram::toJson() const
+{
+    // 只输出到最后一个非空的桶
+    int used = buckets.size();
+    while (used > 0 && buckets.at(used - 1) == 0)
+    {
+        --used;
+    }
+    QJsonArray counts;
+    for (int i = 0; i < used; ++i)
+    {
+        counts.append(double(buckets.at(i)));
+    }
+
+    QJsonObject json;
+    json.insert("count", double(count));
+    json.insert("total_ns", double(totalNanos));
+    json.insert("mean_ns", count > 0 ? double(totalNanos) / count : 0.0);
+    json.insert("max_ns", double(maxNanos));
+    json.insert("p50_ns", double(percentile(0.5)));
+    json.insert("p90_ns", double(percentile(0.9)));
+    json.insert("p99_ns", double(percentile(0.99)));
+    json.insert("log2_buckets", counts);
+    return json;
+}
+
+UserStats::Scope::Scope(UserStats *stats, Operation operation)
+    : m_stats(stats->isEnabled() ? stats : nullptr)
+    , m_operation(operation)
+{
+    if (m_stats)
+    {
+        m_timer.start();
+    }
+}
+
+UserStats::Scope::~Scope()
+{
+    if (m_stats)
+    {
+        m_stats->record(m_operation, m_timer.nsecsElapsed());
+    }
+}
+
+UserStats::UserStats()
+    : m_enabled(0)
+    , m_dumper(nullptr)
+{
+    reset();
+}
+
+UserStats::~UserStats()
+{
+    stopDump();
+}
+
+void UserStats::setEnabled(bool enabled)
+{
+    m_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+void UserStats::add(UserStats::Counter counter, qint64 value)
+{
+    m_counters[counter].fetchAndAddRelaxed(value);
+}
+
+void UserStats::record(UserStats::Operation operation, qint64 nanos)
+{
+    OperationStats &stats = m_operations[operation];
+    stats.count.fetchAndAddRelaxed(1);
+    stats.totalNanos.fetchAndAddRelaxed(nanos);
+
+    qint64 max = stats.maxNanos.loadAcquire();
+    while (nanos > max && !stats.maxNanos.testAndSetOrdered(max, nanos, max))
+    {
+    }
+
+    int bucket = 0;
+    for (quint64 value = quint64(qMax(nanos, qint64(1))) >> 1; value; value >>= 1)
+    {
+        ++bucket;
+    }
+    stats.buckets[qMin(bucket, BUCKET_COUNT - 1)].fetchAndAddRelaxed(1);
+}
+
+qint64 UserStats::counter(UserStats::Counter counter) const
+{
+    return m_counters[counter].loadAcquire();
+}
+
+UserStats::Histogram UserStats::histogram(UserStats::Operation operation) const
+{
+    const OperationStats &stats = m_operations[operation];
+    Histogram histogram;
+    histogram.count = stats.count.loadAcquire();
+    histogram.totalNanos = stats.totalNanos.loadAcquire();
+    histogram.maxNanos = stats.maxNanos.loadAcquire();
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        histogram.buckets[i] = stats.buckets[i].loadAcquire();
+    }
+    return histogram;
+}
+
+void UserStats::reset()
+{
+    for (int i = 0; i < CounterCount; ++i)
+    {
+        m_counters[i].storeRelease(0);
+    }
+    for (int i = 0; i < OperationCount; ++i)
+    {
+        OperationStats &stats = m_operations[i];
+        stats.count.storeRelease(0);
+        stats.totalNanos.storeRelease(0);
+        stats.maxNanos.storeRelease(0);
+        for (int j = 0; j < BUCKET_COUNT; ++j)
+        {
+            stats.buckets[j].storeRelease(0);
+        }
+    }
+}
+
+QJsonObject UserStats::toJson() const
+{
+    QJsonObject counters;
+    for (int i = 0; i < CounterCount; ++i)
+    {
+        counters.insert(counterName(Counter(i)), double(counter(Counter(i))));
+    }
+
+    QJsonObject operations;
+    for (int i = 0; i < OperationCount; ++i)
+    {
+        Histogram histogram = this->histogram(Operation(i));
+        if (histogram.count > 0)
+        {
+            operations.insert(operationName(Operation(i)), histogram.toJson());
+        }
+    }
+
+    QJsonObject json;
+    json.insert("time", QDateTime::currentDateTime().toString(Qt::ISODate));
+    json.insert("enabled", isEnabled());
+    json.insert("counters", counters);
+    json.insert("operations", operations);
+    return json;
+}
+
+void UserStats::startDump(const QString &fileName, int interval)
+{
+    QMutexLocker locker(&m_dumpMutex);
+    if (m_dumper)
+    {
+        m_dumper->stop();
+        delete m_dumper;
+    }
+    m_dumper = new UserStatsDumper(this, fileName, qMax(1, interval));
+    m_dumper->start();
+}
+
+void UserStats::stopDump()
+{
+    QMutexLocker locker(&m_dumpMutex);
+    if (!m_dumper)
+    {
+        return;
+    }
+    m_dumper->stop();
+    delete m_dumper;
+    m_dumper = nullptr;
+}
+
+QString UserStats::counterName(UserStats::Counter counter)
+{
+    switch (counter)
+    {
+    case BytesRead:      return "bytes_read";
+    case BytesWritten:   return "bytes_written";
+    case RecordsDecoded: return "records_decoded";
+    case RecordsWritten: return "records_written";
+    case DeviceReads:    return "device_reads";
+    case DeviceWrites:   return "device_writes";
+    case Syncs:          return "syncs";
+    case IoNanos:        return "io_ns";
+    case DecodeNanos:    return "decode_ns";
+    default:             return QString();
+    }
+}
+
+QString UserStats::operationName(UserStats::Operation operation)
+{
+    switch (operation)
+    {
+    case Select:       return "select";
+    case SelectAll:    return "select_all";
+    case SelectRange:  return "select_range";
+    case SelectByName: return "select_by_name";
+    case Insert:       return "insert";
+    case Update:       return "update";
+    case Remove:       return "remove";
+    default:           return QString();
+    }
+}
+
+bool UserStats::writeJson(const QString &fileName, const QJsonObject &json)
+{
+    // QSaveFile 写临时文件，commit() 时用原子的改名替换原文件
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) {
+        qDebug() << QString::fromLocal8Bit("\n统计文件打开失败");
+        return false;
+    }
+    QByteArray content = QJsonDocument(json).toJson();
+    if (file.write(content) != content.size() || !file.commit())
+    {
+        qDebug() << QString::fromLocal8Bit("\n统计文件写入失败");
+        file.cancelWriting();
+        return false;
+    }
+    return true;
+}
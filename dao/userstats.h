@@ -0,0 +1,141 @@
+#ifndef USERSTATS_H
+#define USERSTATS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+class UserStatsDumper;
+
+/**
+ * @brief UserDao 的运行统计：读写的字节数和调用次数、fsync 次数、读设备与解码各自的耗时，
+ *        以及每种操作的延迟分布（按 2 的幂分桶的直方图）。
+ *
+ * 默认关闭，关闭时每次操作只多读一次原子变量。计数都是原子的，多个线程可以同时累加，
+ * 读取时各项之间不保证是同一时刻的值。可以通过 toJson() 随时查询，
+ * 也可以用 startDump() 在后台线程中定期把 JSON 写到文件里。
+ */
+class UserStats
+{
+    Q_DISABLE_COPY(UserStats)
+
+public:
+    enum Counter {
+        BytesRead,      ///< 读取的记录字节数（映射读取时是解析过的字节数）
+        BytesWritten,   ///< 写入数据文件的字节数
+        RecordsDecoded, ///< 解码出的 User 个数
+        RecordsWritten, ///< 写入的记录条数（含墓碑）
+        DeviceReads,    ///< 流式读取时对文件调用 read 的次数，映射读取不计
+        DeviceWrites,   ///< 对数据文件调用 write 的次数
+        Syncs,          ///< fsync 次数（含检查点和压缩）
+        IoNanos,        ///< 读写文件和 fsync 的耗时
+        DecodeNanos,    ///< 读取操作中除去读设备之外的耗时，即解析、解码和构造 QString 的耗时
+        CounterCount
+    };
+
+    enum Operation {
+        Select,
+        SelectAll,
+        SelectRange,
+        SelectByName,
+        Insert,
+        Update,
+        Remove,
+        OperationCount
+    };
+
+    /**
+     * @brief 一种操作的延迟分布。第 i 个桶是耗时在 [2^i, 2^(i+1)) 纳秒内的次数（第 0 个桶包括 0）
+     */
+    struct Histogram
+    {
+        qint64 count;
+        qint64 totalNanos;
+        qint64 maxNanos;
+        QVector<qint64> buckets;
+
+        Histogram();
+
+        /**
+         * @brief 估计的分位数（纳秒），取所在桶的上界，不超过 maxNanos
+         * @param p 0 到 1 之间
+         */
+        qint64 percentile(double p) const;
+        QJsonObject toJson() const;
+    };
+
+    /**
+     * @brief 统计一次操作的耗时，析构时计入直方图；统计关闭时什么也不做
+     */
+    class Scope
+    {
+    public:
+        Scope(UserStats *stats, Operation operation);
+        ~Scope();
+
+    private:
+        UserStats *m_stats;
+        Operation m_operation;
+        QElapsedTimer m_timer;
+    };
+
+    static const int BUCKET_COUNT = 48;
+
+    UserStats();
+    ~UserStats();
+
+    bool isEnabled() const
+    {
+        return m_enabled.loadAcquire() != 0;
+    }
+    void setEnabled(bool enabled);
+
+    void add(Counter counter, qint64 value);
+    void record(Operation operation, qint64 nanos);
+
+    qint64 counter(Counter counter) const;
+    Histogram histogram(Operation operation) const;
+
+    /**
+     * @brief 清零所有计数和直方图，不改变是否开启
+     */
+    void reset();
+
+    QJsonObject toJson() const;
+
+    /**
+     * @brief 每隔 interval 毫秒把 toJson() 写到 fileName（先写临时文件再替换），已经在写时先停止。
+     *        停止时再写最后一次。
+     */
+    void startDump(const QString &fileName, int interval = 1000);
+    void stopDump();
+
+    static QString counterName(Counter counter);
+    static QString operationName(Operation operation);
+
+    /**
+     * @brief 把 JSON 写到文件：用 QSaveFile 先写临时文件再原子地替换，读者不会读到写了一半的内容
+     */
+    static bool writeJson(const QString &fileName, const QJsonObject &json);
+
+private:
+    struct OperationStats
+    {
+        QAtomicInteger<qint64> count;
+        QAtomicInteger<qint64> totalNanos;
+        QAtomicInteger<qint64> maxNanos;
+        QAtomicInteger<qint64> buckets[BUCKET_COUNT];
+    };
+
+    QAtomicInt m_enabled;
+    QAtomicInteger<qint64> m_counters[CounterCount];
+    OperationStats m_operations[OperationCount];
+
+    QMutex m_dumpMutex;
+    UserStatsDumper *m_dumper;
+};
+
+#endif // USERSTATS_H
@@ -0,0 +1,52 @@
+#ifndef USERSTORE_H
+#define USERSTORE_H
+
+#include <QString>
+#include <QVector>
+#include "data/user.h"
+
+/**
+ * @brief User 存储后端的公共接口。
+ *
+ * UserDao（user.dat）、ShardedUserDao 和 SqliteUserDao（SQLite，经 DBUtil）都实现这个接口，
+ * 只依赖这些操作的代码可以按部署环境选择后端，基准测试也通过它在同样的负载下比较各个后端。
+ * 各后端特有的功能（后台写入、快照、缓存、事务等）仍然通过具体的类使用。
+ */
+class UserStore
+{
+public:
+    virtual ~UserStore() {}
+
+    /**
+     * @brief 按 id 查询。
+     * @param user[out] 查到的记录
+     * @return 记录不存在时返回 false，user 不变
+     */
+    virtual bool select(quint32 id, User *user) = 0;
+    virtual bool contains(quint32 id) = 0;
+
+    virtual QVector<User> selectAll() = 0;
+
+    /**
+     * @brief 查询 id 在 [lo, hi] 范围内的所有记录
+     */
+    virtual QVector<User> selectRange(quint32 lo, quint32 hi) = 0;
+    virtual QVector<User> selectByName(const QString &userName) = 0;
+
+    /**
+     * @brief 插入（id 已经存在时覆盖）
+     */
+    virtual bool insert(const QVector<User> &users) = 0;
+
+    /**
+     * @brief 更新，有任何一个 id 不存在时不做修改并返回 false
+     */
+    virtual bool update(const QVector<User> &users) = 0;
+
+    /**
+     * @brief 删除，有任何一个 id 不存在时不做修改并返回 false
+     */
+    virtual bool remove(const QVector<User> &users) = 0;
+};
+
+#endif // USERSTORE_H
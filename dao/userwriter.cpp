@@ -0,0 +1,120 @@
+#include "userwriter.h"
+
+UserWriter::UserWriter(const WriteFunction &write, int maxBatch, int maxDelay)
+    : m_write(write)
+    , m_maxBatch(qMax(1, maxBatch))
+    , m_maxDelay(qMax(0, maxDelay))
+    , m_firstQueued(0)
+    , m_flushRequested(false)
+    , m_stopping(false)
+{
+    m_clock.start();
+    m_batch.reportStarted();
+    start();
+}
+
+UserWriter::~UserWriter()
+{
+    stop();
+}
+
+QFuture<bool> UserWriter::enqueue(const User &user)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_stopping)
+    {
+        QFutureInterface<bool> rejected;
+        rejected.reportStarted();
+        rejected.reportResult(false);
+        rejected.reportFinished();
+        return rejected.future();
+    }
+
+    if (m_queue.isEmpty())
+    {
+        m_firstQueued = m_clock.elapsed();
+        m_wakeup.wakeOne();
+    }
+    m_queue.append(user);
+    if (m_queue.size() >= m_maxBatch)
+    {
+        m_wakeup.wakeOne();
+    }
+    return m_batch.future();
+}
+
+bool UserWriter::flush()
+{
+    // 写线程按顺序处理批次，等最后提交的那一批即可
+    QFuture<bool> last;
+    {
+        QMutexLocker locker(&m_mutex);
+        last = m_inFlight;
+        if (!m_queue.isEmpty())
+        {
+            last = m_batch.future();
+            m_flushRequested = true;
+            m_wakeup.wakeOne();
+        }
+    }
+
+    last.waitForFinished();
+    return last.resultCount() == 0 || last.result();
+}
+
+void UserWriter::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wakeup.wakeOne();
+    }
+    wait();
+}
+
+int UserWriter::pending() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queue.size();
+}
+
+void UserWriter::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever
+    {
+        while (!m_stopping && m_queue.isEmpty())
+        {
+            m_wakeup.wait(&m_mutex);
+        }
+        if (m_queue.isEmpty())
+        {
+            break;
+        }
+
+        // 攒批：直到数量够了、等待超时、有人要求 flush 或者正在退出
+        while (!m_stopping && !m_flushRequested && m_queue.size() < m_maxBatch)
+        {
+            qint64 remaining = m_firstQueued + m_maxDelay - m_clock.elapsed();
+            if (remaining <= 0)
+            {
+                break;
+            }
+            m_wakeup.wait(&m_mutex, ulong(remaining));
+        }
+
+        QVector<User> users;
+        users.swap(m_queue);
+        QFutureInterface<bool> batch = m_batch;
+        m_batch = QFutureInterface<bool>();
+        m_batch.reportStarted();
+        m_inFlight = batch.future();
+        m_flushRequested = false;
+
+        locker.unlock();
+        bool ok = m_write(users);
+        batch.reportResult(ok);
+        batch.reportFinished();
+        locker.relock();
+    }
+}
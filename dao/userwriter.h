@@ -0,0 +1,74 @@
+#ifndef USERWRITER_H
+#define USERWRITER_H
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <functional>
+
+#include "data/user.h"
+
+/**
+ * @brief 后台写线程：多个线程提交的单条记录先放进队列，攒够 maxBatch 条或者
+ *        第一条记录等待超过 maxDelay 毫秒后，由写线程一次性写入。
+ *
+ * 同一批的记录共享一个 QFuture<bool>，在这一批写入（需要时包括 fsync）完成后给出结果，
+ * 调用者可以等待它确认落盘，也可以直接丢弃不管。
+ */
+class UserWriter : public QThread
+{
+public:
+    typedef std::function<bool(const QVector<User> &)> WriteFunction;
+
+    /**
+     * @param write 实际写入一批记录的函数，在写线程中调用
+     * @param maxBatch 每批最多的记录数
+     * @param maxDelay 第一条记录最多等待的毫秒数
+     */
+    UserWriter(const WriteFunction &write, int maxBatch, int maxDelay);
+    ~UserWriter();
+
+    /**
+     * @brief 把一条记录放进队列。
+     * @return 记录所在批次的写入结果
+     */
+    QFuture<bool> enqueue(const User &user);
+
+    /**
+     * @brief 立即写入队列中的记录，并等待所有已提交的记录写完。
+     * @return 最后一批的写入结果
+     */
+    bool flush();
+
+    /**
+     * @brief 写完队列中剩余的记录后结束写线程。
+     */
+    void stop();
+
+    int pending() const;
+
+protected:
+    void run() override;
+
+private:
+    WriteFunction m_write;
+    int m_maxBatch;
+    int m_maxDelay;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wakeup;
+    QElapsedTimer m_clock;
+
+    QVector<User> m_queue;
+    QFutureInterface<bool> m_batch;
+    QFuture<bool> m_inFlight;
+    qint64 m_firstQueued;
+    bool m_flushRequested;
+    bool m_stopping;
+};
+
+#endif // USERWRITER_H
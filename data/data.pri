@@ -0,0 +1,7 @@
+HEADERS += \
+    $$PWD/user.h \
+    $$PWD/userbatch.h
+
+SOURCES += \
+    $$PWD/user.cpp \
+    $$PWD/userbatch.cpp
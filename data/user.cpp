@@ -23,17 +23,13 @@ User::~User()
 
 QDataStream& operator<<(QDataStream &out, const User &user)
 {
-    out << user.m_id
-        << user.m_userName
-        << user.m_password;
+    Serializer<User>::write(out, user);
     return out;
 }
 
 QDataStream& operator>>(QDataStream &in, User &user)
 {
-    in >> user.m_id
-       >> user.m_userName
-       >> user.m_password;
+    Serializer<User>::read(in, &user);
     return in;
 }
 
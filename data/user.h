@@ -4,7 +4,14 @@
 #include <QObject>
 #include <QDataStream>
 
-class User
+#include "include/serializefields.h"
+
+/**
+ * @brief 用户记录。通过 FieldSerializable 实现 SerializeInterface，可以单独写入文件、
+ *        用 serializedSize() / serializeBinary(uchar *, ...) 编码到调用者的缓冲区，
+ *        或者用 SerializeInterface::serializeBatch() 把一批记录编码到同一块缓冲区中。
+ */
+class User : public FieldSerializable<User>
 {
 public:
     User();
@@ -27,6 +34,15 @@ private:
     quint32 m_id;
     QString m_userName;
     QString m_password;
+
+public:
+    /**
+     * @brief 参与序列化的字段及顺序，operator<< / operator>> 按它生成
+     */
+    typedef SerializeFields<
+        SERIALIZE_FIELD(User, m_id),
+        SERIALIZE_FIELD(User, m_userName),
+        SERIALIZE_FIELD(User, m_password)> Fields;
 };
 
 #endif // USER_H
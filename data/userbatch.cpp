@@ -0,0 +1,125 @@
+#include "userbatch.h"
+
+UserView::UserView(const UserBatch *batch, int row)
+    : m_batch(batch)
+    , m_row(row)
+{
+
+}
+
+quint32 UserView::id() const
+{
+    return m_batch->m_rows.at(m_row).id;
+}
+
+QStringRef UserView::userName() const
+{
+    const UserBatch::Row &row = m_batch->m_rows.at(m_row);
+    return m_batch->ref(row.userName, row.userNameSize);
+}
+
+QStringRef UserView::password() const
+{
+    const UserBatch::Row &row = m_batch->m_rows.at(m_row);
+    return m_batch->ref(row.password, row.passwordSize);
+}
+
+User UserView::toUser() const
+{
+    return User(id(), userName().toString(), password().toString());
+}
+
+UserBatch::UserBatch()
+{
+
+}
+
+void UserBatch::reserve(int rows, int units)
+{
+    m_rows.reserve(rows);
+    if (units > 0)
+    {
+        m_strings.reserve(units);
+    }
+}
+
+void UserBatch::append(const User &user)
+{
+    append(user.id(), user.userName(), user.password());
+}
+
+void UserBatch::append(quint32 id, const QString &userName, const QString &password)
+{
+    Row row;
+    row.id = id;
+    row.userName = store(userName, &row.userNameSize);
+    row.password = store(password, &row.passwordSize);
+    m_rows.append(row);
+}
+
+void UserBatch::append(const UserBatch &other)
+{
+    int base = m_strings.size();
+    m_strings.append(other.m_strings);
+    m_rows.reserve(m_rows.size() + other.m_rows.size());
+    foreach (Row row, other.m_rows)
+    {
+        row.userName += base;
+        row.password += base;
+        m_rows.append(row);
+    }
+}
+
+void UserBatch::clear()
+{
+    m_rows.clear();
+    m_strings.clear();
+}
+
+int UserBatch::size() const
+{
+    return m_rows.size();
+}
+
+bool UserBatch::isEmpty() const
+{
+    return m_rows.isEmpty();
+}
+
+UserView UserBatch::at(int row) const
+{
+    return UserView(this, row);
+}
+
+QVector<User> UserBatch::toVector() const
+{
+    QVector<User> users;
+    users.reserve(m_rows.size());
+    for (int i = 0; i < m_rows.size(); ++i)
+    {
+        users.append(at(i).toUser());
+    }
+    return users;
+}
+
+qint64 UserBatch::stringBytes() const
+{
+    return qint64(m_strings.capacity()) * qint64(sizeof(QChar));
+}
+
+int UserBatch::store(const QString &str, int *size)
+{
+    int position = m_strings.size();
+    *size = str.isNull() ? -1 : str.size();
+    m_strings.append(str);
+    return position;
+}
+
+QStringRef UserBatch::ref(int position, int size) const
+{
+    if (size < 0)
+    {
+        return QStringRef();
+    }
+    return QStringRef(&m_strings, position, size);
+}
@@ -0,0 +1,104 @@
+#ifndef USERBATCH_H
+#define USERBATCH_H
+
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+#include "user.h"
+
+class UserBatch;
+
+/**
+ * @brief UserBatch 中一条记录的只读视图，字符串直接引用批次的存储，不复制。
+ *        只在批次存在并且没有继续追加记录期间有效，需要保留时用 toUser() 转换。
+ */
+class UserView
+{
+public:
+    quint32 id() const;
+    QStringRef userName() const;
+    QStringRef password() const;
+
+    /**
+     * @brief 复制成独立的 User（两个字符串各分配一次内存）
+     */
+    User toUser() const;
+
+private:
+    friend class UserBatch;
+    UserView(const UserBatch *batch, int row);
+
+    const UserBatch *m_batch;
+    int m_row;
+};
+
+/**
+ * @brief 一批 User：所有字符串的内容连续存放在同一块存储中，每条记录只记录 id 和字符串的位置。
+ *
+ * 读出大量记录时用它代替 QVector<User>，不需要为每条记录的两个字符串分别分配内存，
+ * 存储按倍数增长，整批一次释放。通过 at() 得到的 UserView 访问记录。
+ */
+class UserBatch
+{
+public:
+    UserBatch();
+
+    /**
+     * @brief 预留记录数和字符串的总长度（UTF-16 码元个数）
+     */
+    void reserve(int rows, int units = 0);
+
+    /**
+     * @brief 追加一条记录，复制字符串的内容
+     */
+    void append(const User &user);
+    void append(quint32 id, const QString &userName, const QString &password);
+
+    /**
+     * @brief 追加另一批记录的全部内容
+     */
+    void append(const UserBatch &other);
+
+    void clear();
+
+    int size() const;
+    bool isEmpty() const;
+    UserView at(int row) const;
+
+    /**
+     * @brief 转换成独立的 User 列表
+     */
+    QVector<User> toVector() const;
+
+    /**
+     * @brief 字符串存储占用的字节数
+     */
+    qint64 stringBytes() const;
+
+private:
+    friend class UserView;
+
+    struct Row
+    {
+        quint32 id;
+        int userName;     ///< 在 m_strings 中的位置
+        int userNameSize; ///< -1 表示 null
+        int password;
+        int passwordSize;
+    };
+
+    /**
+     * @brief 把 str 追加到存储中
+     * @param size[out] 长度，null 字符串为 -1
+     * @return 位置
+     */
+    int store(const QString &str, int *size);
+
+    QStringRef ref(int position, int size) const;
+
+    QVector<Row> m_rows;
+    QString m_strings;
+};
+
+#endif // USERBATCH_H
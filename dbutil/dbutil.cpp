@@ -4,8 +4,19 @@
 
 DBUtil::DBUtil()
 {
-    QSqlDatabase db = ConnectionPool().getConnection()->database();
-    m_query = new QSqlQuery(db);
+    m_database = ConnectionPool().getConnection()->database();
+    m_query = new QSqlQuery(m_database);
+}
+
+DBUtil::DBUtil(const QSqlDatabase &database)
+    : m_database(database)
+{
+    m_query = new QSqlQuery(m_database);
+}
+
+DBUtil::~DBUtil()
+{
+    delete m_query;
 }
 
 int DBUtil::insert(const QString &sql, const QVariantMap &params) {
@@ -29,7 +40,7 @@ bool DBUtil::insertBatch(const QString &sql, const QList<QVariantMap> &params)
 }
 
 bool DBUtil::update(const QString &sql, const QVariantMap &params) {
-    bool result;
+    bool result = false;
 
     executeSql(sql, params, [&result](QSqlQuery *query) {
         result = query->lastError().type() == QSqlError::NoError;
@@ -40,7 +51,7 @@ bool DBUtil::update(const QString &sql, const QVariantMap &params) {
 
 bool DBUtil::updateBatch(const QString &sql, const QList<QVariantMap> &params)
 {
-    bool result;
+    bool result = false;
 
     executeBatchSql(sql, params, [&result](QSqlQuery *query) {
         result = query->lastError().type() == QSqlError::NoError;
@@ -83,20 +94,17 @@ QVariant DBUtil::selectVariant(const QString &sql, const QVariantMap &params) {
 
 bool DBUtil::transaction()
 {
-    QSqlDatabase db = ConnectionPool().getConnection()->database();
-    return db.transaction();
+    return m_database.transaction();
 }
 
 bool DBUtil::commit()
 {
-    QSqlDatabase db = ConnectionPool().getConnection()->database();
-    return db.commit();
+    return m_database.commit();
 }
 
 bool DBUtil::roolback()
 {
-    QSqlDatabase db = ConnectionPool().getConnection()->database();
-    return db.rollback();
+    return m_database.rollback();
 }
 
 QString DBUtil::lastError()
@@ -148,13 +156,20 @@ void DBUtil::bindValues(QSqlQuery *query, const QVariantMap &params)
 
 void DBUtil::bindBatchValues(QSqlQuery *query, const QList<QVariantMap> &params)
 {
-    foreach (auto param, params)
+    // execBatch() 要求每个参数绑定一个 QVariantList，第 i 个元素是第 i 个 map 中的值
+    QMap<QString, QVariantList> columns;
+    foreach (const QVariantMap &param, params)
     {
         for (QVariantMap::const_iterator i=param.constBegin(); i!=param.constEnd(); ++i)
         {
-            query->bindValue(":" + i.key(), i.value());
+            columns[i.key()].append(i.value());
         }
     }
+
+    for (QMap<QString, QVariantList>::const_iterator i=columns.constBegin(); i!=columns.constEnd(); ++i)
+    {
+        query->bindValue(":" + i.key(), i.value());
+    }
 }
 
 QStringList DBUtil::getFieldNames(const QSqlQuery &query)
@@ -219,6 +234,22 @@ void DBUtil::debug(const QSqlQuery &query)
     }
 }
 
+bool DBUtil::prepare(const QString &sql)
+{
+    if (sql == m_preparedSql)
+    {
+        return true;
+    }
+
+    m_query->setForwardOnly(true);//结果集仅向前，可以更有效地利用内存，它还将提高某些数据库的性能
+    if (!m_query->prepare(sql))
+    {
+        m_preparedSql.clear();
+        return false;
+    }
+    m_preparedSql = sql;
+    return true;
+}
 
 template<typename T>
 QList<T> DBUtil::selectBeans(const T &mapToBean(const QVariantMap &), const QString &sql, const QVariantMap &params)
@@ -236,12 +267,11 @@ QList<T> DBUtil::selectBeans(const T &mapToBean(const QVariantMap &), const QStr
 template<typename T>
 void DBUtil::executeSql(const QString &sql, const QVariantMap &params, const T &t)
 {
+    if (prepare(sql)) {
+        bindValues(m_query, params);
+    }
 
-    m_query->setForwardOnly(true);//结果集仅向前，可以更有效地利用内存，它还将提高某些数据库的性能
-    m_query->prepare(sql);
-    bindValues(m_query, params);
-
-    if (m_query->exec()) {
+    if (!m_preparedSql.isEmpty() && m_query->exec()) {
         t(m_query);
     }
     debug(*m_query, params);
@@ -250,13 +280,44 @@ void DBUtil::executeSql(const QString &sql, const QVariantMap &params, const T &
 template<typename T>
 void DBUtil::executeBatchSql(const QString &sql, const QList<QVariantMap> &params, const T &t)
 {
+    if (prepare(sql)) {
+        bindBatchValues(m_query, params);
+    }
 
-    m_query->setForwardOnly(true);//结果集仅向前，可以更有效地利用内存，它还将提高某些数据库的性能
-    m_query->prepare(sql);
-    bindBatchValues(m_query, params);
-
-    if (m_query->execBatch()) {
+    if (!m_preparedSql.isEmpty() && m_query->execBatch()) {
         t(m_query);
     }
     debug(*m_query);
 }
+
+void DBUtil::executeSql(const QString &sql, const QVariantMap &params)
+{
+    executeSql(sql, params, [](QSqlQuery *) {});
+}
+
+void DBUtil::executeBatchSql(const QString &sql, const QVariantMap &params)
+{
+    if (prepare(sql)) {
+        bindValues(m_query, params);
+    }
+
+    if (!m_preparedSql.isEmpty()) {
+        m_query->execBatch();
+    }
+    debug(*m_query, params);
+}
+
+bool DBUtil::next()
+{
+    return m_query->next();
+}
+
+QVariant DBUtil::value(int i)
+{
+    return m_query->value(i);
+}
+
+QVariant DBUtil::value(const QString &name)
+{
+    return m_query->value(name);
+}
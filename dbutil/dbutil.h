@@ -17,6 +17,11 @@
  * 1.将该类静态函数改为普通函数
  * 2.暴露执行SQL语句的函数，和处理结果集的函数，executeSql() next() value()等。
  * 3.添加批量执行SQL的方法。
+ *
+ * 2026/10/17
+ * 1.添加 DBUtil(const QSqlDatabase &database)，直接使用指定的连接，不经过连接池；事务在同一个连接上执行。
+ * 2.实现 executeSql() executeBatchSql() next() value()，修正批量绑定参数（每个参数绑定一列值）。
+ * 3.同一个 SQL 连续执行时复用已经 prepare 的语句；析构时释放 query。
  *****************************************************************************/
 
 #ifndef DBUTIL_H
@@ -64,9 +69,20 @@
  * 2.具体使用 mainwindow插件下的 loglist.cpp 构造函数
  */
 class DBUTILSHARED_EXPORT DBUtil {
+    Q_DISABLE_COPY(DBUtil)
+
 public:
     DBUtil();
 
+    /**
+     * 使用指定的数据库连接（不经过连接池），例如程序自己打开的 SQLite 数据库。
+     * 连接只能在创建它的线程中使用，DBUtil 也一样。
+     *
+     * @param database 已经打开的连接
+     */
+    explicit DBUtil(const QSqlDatabase &database);
+    ~DBUtil();
+
     /**
      * 执行插入语句，并返回插入行的 id.
      *
@@ -251,7 +267,7 @@ public:
      * （公开，批量执行结果在外部处理）执行sql语句，执行的结果在外部使用 next() value()函数来处理。
      *
      * @param sql
-     * @param params
+     * @param params - 每个参数的值是一个 QVariantList，第 i 个元素用于第 i 次执行
      */
     void executeBatchSql(const QString &sql, const QVariantMap &params = QVariantMap());
 
@@ -345,7 +361,17 @@ private:
      */
     void debug(const QSqlQuery &query);
 
+    /**
+     * 准备执行 sql，与上一次执行的 sql 相同时复用已经 prepare 的语句.
+     *
+     * @param sql
+     * @return prepare 失败返回 false.
+     */
+    bool prepare(const QString &sql);
+
+    QSqlDatabase m_database;
     QSqlQuery *m_query;
+    QString m_preparedSql; // m_query 当前 prepare 的 SQL，prepare 失败时为空
 };
 
 #endif // DBUTIL_H
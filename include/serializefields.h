@@ -0,0 +1,1262 @@
+#ifndef SERIALIZEFIELDS_H
+#define SERIALIZEFIELDS_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include <QtEndian>
+#include <climits>
+#include <cstring>
+#include <type_traits>
+
+#include "serializeinterface.h"
+#include "utf8string.h"
+
+/**
+ * @brief 按字段列表在编译期生成二进制序列化代码（只有头文件）。
+ *
+ * 类在定义中声明一次字段列表，之后编码、解码、计算长度都由模板生成，不需要再手写 operator<< / operator>>：
+ *
+ *     class Point
+ *     {
+ *     ...
+ *     private:
+ *         qint32 m_x;
+ *         qint32 m_y;
+ *         QString m_name;
+ *
+ *     public:
+ *         typedef SerializeFields<
+ *             SERIALIZE_FIELD(Point, m_x),
+ *             SERIALIZE_FIELD(Point, m_y),
+ *             SERIALIZE_FIELD(Point, m_name)> Fields;
+ *     };
+ *
+ *     QByteArray bytes = Serializer<Point>::encode(point);
+ *
+ * 格式有两个版本（SerializeVersion），默认的 SerializeDataStreamVersion 与按同样顺序逐个字段写入
+ * QDataStream（默认设置）完全相同：整数按字节顺序写入，QString/QByteArray 是 quint32 长度（null 为 0xffffffff）加内容，
+ * QVector/QList 是 quint32 个数加元素，唯一的区别是 float 按 4 字节写入（QDataStream 默认扩展成 double）。
+ * SerializeUtf8Version 只改变 QString 的格式：varint 长度加 UTF-8（见 Utf8String），ASCII 字符串只占一半的空间。
+ * SerializeVarintVersion 在此基础上把 2 字节以上的整数字段写成 LEB128 varint（有符号数先 zigzag），
+ * 小的数值只占 1、2 个字节；这时整数不再是定长的，isFixed/fixedSize 只对之前的版本成立。
+ *
+ * 连续的定长字段（整数、枚举、全部由定长字段组成的嵌套类型）在编译期合并成一段，
+ * 整段只检查一次长度，字节顺序与本机相同时每个字段直接 memcpy，从 QDataStream 读取时整段只调用一次 readRawData。
+ * 所有字段都是定长时 Serializer<T>::isFixed 为 true，长度 Serializer<T>::fixedSize 是编译期常量；
+ * 否则 serializedSize() 在编码前算出准确的长度，写入 QDataStream 时只分配一次缓冲区、调用一次 writeRawData。
+ *
+ * 继承 FieldSerializable<T> 即可用字段列表实现 SerializeInterface，写入时带文件头记录版本。
+ */
+
+/**
+ * @brief 序列化格式的版本
+ */
+enum SerializeVersion
+{
+    SerializeDataStreamVersion = 1, ///< 与 QDataStream 相同，QString 是 quint32 字节数 + UTF-16
+    SerializeUtf8Version       = 2, ///< QString 是 varint（UTF-8 字节数 + 1，0 表示 null）+ UTF-8
+    SerializeVarintVersion     = 3, ///< 同上，另外 2 字节以上的整数是 varint（有符号数 zigzag）
+    SerializeCurrentVersion    = SerializeVarintVersion
+};
+
+/**
+ * @brief 字段列表中的一项，用 SERIALIZE_FIELD 生成
+ */
+template <typename Class, typename Type, Type Class::*Member>
+struct SerializeField
+{
+    typedef Type ValueType;
+
+    static const Type &get(const Class &object)
+    {
+        return object.*Member;
+    }
+
+    static Type &get(Class &object)
+    {
+        return object.*Member;
+    }
+};
+
+#define SERIALIZE_FIELD(Class, member) \
+    SerializeField<Class, decltype(Class::member), &Class::member>
+
+template <typename T, typename Enable = void>
+struct FieldCodec;
+
+template <typename... Fields>
+struct SerializeFields;
+
+namespace SerializeDetail {
+
+/**
+ * @brief 一次编码或解码使用的格式：swap 表示字节顺序与本机相反，utf8 表示 QString 使用 SerializeUtf8Version 的格式，
+ *        varint 表示整数使用 SerializeVarintVersion 的格式
+ */
+struct Format
+{
+    bool swap;
+    bool utf8;
+    bool varint;
+};
+
+/**
+ * @brief 按字节顺序复制 size 字节，swap 为 true 时反转字节
+ */
+inline void copy(const void *from, void *to, size_t size, bool swap)
+{
+    if (!swap || size == 1)
+    {
+        memcpy(to, from, size);
+        return;
+    }
+    const uchar *in = static_cast<const uchar *>(from);
+    uchar *out = static_cast<uchar *>(to);
+    for (size_t i = 0; i < size; ++i)
+    {
+        out[i] = in[size - 1 - i];
+    }
+}
+
+inline bool needSwap(QDataStream::ByteOrder order)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    return order == QDataStream::BigEndian;
+#else
+    return order == QDataStream::LittleEndian;
+#endif
+}
+
+inline Format format(QDataStream::ByteOrder order, int version)
+{
+    Format format;
+    format.swap = needSwap(order);
+    format.utf8 = version >= SerializeUtf8Version;
+    format.varint = version >= SerializeVarintVersion;
+    return format;
+}
+
+template <typename T>
+struct HasFields
+{
+    template <typename U> static char test(typename U::Fields *);
+    template <typename U> static long test(...);
+    static const bool value = sizeof(test<T>(nullptr)) == sizeof(char);
+};
+
+/**
+ * @brief 长度前缀：quint32，null 的 QString/QByteArray 为 0xffffffff
+ */
+inline qint64 encodeLength(quint32 length, uchar *out, qint64 capacity, bool swap)
+{
+    if (capacity < qint64(sizeof(quint32)))
+    {
+        return -1;
+    }
+    copy(&length, out, sizeof(quint32), swap);
+    return sizeof(quint32);
+}
+
+inline qint64 decodeLength(const uchar *data, qint64 size, quint32 *length, bool swap)
+{
+    if (size < qint64(sizeof(quint32)))
+    {
+        return -1;
+    }
+    copy(data, length, sizeof(quint32), swap);
+    return sizeof(quint32);
+}
+
+inline bool readLength(QDataStream &stream, quint32 *length, bool swap)
+{
+    uchar bytes[sizeof(quint32)];
+    if (stream.readRawData(reinterpret_cast<char *>(bytes), sizeof(bytes)) != int(sizeof(bytes)))
+    {
+        stream.setStatus(QDataStream::ReadPastEnd);
+        return false;
+    }
+    copy(bytes, length, sizeof(quint32), swap);
+    return true;
+}
+
+/**
+ * @brief varint（LEB128，每字节低 7 位，最高位表示后面还有字节），不受字节顺序影响
+ */
+inline int varintSize(quint64 value)
+{
+    int size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+inline int putVarint(quint64 value, uchar *out)
+{
+    int size = 0;
+    while (value >= 0x80)
+    {
+        out[size++] = uchar(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = uchar(value);
+    return size;
+}
+
+/**
+ * @return 占用的字节数，数据不完整或者超过 UInt 的最大长度（quint32 为 5 字节）时返回 -1
+ */
+template <typename UInt>
+inline qint64 getVarint(const uchar *data, qint64 size, UInt *value)
+{
+    const int maxSize = (sizeof(UInt) * 8 + 6) / 7;
+    UInt result = 0;
+    for (int i = 0; i < maxSize && i < size; ++i)
+    {
+        result |= UInt(data[i] & 0x7f) << (7 * i);
+        if (!(data[i] & 0x80))
+        {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+template <typename UInt>
+inline bool readVarint(QDataStream &stream, UInt *value)
+{
+    const int maxSize = (sizeof(UInt) * 8 + 6) / 7;
+    uchar bytes[10];
+    for (int i = 0; i < maxSize; ++i)
+    {
+        if (stream.readRawData(reinterpret_cast<char *>(bytes + i), 1) != 1)
+        {
+            stream.setStatus(QDataStream::ReadPastEnd);
+            return false;
+        }
+        if (!(bytes[i] & 0x80))
+        {
+            getVarint(bytes, i + 1, value);
+            return true;
+        }
+    }
+    stream.setStatus(QDataStream::ReadCorruptData);
+    return false;
+}
+
+/**
+ * @brief UTF-16 码元按字节顺序复制，swap 为 true 时交换每个码元的两个字节
+ */
+inline void copyUtf16(const void *from, void *to, int length, bool swap)
+{
+    if (!swap)
+    {
+        memcpy(to, from, size_t(length) * 2);
+        return;
+    }
+    const uchar *in = static_cast<const uchar *>(from);
+    uchar *out = static_cast<uchar *>(to);
+    for (int i = 0; i < length; ++i)
+    {
+        // from 和 to 可以是同一块内存（读取后原地转换）
+        uchar high = in[i * 2];
+        out[i * 2] = in[i * 2 + 1];
+        out[i * 2 + 1] = high;
+    }
+}
+
+} // namespace SerializeDetail
+
+/**
+ * @brief 整数、浮点数、枚举：按 sizeof(T) 字节写入。
+ *        SerializeVarintVersion 中 2 字节以上的整数写成 varint，有符号数先 zigzag（-1 -> 1，1 -> 2）
+ */
+template <typename T>
+struct FieldCodec<T, typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type>
+{
+    static const bool isFixed = true;
+    static const qint64 fixedSize = sizeof(T);
+    static const bool isVarint = std::is_integral<T>::value && sizeof(T) > 1;
+
+    typedef typename std::make_unsigned<typename std::conditional<isVarint, T, int>::type>::type Unsigned;
+
+    static qint64 size(const T &value, SerializeDetail::Format format)
+    {
+        if (isVarint && format.varint)
+        {
+            return SerializeDetail::varintSize(zigzag(value));
+        }
+        return sizeof(T);
+    }
+
+    static void put(const T &value, uchar *out, bool swap)
+    {
+        SerializeDetail::copy(&value, out, sizeof(T), swap);
+    }
+
+    static void get(const uchar *data, T *value, bool swap)
+    {
+        SerializeDetail::copy(data, value, sizeof(T), swap);
+    }
+
+    static qint64 encode(const T &value, uchar *out, qint64 capacity, SerializeDetail::Format format)
+    {
+        if (isVarint && format.varint)
+        {
+            Unsigned bits = zigzag(value);
+            if (capacity < SerializeDetail::varintSize(bits))
+            {
+                return -1;
+            }
+            return SerializeDetail::putVarint(bits, out);
+        }
+        if (capacity < fixedSize)
+        {
+            return -1;
+        }
+        put(value, out, format.swap);
+        return fixedSize;
+    }
+
+    static qint64 decode(const uchar *data, qint64 size, T *value, SerializeDetail::Format format)
+    {
+        if (isVarint && format.varint)
+        {
+            Unsigned bits = 0;
+            qint64 used = SerializeDetail::getVarint(data, size, &bits);
+            if (used >= 0)
+            {
+                *value = unzigzag(bits);
+            }
+            return used;
+        }
+        if (size < fixedSize)
+        {
+            return -1;
+        }
+        get(data, value, format.swap);
+        return fixedSize;
+    }
+
+    static bool read(QDataStream &stream, T *value, SerializeDetail::Format format)
+    {
+        if (isVarint && format.varint)
+        {
+            Unsigned bits = 0;
+            if (!SerializeDetail::readVarint(stream, &bits))
+            {
+                return false;
+            }
+            *value = unzigzag(bits);
+            return true;
+        }
+        uchar bytes[sizeof(T)];
+        if (stream.readRawData(reinterpret_cast<char *>(bytes), sizeof(T)) != int(sizeof(T)))
+        {
+            stream.setStatus(QDataStream::ReadPastEnd);
+            return false;
+        }
+        get(bytes, value, format.swap);
+        return true;
+    }
+
+    static Unsigned zigzag(const T &value)
+    {
+        Unsigned bits = Unsigned(value);
+        if (!std::is_signed<T>::value)
+        {
+            return bits;
+        }
+        Unsigned sign = bits >> (sizeof(Unsigned) * 8 - 1);
+        return Unsigned(bits << 1) ^ Unsigned(Unsigned(0) - sign);
+    }
+
+    static T unzigzag(Unsigned bits)
+    {
+        if (!std::is_signed<T>::value)
+        {
+            return T(bits);
+        }
+        return T(Unsigned(bits >> 1) ^ Unsigned(Unsigned(0) - (bits & 1)));
+    }
+};
+
+/**
+ * @brief QString：SerializeDataStreamVersion 是 quint32 字节数（null 为 0xffffffff）+ UTF-16，
+ *        SerializeUtf8Version 是 varint（UTF-8 字节数 + 1，null 为 0）+ UTF-8
+ */
+template <>
+struct FieldCodec<QString>
+{
+    static const bool isFixed = false;
+    static const qint64 fixedSize = 0;
+    static const bool isVarint = false;
+
+    static qint64 size(const QString &value, SerializeDetail::Format format)
+    {
+        if (format.utf8)
+        {
+            if (value.isNull())
+            {
+                return 1;
+            }
+            int bytes = Utf8String::size(value);
+            return SerializeDetail::varintSize(quint32(bytes) + 1) + bytes;
+        }
+        return sizeof(quint32) + (value.isNull() ? 0 : qint64(value.size()) * 2);
+    }
+
+    static qint64 encode(const QString &value, uchar *out, qint64 capacity, SerializeDetail::Format format)
+    {
+        if (format.utf8)
+        {
+            return encodeUtf8(value, out, capacity);
+        }
+        if (value.isNull())
+        {
+            return SerializeDetail::encodeLength(0xffffffff, out, capacity, format.swap);
+        }
+        qint64 bytes = qint64(value.size()) * 2;
+        if (capacity < qint64(sizeof(quint32)) + bytes)
+        {
+            return -1;
+        }
+        SerializeDetail::encodeLength(quint32(bytes), out, capacity, format.swap);
+        SerializeDetail::copyUtf16(value.utf16(), out + sizeof(quint32), value.size(), format.swap);
+        return sizeof(quint32) + bytes;
+    }
+
+    static qint64 decode(const uchar *data, qint64 size, QString *value, SerializeDetail::Format format)
+    {
+        if (format.utf8)
+        {
+            return decodeUtf8(data, size, value);
+        }
+        quint32 bytes = 0;
+        if (SerializeDetail::decodeLength(data, size, &bytes, format.swap) < 0)
+        {
+            return -1;
+        }
+        if (bytes == 0xffffffff)
+        {
+            *value = QString();
+            return sizeof(quint32);
+        }
+        if ((bytes & 1) || qint64(bytes) > size - qint64(sizeof(quint32)))
+        {
+            return -1;
+        }
+        value->resize(int(bytes / 2));
+        SerializeDetail::copyUtf16(data + sizeof(quint32), value->data(), value->size(), format.swap);
+        return sizeof(quint32) + bytes;
+    }
+
+    static bool read(QDataStream &stream, QString *value, SerializeDetail::Format format)
+    {
+        if (format.utf8)
+        {
+            return readUtf8(stream, value);
+        }
+        quint32 bytes = 0;
+        if (!SerializeDetail::readLength(stream, &bytes, format.swap))
+        {
+            return false;
+        }
+        if (bytes == 0xffffffff)
+        {
+            *value = QString();
+            return true;
+        }
+        if (bytes & 1)
+        {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            return false;
+        }
+        value->resize(int(bytes / 2));
+        if (stream.readRawData(reinterpret_cast<char *>(value->data()), int(bytes)) != int(bytes))
+        {
+            stream.setStatus(QDataStream::ReadPastEnd);
+            return false;
+        }
+        if (format.swap)
+        {
+            SerializeDetail::copyUtf16(value->data(), value->data(), value->size(), true);
+        }
+        return true;
+    }
+
+    static qint64 encodeUtf8(const QString &value, uchar *out, qint64 capacity)
+    {
+        if (value.isNull())
+        {
+            if (capacity < 1)
+            {
+                return -1;
+            }
+            out[0] = 0;
+            return 1;
+        }
+        // UTF-8 的长度要先算出来才能写前缀，字符串一般很短，多扫一遍比事后移动内容便宜
+        int bytes = Utf8String::size(value);
+        int prefix = SerializeDetail::varintSize(quint32(bytes) + 1);
+        if (capacity < qint64(prefix) + bytes)
+        {
+            return -1;
+        }
+        SerializeDetail::putVarint(quint32(bytes) + 1, out);
+        Utf8String::encode(value, out + prefix);
+        return prefix + bytes;
+    }
+
+    static qint64 decodeUtf8(const uchar *data, qint64 size, QString *value)
+    {
+        quint32 length = 0;
+        qint64 prefix = SerializeDetail::getVarint(data, size, &length);
+        if (prefix < 0)
+        {
+            return -1;
+        }
+        if (length == 0)
+        {
+            *value = QString();
+            return prefix;
+        }
+        quint32 bytes = length - 1;
+        if (qint64(bytes) > size - prefix || !Utf8String::decode(data + prefix, int(bytes), value))
+        {
+            return -1;
+        }
+        return prefix + bytes;
+    }
+
+    static bool readUtf8(QDataStream &stream, QString *value)
+    {
+        quint32 length = 0;
+        if (!SerializeDetail::readVarint(stream, &length))
+        {
+            return false;
+        }
+        if (length == 0)
+        {
+            *value = QString();
+            return true;
+        }
+        int bytes = int(length - 1);
+        uchar local[256];
+        QByteArray heap;
+        uchar *buffer = local;
+        if (bytes > int(sizeof(local)))
+        {
+            heap.resize(bytes);
+            buffer = reinterpret_cast<uchar *>(heap.data());
+        }
+        if (stream.readRawData(reinterpret_cast<char *>(buffer), bytes) != bytes)
+        {
+            stream.setStatus(QDataStream::ReadPastEnd);
+            return false;
+        }
+        if (!Utf8String::decode(buffer, bytes, value))
+        {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief QByteArray：quint32 字节数（null 为 0xffffffff）+ 内容
+ */
+template <>
+struct FieldCodec<QByteArray>
+{
+    static const bool isFixed = false;
+    static const qint64 fixedSize = 0;
+    static const bool isVarint = false;
+
+    static qint64 size(const QByteArray &value, SerializeDetail::Format)
+    {
+        return sizeof(quint32) + (value.isNull() ? 0 : value.size());
+    }
+
+    static qint64 encode(const QByteArray &value, uchar *out, qint64 capacity, SerializeDetail::Format format)
+    {
+        if (value.isNull())
+        {
+            return SerializeDetail::encodeLength(0xffffffff, out, capacity, format.swap);
+        }
+        if (capacity < qint64(sizeof(quint32)) + value.size())
+        {
+            return -1;
+        }
+        SerializeDetail::encodeLength(quint32(value.size()), out, capacity, format.swap);
+        memcpy(out + sizeof(quint32), value.constData(), size_t(value.size()));
+        return sizeof(quint32) + value.size();
+    }
+
+    static qint64 decode(const uchar *data, qint64 size, QByteArray *value, SerializeDetail::Format format)
+    {
+        quint32 bytes = 0;
+        if (SerializeDetail::decodeLength(data, size, &bytes, format.swap) < 0)
+        {
+            return -1;
+        }
+        if (bytes == 0xffffffff)
+        {
+            *value = QByteArray();
+            return sizeof(quint32);
+        }
+        if (qint64(bytes) > size - qint64(sizeof(quint32)))
+        {
+            return -1;
+        }
+        *value = QByteArray(reinterpret_cast<const char *>(data + sizeof(quint32)), int(bytes));
+        return sizeof(quint32) + bytes;
+    }
+
+    static bool read(QDataStream &stream, QByteArray *value, SerializeDetail::Format format)
+    {
+        quint32 bytes = 0;
+        if (!SerializeDetail::readLength(stream, &bytes, format.swap))
+        {
+            return false;
+        }
+        if (bytes == 0xffffffff)
+        {
+            *value = QByteArray();
+            return true;
+        }
+        value->resize(int(bytes));
+        if (stream.readRawData(value->data(), int(bytes)) != int(bytes))
+        {
+            stream.setStatus(QDataStream::ReadPastEnd);
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief QVector/QList：quint32 个数 + 元素
+ */
+template <typename Container, typename T>
+struct SequenceCodec
+{
+    static const bool isFixed = false;
+    static const qint64 fixedSize = 0;
+    static const bool isVarint = false;
+
+    static qint64 size(const Container &values, SerializeDetail::Format format)
+    {
+        if (FieldCodec<T>::isFixed && !(FieldCodec<T>::isVarint && format.varint))
+        {
+            return sizeof(quint32) + qint64(values.size()) * FieldCodec<T>::fixedSize;
+        }
+        qint64 total = sizeof(quint32);
+        for (typename Container::const_iterator it = values.constBegin(); it != values.constEnd(); ++it)
+        {
+            total += FieldCodec<T>::size(*it, format);
+        }
+        return total;
+    }
+
+    static qint64 encode(const Container &values, uchar *out, qint64 capacity, SerializeDetail::Format format)
+    {
+        qint64 pos = SerializeDetail::encodeLength(quint32(values.size()), out, capacity, format.swap);
+        if (pos < 0)
+        {
+            return -1;
+        }
+        for (typename Container::const_iterator it = values.constBegin(); it != values.constEnd(); ++it)
+        {
+            qint64 used = FieldCodec<T>::encode(*it, out + pos, capacity - pos, format);
+            if (used < 0)
+            {
+                return -1;
+            }
+            pos += used;
+        }
+        return pos;
+    }
+
+    static qint64 decode(const uchar *data, qint64 size, Container *values, SerializeDetail::Format format)
+    {
+        quint32 count = 0;
+        qint64 pos = SerializeDetail::decodeLength(data, size, &count, format.swap);
+        if (pos < 0)
+        {
+            return -1;
+        }
+        values->clear();
+        values->reserve(int(qMin<qint64>(count, size)));
+        for (quint32 i = 0; i < count; ++i)
+        {
+            T value;
+            qint64 used = FieldCodec<T>::decode(data + pos, size - pos, &value, format);
+            if (used < 0)
+            {
+                return -1;
+            }
+            values->append(value);
+            pos += used;
+        }
+        return pos;
+    }
+
+    static bool read(QDataStream &stream, Container *values, SerializeDetail::Format format)
+    {
+        quint32 count = 0;
+        if (!SerializeDetail::readLength(stream, &count, format.swap))
+        {
+            return false;
+        }
+        values->clear();
+        for (quint32 i = 0; i < count; ++i)
+        {
+            T value;
+            if (!FieldCodec<T>::read(stream, &value, format))
+            {
+                return false;
+            }
+            values->append(value);
+        }
+        return true;
+    }
+};
+
+template <typename T>
+struct FieldCodec<QVector<T> > : SequenceCodec<QVector<T>, T>
+{
+};
+
+template <typename T>
+struct FieldCodec<QList<T> > : SequenceCodec<QList<T>, T>
+{
+};
+
+/**
+ * @brief 声明了字段列表（T::Fields）的类型，可以作为其它类型的字段嵌套
+ */
+template <typename T>
+struct FieldCodec<T, typename std::enable_if<SerializeDetail::HasFields<T>::value>::type>
+{
+    typedef typename T::Fields Fields;
+
+    static const bool isFixed = Fields::isFixed;
+    static const qint64 fixedSize = Fields::fixedSize;
+    static const bool isVarint = Fields::runHasVarint;
+
+    static qint64 size(const T &value, SerializeDetail::Format format)
+    {
+        return Fields::size(value, format);
+    }
+
+    static void put(const T &value, uchar *out, bool swap)
+    {
+        Fields::putRun(value, out, swap, std::integral_constant<bool, Fields::headFixed>());
+    }
+
+    static void get(const uchar *data, T *value, bool swap)
+    {
+        Fields::getRun(data, value, swap, std::integral_constant<bool, Fields::headFixed>());
+    }
+
+    static qint64 encode(const T &value, uchar *out, qint64 capacity, SerializeDetail::Format format)
+    {
+        return Fields::encode(value, out, capacity, format);
+    }
+
+    static qint64 decode(const uchar *data, qint64 size, T *value, SerializeDetail::Format format)
+    {
+        return Fields::decode(data, size, value, format);
+    }
+
+    static bool read(QDataStream &stream, T *value, SerializeDetail::Format format)
+    {
+        return Fields::read(stream, value, format);
+    }
+};
+
+/**
+ * @brief 空字段列表，递归的终点
+ */
+template <>
+struct SerializeFields<>
+{
+    static const bool headFixed = false;
+    static const qint64 runSize = 0;
+    static const bool runHasVarint = false;
+    static const bool isFixed = true;
+    static const qint64 fixedSize = 0;
+    typedef SerializeFields<> Tail;
+
+    template <typename Class>
+    static qint64 size(const Class &, SerializeDetail::Format)
+    {
+        return 0;
+    }
+
+    template <typename Class>
+    static qint64 encode(const Class &, uchar *, qint64, SerializeDetail::Format)
+    {
+        return 0;
+    }
+
+    template <typename Class>
+    static qint64 decode(const uchar *, qint64, Class *, SerializeDetail::Format)
+    {
+        return 0;
+    }
+
+    template <typename Class>
+    static bool read(QDataStream &, Class *, SerializeDetail::Format)
+    {
+        return true;
+    }
+
+    template <typename Class>
+    static void putRun(const Class &, uchar *, bool, std::false_type)
+    {
+    }
+
+    template <typename Class>
+    static void getRun(const uchar *, Class *, bool, std::false_type)
+    {
+    }
+};
+
+/**
+ * @brief 字段列表。headFixed 表示第一个字段是否定长，runSize 是从第一个字段开始连续定长字段的总长度，
+ *        Tail 是跳过这段定长字段之后剩下的字段列表。runHasVarint 表示这段定长字段中有 SerializeVarintVersion
+ *        会写成 varint 的整数，这时这一段在 varint 格式下逐个字段处理。
+ */
+template <typename Field, typename... Rest>
+struct SerializeFields<Field, Rest...>
+{
+    typedef typename std::remove_cv<typename Field::ValueType>::type ValueType;
+    typedef FieldCodec<ValueType> Codec;
+    typedef SerializeFields<Rest...> Next;
+
+    static const bool headFixed = Codec::isFixed;
+    static const qint64 runSize = Codec::isFixed ? Codec::fixedSize + Next::runSize : 0;
+    static const bool runHasVarint = Codec::isFixed && (Codec::isVarint || Next::runHasVarint);
+    static const bool isFixed = Codec::isFixed && Next::isFixed;
+    static const qint64 fixedSize = isFixed ? runSize : 0;
+    typedef typename std::conditional<Codec::isFixed, typename Next::Tail, SerializeFields>::type Tail;
+
+    template <typename Class>
+    static qint64 size(const Class &object, SerializeDetail::Format format)
+    {
+        return sizeFrom(object, format, std::integral_constant<bool, headFixed>());
+    }
+
+    template <typename Class>
+    static qint64 encode(const Class &object, uchar *out, qint64 capacity, SerializeDetail::Format format)
+    {
+        return encodeFrom(object, out, capacity, format, std::integral_constant<bool, headFixed>());
+    }
+
+    template <typename Class>
+    static qint64 decode(const uchar *data, qint64 size, Class *object, SerializeDetail::Format format)
+    {
+        return decodeFrom(data, size, object, format, std::integral_constant<bool, headFixed>());
+    }
+
+    template <typename Class>
+    static bool read(QDataStream &stream, Class *object, SerializeDetail::Format format)
+    {
+        return readFrom(stream, object, format, std::integral_constant<bool, headFixed>());
+    }
+
+    /**
+     * @brief 写入从这个字段开始的一段定长字段，调用者已经检查过长度
+     */
+    template <typename Class>
+    static void putRun(const Class &object, uchar *out, bool swap, std::true_type)
+    {
+        Codec::put(Field::get(object), out, swap);
+        Next::putRun(object, out + Codec::fixedSize, swap, std::integral_constant<bool, Next::headFixed>());
+    }
+
+    template <typename Class>
+    static void putRun(const Class &, uchar *, bool, std::false_type)
+    {
+    }
+
+    template <typename Class>
+    static void getRun(const uchar *data, Class *object, bool swap, std::true_type)
+    {
+        Codec::get(data, &Field::get(*object), swap);
+        Next::getRun(data + Codec::fixedSize, object, swap, std::integral_constant<bool, Next::headFixed>());
+    }
+
+    template <typename Class>
+    static void getRun(const uchar *, Class *, bool, std::false_type)
+    {
+    }
+
+private:
+    template <typename Class>
+    static qint64 sizeFrom(const Class &object, SerializeDetail::Format format, std::true_type)
+    {
+        if (runHasVarint && format.varint)
+        {
+            return sizeFrom(object, format, std::false_type());
+        }
+        return runSize + Tail::size(object, format);
+    }
+
+    template <typename Class>
+    static qint64 sizeFrom(const Class &object, SerializeDetail::Format format, std::false_type)
+    {
+        return Codec::size(Field::get(object), format) + Next::size(object, format);
+    }
+
+    template <typename Class>
+    static qint64 encodeFrom(const Class &object, uchar *out, qint64 capacity, SerializeDetail::Format format, std::true_type)
+    {
+        if (runHasVarint && format.varint)
+        {
+            return encodeFrom(object, out, capacity, format, std::false_type());
+        }
+        // 一段定长字段只检查一次长度
+        if (capacity < runSize)
+        {
+            return -1;
+        }
+        putRun(object, out, format.swap, std::true_type());
+        qint64 used = Tail::encode(object, out + runSize, capacity - runSize, format);
+        return used < 0 ? -1 : runSize + used;
+    }
+
+    template <typename Class>
+    static qint64 encodeFrom(const Class &object, uchar *out, qint64 capacity, SerializeDetail::Format format, std::false_type)
+    {
+        qint64 head = Codec::encode(Field::get(object), out, capacity, format);
+        if (head < 0)
+        {
+            return -1;
+        }
+        qint64 used = Next::encode(object, out + head, capacity - head, format);
+        return used < 0 ? -1 : head + used;
+    }
+
+    template <typename Class>
+    static qint64 decodeFrom(const uchar *data, qint64 size, Class *object, SerializeDetail::Format format, std::true_type)
+    {
+        if (runHasVarint && format.varint)
+        {
+            return decodeFrom(data, size, object, format, std::false_type());
+        }
+        if (size < runSize)
+        {
+            return -1;
+        }
+        getRun(data, object, format.swap, std::true_type());
+        qint64 used = Tail::decode(data + runSize, size - runSize, object, format);
+        return used < 0 ? -1 : runSize + used;
+    }
+
+    template <typename Class>
+    static qint64 decodeFrom(const uchar *data, qint64 size, Class *object, SerializeDetail::Format format, std::false_type)
+    {
+        qint64 head = Codec::decode(data, size, &Field::get(*object), format);
+        if (head < 0)
+        {
+            return -1;
+        }
+        qint64 used = Next::decode(data + head, size - head, object, format);
+        return used < 0 ? -1 : head + used;
+    }
+
+    template <typename Class>
+    static bool readFrom(QDataStream &stream, Class *object, SerializeDetail::Format format, std::true_type)
+    {
+        if (runHasVarint && format.varint)
+        {
+            return readFrom(stream, object, format, std::false_type());
+        }
+        // 一段定长字段一次读出
+        uchar run[runSize];
+        if (stream.readRawData(reinterpret_cast<char *>(run), int(runSize)) != int(runSize))
+        {
+            stream.setStatus(QDataStream::ReadPastEnd);
+            return false;
+        }
+        getRun(run, object, format.swap, std::true_type());
+        return Tail::read(stream, object, format);
+    }
+
+    template <typename Class>
+    static bool readFrom(QDataStream &stream, Class *object, SerializeDetail::Format format, std::false_type)
+    {
+        return Codec::read(stream, &Field::get(*object), format) && Next::read(stream, object, format);
+    }
+};
+
+/**
+ * @brief 序列化的入口，T 可以是声明了字段列表的类型，也可以是 FieldCodec 支持的其它类型。
+ */
+template <typename T>
+class Serializer
+{
+public:
+    typedef FieldCodec<T> Codec;
+
+    static const bool isFixed = Codec::isFixed;
+    static const qint64 fixedSize = Codec::fixedSize;
+
+    /**
+     * @brief 编码后的准确长度
+     */
+    static qint64 serializedSize(const T &value, int version = SerializeDataStreamVersion)
+    {
+        return Codec::size(value, SerializeDetail::format(QDataStream::BigEndian, version));
+    }
+
+    /**
+     * @brief 编码到调用者提供的缓冲区。
+     * @return 写入的字节数，缓冲区不够时返回 -1
+     */
+    static qint64 encode(const T &value, uchar *out, qint64 capacity,
+                         QDataStream::ByteOrder order = QDataStream::BigEndian,
+                         int version = SerializeDataStreamVersion)
+    {
+        return Codec::encode(value, out, capacity, SerializeDetail::format(order, version));
+    }
+
+    static QByteArray encode(const T &value, QDataStream::ByteOrder order = QDataStream::BigEndian,
+                             int version = SerializeDataStreamVersion)
+    {
+        QByteArray bytes(int(serializedSize(value, version)), Qt::Uninitialized);
+        encode(value, reinterpret_cast<uchar *>(bytes.data()), bytes.size(), order, version);
+        return bytes;
+    }
+
+    /**
+     * @brief 从内存解码。
+     * @return 使用的字节数，数据不完整或者不合法时返回 -1
+     */
+    static qint64 decode(const uchar *data, qint64 size, T *value,
+                         QDataStream::ByteOrder order = QDataStream::BigEndian,
+                         int version = SerializeDataStreamVersion)
+    {
+        return Codec::decode(data, size, value, SerializeDetail::format(order, version));
+    }
+
+    /**
+     * @brief 写入 QDataStream，使用流的字节顺序。先算出长度编码到一块缓冲区中，再一次写入。
+     *        编码失败（例如超出 int 范围）时设置 WriteFailed，不写入任何数据。
+     */
+    static bool write(QDataStream &stream, const T &value, int version = SerializeDataStreamVersion)
+    {
+        qint64 size = serializedSize(value, version);
+        if (size < 0 || size > INT_MAX)
+        {
+            stream.setStatus(QDataStream::WriteFailed);
+            return false;
+        }
+        uchar local[256];
+        QByteArray heap;
+        uchar *buffer = local;
+        if (size > qint64(sizeof(local)))
+        {
+            heap.resize(int(size));
+            buffer = reinterpret_cast<uchar *>(heap.data());
+        }
+        qint64 used = encode(value, buffer, size, stream.byteOrder(), version);
+        if (used < 0)
+        {
+            stream.setStatus(QDataStream::WriteFailed);
+            return false;
+        }
+        if (stream.writeRawData(reinterpret_cast<const char *>(buffer), int(used)) != int(used))
+        {
+            stream.setStatus(QDataStream::WriteFailed);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 从 QDataStream 读取，使用流的字节顺序。出错时设置流的状态并返回 false。
+     */
+    static bool read(QDataStream &stream, T *value, int version = SerializeDataStreamVersion)
+    {
+        return Codec::read(stream, value, SerializeDetail::format(stream.byteOrder(), version));
+    }
+};
+
+/**
+ * @brief FieldSerializable 写入的文件头：
+ *     "SRLZ" + quint16 version + quint16 flags（保留，按流的字节顺序）
+ *
+ * 没有文件头的数据是加入版本之前写入的，按 SerializeDataStreamVersion 读取。
+ */
+class SerializeHeader
+{
+public:
+    enum { Size = 8 };
+
+    static bool write(QDataStream &stream, int version = SerializeCurrentVersion)
+    {
+        if (stream.writeRawData(magic(), 4) != 4)
+        {
+            return false;
+        }
+        stream << quint16(version) << quint16(0);
+        return stream.status() == QDataStream::Ok;
+    }
+
+    /**
+     * @brief 读取文件头，没有文件头时不消耗数据，version 为 SerializeDataStreamVersion。
+     * @return 版本比 SerializeCurrentVersion 新时设置流的状态并返回 false
+     */
+    static bool read(QDataStream &stream, int *version)
+    {
+        *version = SerializeDataStreamVersion;
+        QIODevice *device = stream.device();
+        if (!device || device->peek(4) != QByteArray::fromRawData(magic(), 4))
+        {
+            return true;
+        }
+
+        char head[4];
+        quint16 value = 0;
+        quint16 flags = 0;
+        stream.readRawData(head, sizeof(head));
+        stream >> value >> flags;
+        if (stream.status() != QDataStream::Ok)
+        {
+            return false;
+        }
+        if (value > SerializeCurrentVersion)
+        {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            return false;
+        }
+        *version = value;
+        return true;
+    }
+
+    /**
+     * @brief 编码到 out（至少 Size 字节）
+     */
+    static void encode(uchar *out, QDataStream::ByteOrder order, int version = SerializeCurrentVersion)
+    {
+        memcpy(out, magic(), 4);
+        if (order == QDataStream::BigEndian)
+        {
+            qToBigEndian<quint16>(quint16(version), out + 4);
+            qToBigEndian<quint16>(0, out + 6);
+        }
+        else
+        {
+            qToLittleEndian<quint16>(quint16(version), out + 4);
+            qToLittleEndian<quint16>(0, out + 6);
+        }
+    }
+
+    /**
+     * @brief 从内存读取文件头，没有文件头时 version 为 SerializeDataStreamVersion。
+     * @return 文件头的字节数（0 或 Size），数据不完整或者版本比 SerializeCurrentVersion 新时返回 -1
+     */
+    static qint64 decode(const uchar *data, qint64 size, QDataStream::ByteOrder order, int *version)
+    {
+        *version = SerializeDataStreamVersion;
+        if (size < 4 || memcmp(data, magic(), 4) != 0)
+        {
+            return 0;
+        }
+        if (size < Size)
+        {
+            return -1;
+        }
+        quint16 value = order == QDataStream::BigEndian ? qFromBigEndian<quint16>(data + 4)
+                                                        : qFromLittleEndian<quint16>(data + 4);
+        if (value > SerializeCurrentVersion)
+        {
+            return -1;
+        }
+        *version = value;
+        return Size;
+    }
+
+private:
+    static const char *magic()
+    {
+        return "SRLZ";
+    }
+};
+
+/**
+ * @brief 用字段列表实现 SerializeInterface，Derived 需要声明 Fields。
+ *        写入时先写 SerializeHeader，再按 SerializeCurrentVersion 写字段；读取时按文件头中的版本。
+ *        基于内存的三个函数直接调用 Serializer，文件和 QDataStream 的写入使用 SerializeInterface 的默认实现。
+ *
+ *     class Point : public FieldSerializable<Point> { ... typedef SerializeFields<...> Fields; };
+ */
+template <typename Derived>
+class FieldSerializable : public SerializeInterface
+{
+public:
+    using SerializeInterface::serializeBinary;
+    using SerializeInterface::deSerializeBinary;
+
+    qint64 serializedSize() const override
+    {
+        return SerializeHeader::Size + Serializer<Derived>::serializedSize(derived(), SerializeCurrentVersion);
+    }
+
+    qint64 serializeBinary(uchar *out, qint64 capacity,
+                           QDataStream::ByteOrder order = QDataStream::BigEndian) const override
+    {
+        if (capacity < SerializeHeader::Size)
+        {
+            return -1;
+        }
+        SerializeHeader::encode(out, order, SerializeCurrentVersion);
+        qint64 used = Serializer<Derived>::encode(derived(), out + SerializeHeader::Size,
+                                                  capacity - SerializeHeader::Size, order, SerializeCurrentVersion);
+        return used < 0 ? -1 : SerializeHeader::Size + used;
+    }
+
+    qint64 deSerializeBinary(const uchar *data, qint64 size,
+                             QDataStream::ByteOrder order = QDataStream::BigEndian) override
+    {
+        int version = SerializeDataStreamVersion;
+        qint64 header = SerializeHeader::decode(data, size, order, &version);
+        if (header < 0)
+        {
+            return -1;
+        }
+        qint64 used = Serializer<Derived>::decode(data + header, size - header, static_cast<Derived *>(this),
+                                                  order, version);
+        return used < 0 ? -1 : header + used;
+    }
+
+    /**
+     * @brief 从流中按字段读取，不需要设备中已有完整的数据
+     */
+    bool deSerializeBinary(QDataStream &stream) override
+    {
+        int version = SerializeDataStreamVersion;
+        return SerializeHeader::read(stream, &version)
+                && Serializer<Derived>::read(stream, static_cast<Derived *>(this), version);
+    }
+
+private:
+    const Derived &derived() const
+    {
+        return static_cast<const Derived &>(*this);
+    }
+};
+
+#endif // SERIALIZEFIELDS_H
@@ -2,38 +2,203 @@
 #define SERIALIZE_H
 
 #include <QObject>
+#include <QByteArray>
 #include <QDataStream>
+#include <QFile>
+#include <QIODevice>
+#include <climits>
 
+/**
+ * @brief 二进制序列化接口。
+ *
+ * 实现类只需要实现三个基于内存的函数：serializedSize() 给出准确长度，
+ * serializeBinary(uchar *, ...) / deSerializeBinary(const uchar *, ...) 在调用者提供的连续缓冲区上编码、解码，
+ * 不经过 QIODevice，也不分配内存。文件和 QDataStream 版本默认在此基础上实现：
+ * 写入时先算出长度、编码到一块缓冲区，再一次写入；读取时直接在文件映射的内存上解码。
+ *
+ * 大量对象可以用 serializeBatch() 编码到同一块缓冲区中（只分配一次），再一次 write()。
+ */
 class SerializeInterface
 {
 public:
+    virtual ~SerializeInterface() {}
+
+    /**
+     * @brief 序列化之后的准确字节数
+     */
+    virtual qint64 serializedSize() const = 0;
+
+    /**
+     * @brief 序列化到调用者提供的缓冲区。
+     * @param[out] out 缓冲区
+     * @param[in] capacity 缓冲区的字节数，不少于 serializedSize() 时一定成功
+     * @param[in] order 字节顺序
+     * @return 写入的字节数，缓冲区不够时返回 -1
+     */
+    virtual qint64 serializeBinary(uchar *out, qint64 capacity,
+                                   QDataStream::ByteOrder order = QDataStream::BigEndian) const = 0;
+
+    /**
+     * @brief 从内存反序列化，需要与序列化时使用相同的字节顺序。
+     * @param[in] data 数据
+     * @param[in] size 数据的字节数，可以比一个对象长（例如 serializeBatch() 写入的一批对象）
+     * @param[in] order 字节顺序
+     * @return 使用的字节数，数据不完整或者不合法时返回 -1
+     */
+    virtual qint64 deSerializeBinary(const uchar *data, qint64 size,
+                                     QDataStream::ByteOrder order = QDataStream::BigEndian) = 0;
 
     /**
     * @brief 用来把类对象进行二进制方式序列化的函数。
     * @param[in] fileName 文件名。
     * @return 执行结果
     */
-    virtual bool serializeBinary(const QString &fileName) const = 0;
+    virtual bool serializeBinary(const QString &fileName) const
+    {
+        QFile file(fileName);
+        if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+            return false;
+        }
+        QDataStream stream(&file);
+        stream.setByteOrder(QDataStream::BigEndian);
+        bool written = serializeBinary(stream);
+        file.close();
+        return written;
+    }
 
     /**
      * @brief 用来把类对象进行二进制方式序列化的函数。本接口的实现需要设置字节顺序
+     *        默认实现编码失败时设置 WriteFailed，不写入任何数据。
      * @param[in] stream 文件流对象。
      * @return 执行结果
      */
-    virtual bool serializeBinary(QDataStream& stream) const = 0;
+    virtual bool serializeBinary(QDataStream& stream) const
+    {
+        qint64 size = serializedSize();
+        if (size < 0 || size > INT_MAX)
+        {
+            stream.setStatus(QDataStream::WriteFailed);
+            return false;
+        }
+        uchar local[256];
+        QByteArray heap;
+        uchar *buffer = local;
+        if (size > qint64(sizeof(local)))
+        {
+            heap.resize(int(size));
+            buffer = reinterpret_cast<uchar *>(heap.data());
+        }
+        qint64 used = serializeBinary(buffer, size, stream.byteOrder());
+        if (used < 0 || stream.writeRawData(reinterpret_cast<const char *>(buffer), int(used)) != int(used))
+        {
+            stream.setStatus(QDataStream::WriteFailed);
+            return false;
+        }
+        return true;
+    }
 
     /**
-    * @brief 用来把类对象进行二进制方式反序列化的函数。
+    * @brief 用来把类对象进行二进制方式反序列化的函数。文件能映射到内存时直接在映射上解码。
     * @param[in] fileName 文件名。
     * @return 执行结果
     */
-    virtual bool deSerializeBinary(const QString& fileName) = 0;
+    virtual bool deSerializeBinary(const QString& fileName)
+    {
+        QFile file(fileName);
+        if (!file.open(QFile::ReadOnly)) {
+            return false;
+        }
+        qint64 size = file.size();
+        const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+        QByteArray bytes;
+        if (!data)
+        {
+            bytes = file.readAll();
+            data = reinterpret_cast<const uchar *>(bytes.constData());
+            size = bytes.size();
+        }
+        bool read = deSerializeBinary(data, size, QDataStream::BigEndian) >= 0;
+        file.close();
+        return read;
+    }
+
     /**
     * @brief 用来把类对象进行二进制方式序列化的函数。本接口的实现需要与序列化保存设置相同的字节顺序
+    *        默认实现在设备中已有的数据上解码（peek），只消耗用到的字节；顺序设备需要在调用前收到完整的数据。
+    *        先只取一小段，解码失败（数据可能不完整）时加倍重试，直到取完设备中剩下的数据，
+    *        因此逐个读取 N 个对象只复制 O(N) 字节，而不是每次都复制剩下的全部数据。
+    *        取完剩下的数据仍然解码失败时按数据不完整处理，与 QDataStream 读到末尾时一样设置 ReadPastEnd，
+    *        不消耗数据。
     * @param[in] stream 文件流对象。
     * @return 执行结果
     */
-    virtual bool deSerializeBinary(QDataStream& ds) = 0;
+    virtual bool deSerializeBinary(QDataStream& ds)
+    {
+        QIODevice *device = ds.device();
+        if (!device)
+        {
+            return false;
+        }
+        qint64 available = device->bytesAvailable();
+        qint64 window = qMin<qint64>(available, 256);
+        qint64 used = -1;
+        for (;;)
+        {
+            QByteArray data = device->peek(window);
+            used = deSerializeBinary(reinterpret_cast<const uchar *>(data.constData()), data.size(), ds.byteOrder());
+            qint64 next = qMin(available, qMin<qint64>(window * 2, INT_MAX));
+            if (used >= 0 || next == window)
+            {
+                break;
+            }
+            window = next;
+        }
+        if (used < 0)
+        {
+            ds.setStatus(QDataStream::ReadPastEnd);
+            return false;
+        }
+        return ds.skipRawData(int(used)) == int(used);
+    }
+
+    /**
+     * @brief 把 [begin, end) 中的对象依次序列化追加到 out：先累加长度，out 只扩大一次，之后可以一次写入。
+     *        Iterator 解引用得到 SerializeInterface 的派生类对象。
+     * @return 执行结果，失败时 out 恢复原来的长度
+     */
+    template <typename Iterator>
+    static bool serializeBatch(Iterator begin, Iterator end, QByteArray *out,
+                               QDataStream::ByteOrder order = QDataStream::BigEndian)
+    {
+        qint64 total = 0;
+        for (Iterator it = begin; it != end; ++it)
+        {
+            const SerializeInterface &object = *it;
+            total += object.serializedSize();
+        }
+
+        int start = out->size();
+        if (total > qint64(INT_MAX - start))
+        {
+            return false;
+        }
+        out->resize(start + int(total));
+        uchar *data = reinterpret_cast<uchar *>(out->data()) + start;
+        qint64 pos = 0;
+        for (Iterator it = begin; it != end; ++it)
+        {
+            const SerializeInterface &object = *it;
+            qint64 used = object.serializeBinary(data + pos, total - pos, order);
+            if (used < 0)
+            {
+                out->resize(start);
+                return false;
+            }
+            pos += used;
+        }
+        out->resize(start + int(pos));
+        return true;
+    }
 };
 
 #endif // SERIALIZE_H
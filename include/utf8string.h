@@ -0,0 +1,324 @@
+#ifndef UTF8STRING_H
+#define UTF8STRING_H
+
+#include <QString>
+#include <QtEndian>
+#include <cstring>
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#  define UTF8STRING_SSE2
+#  include <emmintrin.h>
+#endif
+
+/**
+ * @brief QString（UTF-16）与 UTF-8 之间的转换（只有头文件）。
+ *
+ * 用户名、密码这类字符串几乎都是 ASCII，所以先按块判断是否全是 ASCII：
+ * x86 上用 SSE2 每次处理 16 字节（编码时 8 个 UTF-16 码元），其它平台每次 8 字节（4 个码元），
+ * 整块都是 ASCII 时直接扩展或收窄，遇到非 ASCII 的块再逐个字符转换。
+ *
+ * 编码时不成对的代理项写成 U+FFFD；解码时拒绝不合法的 UTF-8（过长编码、代理项、超出 U+10FFFF、截断的序列）。
+ */
+class Utf8String
+{
+public:
+    /**
+     * @brief 编码成 UTF-8 之后的字节数
+     */
+    static int size(const QChar *data, int length)
+    {
+        const ushort *in = reinterpret_cast<const ushort *>(data);
+        int bytes = 0;
+        int i = 0;
+        while (i < length)
+        {
+            int ascii = asciiPrefix(in + i, length - i);
+            bytes += ascii;
+            i += ascii;
+            if (i == length)
+            {
+                break;
+            }
+            bytes += charSize(in, length, &i);
+        }
+        return bytes;
+    }
+
+    static int size(const QString &str)
+    {
+        return size(str.constData(), str.size());
+    }
+
+    /**
+     * @brief 编码成 UTF-8，调用者保证 out 至少有 size() 字节。
+     * @return 写入的字节数
+     */
+    static int encode(const QChar *data, int length, uchar *out)
+    {
+        const ushort *in = reinterpret_cast<const ushort *>(data);
+        uchar *start = out;
+        int i = 0;
+        while (i < length)
+        {
+            int ascii = narrowAscii(in + i, length - i, out);
+            out += ascii;
+            i += ascii;
+            if (i == length)
+            {
+                break;
+            }
+            out = encodeChar(in, length, &i, out);
+        }
+        return int(out - start);
+    }
+
+    static int encode(const QString &str, uchar *out)
+    {
+        return encode(str.constData(), str.size(), out);
+    }
+
+    /**
+     * @brief 解码 UTF-8，str 的存储没有被共享时直接复用。
+     * @return 数据不是合法的 UTF-8 时返回 false
+     */
+    static bool decode(const uchar *data, int size, QString *str)
+    {
+        // UTF-16 码元个数不会超过 UTF-8 字节数
+        str->resize(size);
+        ushort *out = reinterpret_cast<ushort *>(str->data());
+        ushort *start = out;
+        int i = 0;
+        while (i < size)
+        {
+            int ascii = widenAscii(data + i, size - i, out);
+            out += ascii;
+            i += ascii;
+            if (i == size)
+            {
+                break;
+            }
+            if (!decodeChar(data, size, &i, &out))
+            {
+                str->clear();
+                return false;
+            }
+        }
+        str->truncate(int(out - start));
+        return true;
+    }
+
+private:
+    /**
+     * @brief 开头连续的 ASCII 码元个数（按块判断，可能少算最后不足一块的部分，由调用者逐个处理）
+     */
+    static int asciiPrefix(const ushort *in, int length)
+    {
+        int i = 0;
+#ifdef UTF8STRING_SSE2
+        const __m128i mask = _mm_set1_epi16(short(0xff80));
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= length; i += 8)
+        {
+            __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, mask), zero)) != 0xffff)
+            {
+                break;
+            }
+        }
+#else
+        for (; i + 4 <= length; i += 4)
+        {
+            quint64 units;
+            memcpy(&units, in + i, sizeof(units));
+            if (units & Q_UINT64_C(0xff80ff80ff80ff80))
+            {
+                break;
+            }
+        }
+#endif
+        while (i < length && in[i] < 0x80)
+        {
+            ++i;
+        }
+        return i;
+    }
+
+    /**
+     * @brief 把开头连续的 ASCII 码元收窄成字节写入 out，返回个数
+     */
+    static int narrowAscii(const ushort *in, int length, uchar *out)
+    {
+        int i = 0;
+#ifdef UTF8STRING_SSE2
+        const __m128i mask = _mm_set1_epi16(short(0xff80));
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= length; i += 8)
+        {
+            __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, mask), zero)) != 0xffff)
+            {
+                break;
+            }
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(units, units));
+        }
+#endif
+        for (; i < length && in[i] < 0x80; ++i)
+        {
+            out[i] = uchar(in[i]);
+        }
+        return i;
+    }
+
+    /**
+     * @brief 把开头连续的 ASCII 字节扩展成 UTF-16 写入 out，返回个数
+     */
+    static int widenAscii(const uchar *in, int size, ushort *out)
+    {
+        int i = 0;
+#ifdef UTF8STRING_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+            {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 8), _mm_unpackhi_epi8(bytes, zero));
+        }
+#else
+        for (; i + 8 <= size; i += 8)
+        {
+            quint64 bytes;
+            memcpy(&bytes, in + i, sizeof(bytes));
+            if (bytes & Q_UINT64_C(0x8080808080808080))
+            {
+                break;
+            }
+            for (int j = 0; j < 8; ++j)
+            {
+                out[i + j] = in[i + j];
+            }
+        }
+#endif
+        for (; i < size && in[i] < 0x80; ++i)
+        {
+            out[i] = in[i];
+        }
+        return i;
+    }
+
+    static int charSize(const ushort *in, int length, int *i)
+    {
+        ushort unit = in[(*i)++];
+        if (unit < 0x80)
+        {
+            return 1;
+        }
+        if (unit < 0x800)
+        {
+            return 2;
+        }
+        if (QChar::isHighSurrogate(unit) && *i < length && QChar::isLowSurrogate(in[*i]))
+        {
+            ++*i;
+            return 4;
+        }
+        return 3;
+    }
+
+    static uchar *encodeChar(const ushort *in, int length, int *i, uchar *out)
+    {
+        uint code = in[(*i)++];
+        if (code < 0x80)
+        {
+            *out++ = uchar(code);
+            return out;
+        }
+        if (code < 0x800)
+        {
+            *out++ = uchar(0xc0 | (code >> 6));
+            *out++ = uchar(0x80 | (code & 0x3f));
+            return out;
+        }
+        if (QChar::isSurrogate(code))
+        {
+            if (QChar::isHighSurrogate(code) && *i < length && QChar::isLowSurrogate(in[*i]))
+            {
+                code = QChar::surrogateToUcs4(ushort(code), in[(*i)++]);
+                *out++ = uchar(0xf0 | (code >> 18));
+                *out++ = uchar(0x80 | ((code >> 12) & 0x3f));
+                *out++ = uchar(0x80 | ((code >> 6) & 0x3f));
+                *out++ = uchar(0x80 | (code & 0x3f));
+                return out;
+            }
+            code = QChar::ReplacementCharacter;
+        }
+        *out++ = uchar(0xe0 | (code >> 12));
+        *out++ = uchar(0x80 | ((code >> 6) & 0x3f));
+        *out++ = uchar(0x80 | (code & 0x3f));
+        return out;
+    }
+
+    static bool decodeChar(const uchar *in, int size, int *i, ushort **out)
+    {
+        uchar lead = in[*i];
+        int extra;
+        uint code;
+        uint minimum;
+        if ((lead & 0xe0) == 0xc0)
+        {
+            extra = 1;
+            code = lead & 0x1f;
+            minimum = 0x80;
+        }
+        else if ((lead & 0xf0) == 0xe0)
+        {
+            extra = 2;
+            code = lead & 0x0f;
+            minimum = 0x800;
+        }
+        else if ((lead & 0xf8) == 0xf0)
+        {
+            extra = 3;
+            code = lead & 0x07;
+            minimum = 0x10000;
+        }
+        else
+        {
+            return false;
+        }
+        if (size - *i <= extra)
+        {
+            return false;
+        }
+        for (int k = 1; k <= extra; ++k)
+        {
+            uchar next = in[*i + k];
+            if ((next & 0xc0) != 0x80)
+            {
+                return false;
+            }
+            code = (code << 6) | (next & 0x3f);
+        }
+        if (code < minimum || code > 0x10ffff || QChar::isSurrogate(code))
+        {
+            return false;
+        }
+        *i += extra + 1;
+
+        if (QChar::requiresSurrogates(code))
+        {
+            *(*out)++ = QChar::highSurrogate(code);
+            *(*out)++ = QChar::lowSurrogate(code);
+        }
+        else
+        {
+            *(*out)++ = ushort(code);
+        }
+        return true;
+    }
+};
+
+#endif // UTF8STRING_H
@@ -1,71 +1,38 @@
 #include <QCoreApplication>
 #include <QFile>
-#include <QDateTime>
 #include <QDebug>
-#include <QTextCodec>
 
 #include "data/user.h"
 #include "dao/userdao.h"
 
+// 性能测试见 benchmark/benchmark.pro
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
 
-    int i = 0;
-    QVector<User> users;
-    for (i = 0; i < 1000000; i++)
-    {
-        User user(i, "name" + QString::number(i), "field");
-        users.append(user);
-    }
-    UserDao dao;
-    QDateTime begin;
-    QDateTime end;
+    UserDao dao("user.dat");
+    QFile::remove(dao.fileName());
+    QFile::remove(dao.indexFileName());
+    QFile::remove(dao.checkpointFileName());
 
+    QVector<User> users;
+    for (int i = 0; i < 10; i++)
     {
-        begin = QDateTime::currentDateTime();
-
-        dao.insert(users);
-
-        end = QDateTime::currentDateTime();
-
-        qDebug() << "插入 " << users.size() << "个数据，耗时（毫秒） " << begin.msecsTo(end);
-
+        users.append(User(i, "name" + QString::number(i), "field"));
     }
+    dao.insert(users);
+    dao.insert(User(10, "name10", "field"));
 
-    {
-        User user(i, "name" + QString::number(i), "field");
-
-        begin = QDateTime::currentDateTime();
-
-        dao.insert(user);
+    User user = dao.select(5);
+    qDebug() << user.id() << user.userName() << user.password();
 
-        end = QDateTime::currentDateTime();
-        qDebug() << "插入单个数据，耗时（毫秒） " << begin.msecsTo(end);
-    }
+    dao.update(User(5, "name5", "changed"));
+    dao.remove(User(6, "", ""));
 
-    QVector<User> selectUsers;
+    foreach (const User &u, dao.selectAll())
     {
-        begin = QDateTime::currentDateTime();
-
-        selectUsers = dao.selectAll();
-
-        end = QDateTime::currentDateTime();
-
-        qDebug() << "查询所有数据，耗时（毫秒） " << begin.msecsTo(end);
-
-    }
-
-    {
-        begin = QDateTime::currentDateTime();
-
-        dao.select(50);
-
-        end = QDateTime::currentDateTime();
-
-        qDebug() << "查询单个数据，耗时（毫秒） " << begin.msecsTo(end);
-
+        qDebug() << u.id() << u.userName() << u.password();
     }
 
-    return a.exec();
+    return 0;
 }
@@ -7,15 +7,16 @@ CONFIG -= app_bundle
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(data/data.pri)
+include(dao/dao.pri)
+
 HEADERS += \
-        dao/userdao.h \
-        data/user.h \
+        include/serializefields.h \
+        include/utf8string.h \
         include/serializeinterface.h
 
 SOURCES += \
         main.cpp \
-        data/user.cpp \
-        dao/userdao.cpp \
 
 
 # Default rules for deployment.